@@ -1,8 +1,34 @@
 from esp_now_utils import *
+from struct import calcsize, pack, unpack_from
 from time import sleep_ms, ticks_diff, ticks_ms
 
+# Mirrors wire_movement_orders_t in Camera-Face-Detection/main/include/app_wire.hpp:
+# magic, version, kind, sequence, capture time (us), horizontal, vertical, forward, confidence
+MOVEMENT_ORDERS_FORMAT = '<HBBHIhhhB'
+MOVEMENT_ORDERS_SIZE = calcsize(MOVEMENT_ORDERS_FORMAT)
+MOVEMENT_ORDERS_MAGIC = 0xA1CA
+MOVEMENT_ORDERS_VERSION = 2
+ROTATION_SCALE = 100
+DISPLACEMENT_SCALE = 100
+CONFIDENCE_SCALE = 255
+
+# wire_kind_t
+KIND_ORDERS = 0
+KIND_HEARTBEAT = 1
+KIND_NO_TARGET = 2
+KIND_ALVIK_HEARTBEAT = 3
+
+# Mirrors wire_heartbeat_t: magic, version, kind, sequence of the last frame received
+HEARTBEAT_FORMAT = '<HBBH'
+
+# The camera sends a frame every 100 ms (TRANSMISSION_PERIOD) once paired, missing three means the link is gone
+LINK_TIMEOUT_MS = 300
+
+camera_MAC = None
+
 
 def connect_to_camera(connection_timeout):
+  global camera_MAC
   broadcast_MAC = b'\xff' * 6
   local_MAC = get_mac_address()
   connected = False
@@ -18,9 +44,15 @@ def connect_to_camera(connection_timeout):
     mac, msg = esp.irecv(1000)
     if mac is not None:
       print(f'Got a message from MAC: {mac_address_to_string(mac)}')
-      if msg == b'ARDUINO_ALVIK_CAMERA_FACEDETECTOR_:P\x00':
+      if msg.startswith(b'ARDUINO_ALVIK_CAMERA_FACEDETECTOR_:P'):
         print('ESP32S3-EYE CONNECTED')
         connected = True
+        if camera_MAC != mac:
+          try:
+            esp.add_peer(mac) # heartbeats go back to the camera only
+          except OSError:
+            pass
+          camera_MAC = mac
 
 
 def start_camera_comms(connection_timeout = 120000):
@@ -37,18 +69,32 @@ def start_camera_comms(connection_timeout = 120000):
   connect_to_camera(connection_timeout)
 
 
-def poll_camera(timeout_ms = 50, connection_timeout = 120000):
+def send_heartbeat(sequence):
+  # Tells the camera the link is alive, without waiting for the radio to acknowledge it
+  esp.send(camera_MAC, pack(HEARTBEAT_FORMAT, MOVEMENT_ORDERS_MAGIC, MOVEMENT_ORDERS_VERSION, KIND_ALVIK_HEARTBEAT, sequence), False)
+
+
+# Returns the orders, or None when the camera has no target or nothing came within timeout_ms:
+# either way the robot stops
+def poll_camera(timeout_ms = LINK_TIMEOUT_MS, connection_timeout = 120000):
   mac, msg = esp.irecv(timeout_ms)
   if mac is not None:
-    null_index = msg.find(b'\x00')
-    dataStr = msg[:null_index].decode('utf-8')
-    if dataStr == 'ARDUINO_ALVIK_CAMERA_FACEDETECTOR_:P':
+    if len(msg) >= MOVEMENT_ORDERS_SIZE:
+      magic, version, kind, sequence, capture_time, horizontal, vertical, forward, confidence = unpack_from(MOVEMENT_ORDERS_FORMAT, msg)
+      if magic == MOVEMENT_ORDERS_MAGIC:
+        if version != MOVEMENT_ORDERS_VERSION:
+          print(f'Unsupported movement orders version {version}')
+          return None
+        if camera_MAC is not None:
+          send_heartbeat(sequence)
+        if kind == KIND_NO_TARGET:
+          return None
+        horizontalRotation = horizontal / ROTATION_SCALE
+        verticalRotation = vertical / ROTATION_SCALE
+        displacementSpeed = forward / DISPLACEMENT_SCALE
+        return [horizontalRotation, verticalRotation, displacementSpeed, confidence / CONFIDENCE_SCALE]
+
+    if msg.startswith(b'ARDUINO_ALVIK_CAMERA_FACEDETECTOR_:P'):
       print('Camera requesting reconnect')
       connect_to_camera(connection_timeout)
-    else:
-      data = dataStr.split(',')
-      horizontalRotation = float(data[0])
-      verticalRotation = float(data[1])
-      displacementSpeed = float(data[2])
-      return [horizontalRotation, verticalRotation, displacementSpeed]
   return None
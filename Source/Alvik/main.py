@@ -39,14 +39,17 @@ def move_servo_at_speed(speed_dgps, upper_limit = 100, lower_limit = 80):
 
 while True:
   if alvik.is_on():
-    data = poll_camera(2500)
+    # A frame comes every 100 ms while the link is up, a no-target frame or none at all stops the robot
+    data = poll_camera(LINK_TIMEOUT_MS)
     if data is not None:
       horizontal_rotation = data[0]
       vertical_rotation = data[1]
       displacement_speed = data[2]
-      print(f'horizontal_rotation: {horizontal_rotation}\tvertical_rotation: {vertical_rotation}\tdisplacement_speed: {displacement_speed}')
-      
-      alvik.drive(displacement_speed, horizontal_rotation)
+      confidence = data[3]
+      print(f'horizontal_rotation: {horizontal_rotation}\tvertical_rotation: {vertical_rotation}\tdisplacement_speed: {displacement_speed}\tconfidence: {confidence}')
+
+      # Slow down as the camera's prediction of the target ages
+      alvik.drive(displacement_speed * confidence, horizontal_rotation * confidence)
       # alvik.drive(0, horizontal_rotation)
       move_servo_at_speed(vertical_rotation)
     else:
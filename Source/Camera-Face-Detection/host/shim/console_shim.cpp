@@ -0,0 +1,94 @@
+// esp_console replacement: commands are kept in a table and run on demand by
+// the harness instead of from a REPL task.
+
+#include "esp_console.h"
+#include "host_hooks.h"
+
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+struct host_console_repl_t
+{
+    std::string prompt;
+};
+
+static std::map<std::string, esp_console_cmd_t> commands;
+
+esp_err_t esp_console_cmd_register(const esp_console_cmd_t *cmd)
+{
+    if (cmd->command == nullptr || strchr(cmd->command, ' ') || cmd->func == nullptr)
+        return ESP_ERR_INVALID_ARG;
+    commands[cmd->command] = *cmd;
+    return ESP_OK;
+}
+
+static int help_command(int, char **)
+{
+    for (auto &entry : commands)
+        printf("%s %s\n  %s\n", entry.first.c_str(), entry.second.hint ? entry.second.hint : "", entry.second.help ? entry.second.help : "");
+    return 0;
+}
+
+esp_err_t esp_console_register_help_command()
+{
+    esp_console_cmd_t command = {"help", "Print the list of registered commands", nullptr, &help_command, nullptr};
+    return esp_console_cmd_register(&command);
+}
+
+esp_err_t esp_console_new_repl_usb_serial_jtag(const esp_console_dev_usb_serial_jtag_config_t *,
+                                               const esp_console_repl_config_t *repl_config,
+                                               esp_console_repl_t **ret_repl)
+{
+    *ret_repl = new host_console_repl_t{repl_config->prompt ? repl_config->prompt : ""};
+    return ESP_OK;
+}
+
+esp_err_t esp_console_new_repl_uart(const esp_console_dev_uart_config_t *,
+                                    const esp_console_repl_config_t *repl_config,
+                                    esp_console_repl_t **ret_repl)
+{
+    *ret_repl = new host_console_repl_t{repl_config->prompt ? repl_config->prompt : ""};
+    return ESP_OK;
+}
+
+esp_err_t esp_console_start_repl(esp_console_repl_t *)
+{
+    return ESP_OK;
+}
+
+int host_console_run(const char *command_line)
+{
+    std::vector<std::string> words;
+    std::string line(command_line), word;
+    for (char c : line)
+    {
+        if (c == ' ')
+        {
+            if (!word.empty())
+                words.push_back(word);
+            word.clear();
+        }
+        else
+        {
+            word += c;
+        }
+    }
+    if (!word.empty())
+        words.push_back(word);
+    if (words.empty())
+        return 0;
+
+    auto it = commands.find(words[0]);
+    if (it == commands.end())
+    {
+        printf("Unrecognized command: %s\n", words[0].c_str());
+        return 1;
+    }
+
+    std::vector<char *> argv;
+    for (std::string &arg : words)
+        argv.push_back(&arg[0]);
+    return it->second.func(argv.size(), argv.data());
+}
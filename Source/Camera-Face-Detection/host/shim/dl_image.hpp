@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace dl
+{
+    namespace image
+    {
+        void resize_image_nearest(uint16_t *input, std::vector<int> input_shape, uint16_t *output, std::vector<int> output_shape);
+    }
+}
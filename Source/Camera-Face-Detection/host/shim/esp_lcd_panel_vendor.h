@@ -0,0 +1,18 @@
+#pragma once
+
+#include "esp_lcd_panel_io.h"
+
+typedef enum
+{
+    LCD_RGB_ENDIAN_RGB = 0,
+    LCD_RGB_ENDIAN_BGR,
+} lcd_rgb_endian_t;
+
+typedef struct
+{
+    int reset_gpio_num;
+    lcd_rgb_endian_t rgb_endian;
+    unsigned int bits_per_pixel;
+} esp_lcd_panel_dev_config_t;
+
+esp_err_t esp_lcd_new_panel_st7789(const esp_lcd_panel_io_handle_t io, const esp_lcd_panel_dev_config_t *panel_dev_config, esp_lcd_panel_handle_t *ret_panel);
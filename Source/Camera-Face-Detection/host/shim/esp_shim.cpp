@@ -0,0 +1,537 @@
+// Host implementations of the ESP-IDF services used by the application:
+// logging, esp_timer, GPIO outputs, NVS, Wi-Fi, ESP-NOW and the one-shot ADC.
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_now.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "nvs_flash.h"
+#include "esp_adc/adc_oneshot.h"
+#include "driver/gpio.h"
+
+#include "host_hooks.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <new>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/* ---------------------------------------------------------------- esp_err */
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_ESPNOW_NOT_FOUND:
+        return "ESP_ERR_ESPNOW_NOT_FOUND";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
+
+void esp_restart()
+{
+    fprintf(stderr, "esp_restart() called\n");
+    abort();
+}
+
+/* ---------------------------------------------------------------- heap_caps */
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    void *ptr = malloc(size);
+    if (ptr)
+        esp_heap_trace_alloc_hook(ptr, size, caps);
+    return ptr;
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+    void *ptr = calloc(n, size);
+    if (ptr)
+        esp_heap_trace_alloc_hook(ptr, n * size, caps);
+    return ptr;
+}
+
+void *heap_caps_aligned_alloc(size_t alignment, size_t size, uint32_t caps)
+{
+    void *ptr = aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    if (ptr)
+        esp_heap_trace_alloc_hook(ptr, size, caps);
+    return ptr;
+}
+
+void heap_caps_free(void *ptr)
+{
+    if (ptr)
+        esp_heap_trace_free_hook(ptr);
+    free(ptr);
+}
+
+size_t heap_caps_get_total_size(uint32_t caps)
+{
+    return 0;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    return 0;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+    return 0;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    return 0;
+}
+
+// On the robot new and delete go through the heap_caps allocator and its hooks
+void *operator new(size_t size)
+{
+    void *ptr = malloc(size ? size : 1);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    esp_heap_trace_alloc_hook(ptr, size, MALLOC_CAP_DEFAULT);
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    if (ptr)
+        esp_heap_trace_free_hook(ptr);
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+/* ---------------------------------------------------------------- esp_timer */
+
+static const std::chrono::steady_clock::time_point timer_epoch = std::chrono::steady_clock::now();
+
+int64_t esp_timer_get_time()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - timer_epoch).count();
+}
+
+struct host_esp_timer_t
+{
+    esp_timer_cb_t callback;
+    void *arg;
+    int64_t alarm;  // esp_timer time the callback is due, -1 while stopped
+    uint64_t period; // us, 0 for one-shot
+};
+
+// Never destroyed: the dispatcher thread is still waiting on them when the process exits
+static std::mutex &timer_lock = *new std::mutex;
+static std::condition_variable &timer_changed = *new std::condition_variable;
+static std::set<host_esp_timer_t *> &timers = *new std::set<host_esp_timer_t *>;
+static bool timer_thread_started = false;
+
+// Sleeps until the earliest alarm; callbacks run without the lock so they may restart timers
+static void timer_dispatch()
+{
+    std::unique_lock<std::mutex> guard(timer_lock);
+    while (true)
+    {
+        host_esp_timer_t *due = nullptr;
+        for (host_esp_timer_t *timer : timers)
+            if (timer->alarm >= 0 && (due == nullptr || timer->alarm < due->alarm))
+                due = timer;
+        if (due == nullptr)
+        {
+            timer_changed.wait(guard);
+            continue;
+        }
+        int64_t wait = due->alarm - esp_timer_get_time();
+        if (wait > 0)
+        {
+            timer_changed.wait_for(guard, std::chrono::microseconds(wait));
+            continue;
+        }
+        due->alarm = due->period ? due->alarm + due->period : -1;
+        esp_timer_cb_t callback = due->callback;
+        void *arg = due->arg;
+        guard.unlock();
+        callback(arg);
+        guard.lock();
+    }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    std::lock_guard<std::mutex> guard(timer_lock);
+    if (!timer_thread_started)
+    {
+        std::thread(timer_dispatch).detach();
+        timer_thread_started = true;
+    }
+    host_esp_timer_t *timer = new host_esp_timer_t{create_args->callback, create_args->arg, -1, 0};
+    timers.insert(timer);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t timer_start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period)
+{
+    std::lock_guard<std::mutex> guard(timer_lock);
+    if (timer->alarm >= 0)
+        return ESP_ERR_INVALID_STATE;
+    timer->alarm = esp_timer_get_time() + static_cast<int64_t>(timeout_us);
+    timer->period = period;
+    timer_changed.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return timer_start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    return timer_start(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    std::lock_guard<std::mutex> guard(timer_lock);
+    if (timer->alarm < 0)
+        return ESP_ERR_INVALID_STATE;
+    timer->alarm = -1;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    std::lock_guard<std::mutex> guard(timer_lock);
+    if (timer->alarm >= 0)
+        return ESP_ERR_INVALID_STATE;
+    timers.erase(timer);
+    delete timer;
+    return ESP_OK;
+}
+
+/* ---------------------------------------------------------------- gpio */
+
+static std::atomic<host_gpio_hook_t> gpio_hook{nullptr};
+static std::atomic<uint64_t> gpio_levels{0};
+
+esp_err_t gpio_config(const gpio_config_t *)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX)
+        return ESP_ERR_INVALID_ARG;
+    uint64_t bit = 1ULL << gpio_num;
+    if (level)
+        gpio_levels.fetch_or(bit);
+    else
+        gpio_levels.fetch_and(~bit);
+    host_gpio_hook_t hook = gpio_hook.load();
+    if (hook)
+        hook(gpio_num, level ? 1 : 0, esp_timer_get_time());
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    return (gpio_levels.load() >> gpio_num) & 1;
+}
+
+void host_gpio_set_hook(host_gpio_hook_t hook)
+{
+    gpio_hook.store(hook);
+}
+
+/* ---------------------------------------------------------------- esp_log */
+
+static std::mutex log_lock;
+static std::map<std::string, esp_log_level_t> log_levels;
+static esp_log_level_t log_default_level = ESP_LOG_INFO;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    std::lock_guard<std::mutex> guard(log_lock);
+    if (strcmp(tag, "*") == 0)
+    {
+        log_default_level = level;
+        log_levels.clear();
+    }
+    else
+    {
+        log_levels[tag] = level;
+    }
+}
+
+uint32_t esp_log_timestamp()
+{
+    return static_cast<uint32_t>(esp_timer_get_time() / 1000);
+}
+
+static bool log_enabled(esp_log_level_t level, const char *tag)
+{
+    auto it = log_levels.find(tag);
+    return level <= (it == log_levels.end() ? log_default_level : it->second);
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    std::lock_guard<std::mutex> guard(log_lock);
+    if (!log_enabled(level, tag))
+        return;
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+void esp_log_buffer_hexdump_internal(const char *tag, const void *buffer, uint16_t buff_len, esp_log_level_t level)
+{
+    std::lock_guard<std::mutex> guard(log_lock);
+    if (!log_enabled(level, tag))
+        return;
+
+    const uint8_t *bytes = static_cast<const uint8_t *>(buffer);
+    for (uint16_t i = 0; i < buff_len; i += 16)
+    {
+        fprintf(stderr, "%s: 0x%04x  ", tag, i);
+        for (uint16_t j = i; j < i + 16 && j < buff_len; j++)
+            fprintf(stderr, "%02x ", bytes[j]);
+        fprintf(stderr, "\n");
+    }
+}
+
+/* ---------------------------------------------------------------- nvs / wifi */
+
+esp_err_t nvs_flash_init() { return ESP_OK; }
+esp_err_t nvs_flash_erase() { return ESP_OK; }
+
+esp_err_t esp_netif_init() { return ESP_OK; }
+esp_err_t esp_event_loop_create_default() { return ESP_OK; }
+esp_err_t esp_wifi_init(const wifi_init_config_t *) { return ESP_OK; }
+esp_err_t esp_wifi_deinit() { return ESP_OK; }
+esp_err_t esp_wifi_set_storage(wifi_storage_t) { return ESP_OK; }
+esp_err_t esp_wifi_set_mode(wifi_mode_t) { return ESP_OK; }
+esp_err_t esp_wifi_start()
+{
+    // Roughly what bringing the PHY up takes on the robot, so boot timings mean something
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    return ESP_OK;
+}
+esp_err_t esp_wifi_stop() { return ESP_OK; }
+esp_err_t esp_wifi_set_channel(uint8_t, wifi_second_chan_t) { return ESP_OK; }
+
+/* ---------------------------------------------------------------- esp_now */
+
+static std::mutex now_lock;
+static bool now_initialized = false;
+static esp_now_recv_cb_t now_recv_cb = nullptr;
+static esp_now_send_cb_t now_send_cb = nullptr;
+static std::set<std::string> now_peers;
+static host_esp_now_tx_hook_t now_tx_hook = nullptr;
+static bool now_holding = false; // send callbacks are kept in now_held
+static std::vector<std::pair<std::string, esp_now_send_status_t>> &now_held = *new std::vector<std::pair<std::string, esp_now_send_status_t>>();
+
+static std::string mac_key(const uint8_t *mac)
+{
+    return std::string(reinterpret_cast<const char *>(mac), ESP_NOW_ETH_ALEN);
+}
+
+esp_err_t esp_now_init()
+{
+    std::lock_guard<std::mutex> guard(now_lock);
+    now_initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_deinit()
+{
+    std::lock_guard<std::mutex> guard(now_lock);
+    now_initialized = false;
+    now_recv_cb = nullptr;
+    now_send_cb = nullptr;
+    now_peers.clear();
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb)
+{
+    std::lock_guard<std::mutex> guard(now_lock);
+    now_recv_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb)
+{
+    std::lock_guard<std::mutex> guard(now_lock);
+    now_send_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer)
+{
+    std::lock_guard<std::mutex> guard(now_lock);
+    if (!now_initialized)
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    if (!now_peers.insert(mac_key(peer->peer_addr)).second)
+        return ESP_ERR_ESPNOW_EXIST;
+    return ESP_OK;
+}
+
+bool esp_now_is_peer_exist(const uint8_t *peer_addr)
+{
+    std::lock_guard<std::mutex> guard(now_lock);
+    return now_peers.count(mac_key(peer_addr)) != 0;
+}
+
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len)
+{
+    host_esp_now_tx_hook_t hook;
+    esp_now_send_cb_t send_cb;
+    {
+        std::lock_guard<std::mutex> guard(now_lock);
+        if (!now_initialized)
+            return ESP_ERR_ESPNOW_NOT_INIT;
+        if (len == 0 || len > ESP_NOW_MAX_DATA_LEN)
+            return ESP_ERR_ESPNOW_ARG;
+        if (!now_peers.count(mac_key(peer_addr)))
+            return ESP_ERR_ESPNOW_NOT_FOUND;
+        hook = now_tx_hook;
+        send_cb = now_send_cb;
+    }
+
+    static const uint8_t broadcast[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    bool acknowledged = hook ? hook(peer_addr, data, len) : true;
+    if (memcmp(peer_addr, broadcast, ESP_NOW_ETH_ALEN) == 0)
+        acknowledged = true;
+    esp_now_send_status_t status = acknowledged ? ESP_NOW_SEND_SUCCESS : ESP_NOW_SEND_FAIL;
+    {
+        std::lock_guard<std::mutex> guard(now_lock);
+        if (now_holding)
+        {
+            now_held.emplace_back(mac_key(peer_addr), status);
+            return ESP_OK;
+        }
+    }
+    if (send_cb)
+        send_cb(peer_addr, status);
+    return ESP_OK;
+}
+
+void host_esp_now_hold_send_callbacks(bool hold)
+{
+    std::lock_guard<std::mutex> guard(now_lock);
+    now_holding = hold;
+    if (hold)
+        return;
+    // Under the lock, so a frame sent meanwhile cannot have its callback come before these
+    for (const auto &held : now_held)
+        if (now_send_cb)
+            now_send_cb(reinterpret_cast<const uint8_t *>(held.first.data()), held.second);
+    now_held.clear();
+}
+
+void host_esp_now_set_tx_hook(host_esp_now_tx_hook_t hook)
+{
+    std::lock_guard<std::mutex> guard(now_lock);
+    now_tx_hook = hook;
+}
+
+void host_esp_now_inject(const uint8_t *src_addr, const uint8_t *data, int len, int rssi)
+{
+    esp_now_recv_cb_t recv_cb;
+    {
+        std::lock_guard<std::mutex> guard(now_lock);
+        recv_cb = now_recv_cb;
+    }
+    if (recv_cb == nullptr)
+        return;
+
+    uint8_t src[ESP_NOW_ETH_ALEN];
+    uint8_t des[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    memcpy(src, src_addr, ESP_NOW_ETH_ALEN);
+    wifi_pkt_rx_ctrl_t rx_ctrl = {};
+    rx_ctrl.rssi = rssi;
+
+    esp_now_recv_info_t info = {src, des, &rx_ctrl};
+    recv_cb(&info, data, len);
+}
+
+/* ---------------------------------------------------------------- adc */
+
+static std::atomic<int> adc_reading{0};
+
+struct host_adc_unit_t
+{
+    adc_unit_t unit;
+};
+
+esp_err_t adc_oneshot_new_unit(const adc_oneshot_unit_init_cfg_t *init_config, adc_oneshot_unit_handle_t *ret_unit)
+{
+    *ret_unit = new host_adc_unit_t{init_config->unit_id};
+    return ESP_OK;
+}
+
+esp_err_t adc_oneshot_config_channel(adc_oneshot_unit_handle_t, adc_channel_t, const adc_oneshot_chan_cfg_t *)
+{
+    return ESP_OK;
+}
+
+esp_err_t adc_oneshot_read(adc_oneshot_unit_handle_t, adc_channel_t, int *out_raw)
+{
+    *out_raw = adc_reading.load();
+    return ESP_OK;
+}
+
+void host_adc_set_reading(int millivolts)
+{
+    adc_reading.store(millivolts);
+}
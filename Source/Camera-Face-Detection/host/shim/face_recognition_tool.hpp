@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+
+typedef struct
+{
+    int id;
+    std::string name;
+    float similarity;
+} face_info_t;
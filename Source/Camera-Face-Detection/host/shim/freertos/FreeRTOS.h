@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "sdkconfig.h"
+
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t StackType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFFUL)
+#define configTICK_RATE_HZ CONFIG_FREERTOS_HZ
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(xTimeInMs) ((TickType_t)(((TickType_t)(xTimeInMs) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000U))
+#define pdTICKS_TO_MS(xTicks) ((TickType_t)(((uint64_t)(xTicks) * (uint64_t)1000U) / (uint64_t)configTICK_RATE_HZ))
+
+#define tskNO_AFFINITY ((BaseType_t)0x7FFFFFFF)
+#define portNUM_PROCESSORS 2
+#define configMAX_TASK_NAME_LEN 16
+
+typedef void (*TaskFunction_t)(void *);
+
+// Spinlock for the dual-core critical sections, emulated with an atomic flag.
+#include <atomic>
+
+typedef struct
+{
+    std::atomic_flag locked;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {ATOMIC_FLAG_INIT}
+
+static inline void host_mux_enter(portMUX_TYPE *mux)
+{
+    while (mux->locked.test_and_set(std::memory_order_acquire))
+    {
+    }
+}
+
+static inline void host_mux_exit(portMUX_TYPE *mux)
+{
+    mux->locked.clear(std::memory_order_release);
+}
+
+#define portENTER_CRITICAL(mux) host_mux_enter(mux)
+#define portEXIT_CRITICAL(mux) host_mux_exit(mux)
+#define portENTER_CRITICAL_ISR(mux) host_mux_enter(mux)
+#define portEXIT_CRITICAL_ISR(mux) host_mux_exit(mux)
+#define taskENTER_CRITICAL(mux) host_mux_enter(mux)
+#define taskEXIT_CRITICAL(mux) host_mux_exit(mux)
+
+typedef struct host_task_t *TaskHandle_t;
+typedef struct host_queue_t *QueueHandle_t;
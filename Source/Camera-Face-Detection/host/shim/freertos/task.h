@@ -0,0 +1,68 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode,
+                                   const char *pcName,
+                                   uint32_t usStackDepth,
+                                   void *pvParameters,
+                                   UBaseType_t uxPriority,
+                                   TaskHandle_t *pvCreatedTask,
+                                   BaseType_t xCoreID);
+BaseType_t xTaskCreate(TaskFunction_t pvTaskCode,
+                       const char *pcName,
+                       uint32_t usStackDepth,
+                       void *pvParameters,
+                       UBaseType_t uxPriority,
+                       TaskHandle_t *pvCreatedTask);
+void vTaskDelete(TaskHandle_t xTaskToDelete);
+
+void vTaskDelay(TickType_t xTicksToDelay);
+void vTaskDelayUntil(TickType_t *pxPreviousWakeTime, TickType_t xTimeIncrement);
+TickType_t xTaskGetTickCount();
+
+/**
+ * Direct-to-task notifications, used as a counting semaphore only.
+ */
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify);
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait);
+
+TaskHandle_t xTaskGetCurrentTaskHandle();
+const char *pcTaskGetName(TaskHandle_t xTaskToQuery);
+BaseType_t xPortGetCoreID();
+
+typedef enum
+{
+    eRunning = 0,
+    eReady,
+    eBlocked,
+    eSuspended,
+    eDeleted,
+    eInvalid
+} eTaskState;
+
+typedef struct
+{
+    TaskHandle_t xHandle;
+    const char *pcTaskName;
+    UBaseType_t xTaskNumber;
+    eTaskState eCurrentState;
+    UBaseType_t uxCurrentPriority;
+    UBaseType_t uxBasePriority;
+    uint32_t ulRunTimeCounter;      // CPU time of the thread, us
+    StackType_t *pxStackBase;
+    uint32_t usStackHighWaterMark;  // bytes, as on ESP-IDF
+} TaskStatus_t;
+
+#define HOST_STACK_PAINT_SCALE 4 // x86-64 frames are larger, the stack is painted this many times deeper than asked for
+
+/**
+ * The host has no idle tasks, and the stack high-water mark is measured on the x86-64
+ * stack, which frames differently from Xtensa: it is the part left of HOST_STACK_PAINT_SCALE
+ * times the stack asked for, a host-only figure that only shows which tasks come close.
+ */
+UBaseType_t uxTaskGetNumberOfTasks();
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *pxTaskStatusArray, UBaseType_t uxArraySize, uint32_t *pulTotalRunTime);
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t cpuid);
+
+#define taskYIELD() vTaskDelay(0)
@@ -0,0 +1,514 @@
+// Minimal FreeRTOS emulation on top of std::thread. Only the calls used by the
+// application sources are provided; semantics follow the FreeRTOS reference
+// (copy-in/copy-out queues, tick based timeouts) closely enough for the
+// pipeline to behave as it does on the device.
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <pthread.h>
+#include <string>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+#include <pthread.h>
+
+struct host_queue_t
+{
+    std::mutex lock;
+    std::condition_variable readable;
+    std::condition_variable writable;
+    std::vector<uint8_t> storage; // ring of `length` items, allocated once like a FreeRTOS queue's
+    UBaseType_t head;             // oldest item
+    UBaseType_t count;
+    UBaseType_t length;
+    UBaseType_t item_size;
+
+    uint8_t *item(UBaseType_t index) { return this->storage.data() + (this->head + index) % this->length * this->item_size; }
+    std::string name;
+};
+
+struct host_task_t
+{
+    std::string name;
+    TaskFunction_t function;
+    void *parameters;
+    BaseType_t core;
+    UBaseType_t priority;
+    uint32_t stack_depth; // bytes asked for
+    UBaseType_t number;
+    clockid_t clock;      // CPU time of the thread
+    uint8_t *stack_top;   // stack pointer the task function is called with
+    uint8_t *stack_end;   // end of the painted part below it
+
+    std::mutex notify_lock;
+    std::condition_variable notified;
+    uint32_t notify_count;
+};
+
+#define HOST_STACK_PAINT 0xa5
+
+// Where the next call's frame goes; painting starts a red zone below it
+static inline __attribute__((always_inline)) uint8_t *stack_pointer()
+{
+    uint8_t *sp;
+#if defined(__x86_64__)
+    asm volatile("mov %%rsp, %0" : "=r"(sp));
+#elif defined(__aarch64__)
+    asm volatile("mov %0, sp" : "=r"(sp));
+#else
+    sp = static_cast<uint8_t *>(__builtin_frame_address(0)) - 1024;
+#endif
+    return sp;
+}
+
+static thread_local host_task_t *current_task = nullptr;
+static std::mutex tasks_lock;
+static std::vector<host_task_t *> &tasks = *new std::vector<host_task_t *>(); // Never destroyed, detached tasks outlive main()
+static UBaseType_t task_numbers = 0;
+
+static const std::chrono::steady_clock::time_point boot_time = std::chrono::steady_clock::now();
+
+static std::chrono::steady_clock::time_point deadline(TickType_t ticks)
+{
+    return std::chrono::steady_clock::now() + std::chrono::milliseconds(pdTICKS_TO_MS(ticks));
+}
+
+TickType_t xTaskGetTickCount()
+{
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - boot_time);
+    return pdMS_TO_TICKS(elapsed.count());
+}
+
+void vTaskDelay(TickType_t xTicksToDelay)
+{
+    if (xTicksToDelay == 0)
+        std::this_thread::yield();
+    else
+        std::this_thread::sleep_for(std::chrono::milliseconds(pdTICKS_TO_MS(xTicksToDelay)));
+}
+
+void vTaskDelayUntil(TickType_t *pxPreviousWakeTime, TickType_t xTimeIncrement)
+{
+    *pxPreviousWakeTime += xTimeIncrement;
+    TickType_t now = xTaskGetTickCount();
+    if (static_cast<int32_t>(*pxPreviousWakeTime - now) > 0)
+        vTaskDelay(*pxPreviousWakeTime - now);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode,
+                                   const char *pcName,
+                                   uint32_t usStackDepth,
+                                   void *pvParameters,
+                                   UBaseType_t uxPriority,
+                                   TaskHandle_t *pvCreatedTask,
+                                   BaseType_t xCoreID)
+{
+    host_task_t *task = new host_task_t{pcName ? pcName : "", pvTaskCode, pvParameters, xCoreID, uxPriority, usStackDepth, 0, {}, nullptr, nullptr, {}, {}, 0};
+    if (pvCreatedTask)
+        *pvCreatedTask = task;
+
+    std::thread([task]()
+                {
+                    current_task = task;
+                    pthread_getcpuclockid(pthread_self(), &task->clock);
+                    {
+                        std::lock_guard<std::mutex> guard(tasks_lock);
+                        task->number = ++task_numbers;
+                        tasks.push_back(task);
+                    }
+                    // Unwinds through here on vTaskDelete(), or the function returns
+                    struct unregister_t
+                    {
+                        host_task_t *task;
+                        ~unregister_t()
+                        {
+                            std::lock_guard<std::mutex> guard(tasks_lock);
+                            tasks.erase(std::find(tasks.begin(), tasks.end(), task));
+                        }
+                    } unregister = {task};
+
+                    // Paint the unused stack below this frame, like FreeRTOS paints a task's stack on creation
+                    pthread_attr_t attr;
+                    void *stack_low;
+                    size_t stack_size;
+                    pthread_getattr_np(pthread_self(), &attr);
+                    pthread_attr_getstack(&attr, &stack_low, &stack_size);
+                    pthread_attr_destroy(&attr);
+                    uint8_t *entry = stack_pointer();
+                    uint8_t *paint_from = entry - 128; // the x86-64 and AArch64 red zone
+                    size_t paint = static_cast<size_t>(task->stack_depth) * HOST_STACK_PAINT_SCALE;
+                    paint = std::min(paint, static_cast<size_t>(paint_from - static_cast<uint8_t *>(stack_low)) - 4096);
+                    volatile uint8_t *cursor = paint_from;
+                    for (size_t i = 0; i < paint; i++)
+                        *--cursor = HOST_STACK_PAINT;
+                    {
+                        std::lock_guard<std::mutex> guard(tasks_lock);
+                        task->stack_top = entry;
+                        task->stack_end = paint_from - paint;
+                    }
+                    task->function(task->parameters);
+                })
+        .detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pvTaskCode,
+                       const char *pcName,
+                       uint32_t usStackDepth,
+                       void *pvParameters,
+                       UBaseType_t uxPriority,
+                       TaskHandle_t *pvCreatedTask)
+{
+    return xTaskCreatePinnedToCore(pvTaskCode, pcName, usStackDepth, pvParameters, uxPriority, pvCreatedTask, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete)
+{
+    if (xTaskToDelete == nullptr || xTaskToDelete == current_task)
+        pthread_exit(nullptr);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify)
+{
+    {
+        std::lock_guard<std::mutex> guard(xTaskToNotify->notify_lock);
+        xTaskToNotify->notify_count++;
+    }
+    xTaskToNotify->notified.notify_one();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+    host_task_t *task = current_task;
+    if (task == nullptr)
+        return 0; // only tasks have a notification value
+    std::unique_lock<std::mutex> guard(task->notify_lock);
+    auto given = [task] { return task->notify_count != 0; };
+    if (xTicksToWait == portMAX_DELAY)
+        task->notified.wait(guard, given);
+    else
+        task->notified.wait_until(guard, deadline(xTicksToWait), given);
+    uint32_t count = task->notify_count;
+    if (count != 0)
+        task->notify_count = xClearCountOnExit ? 0 : count - 1;
+    return count;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    return current_task;
+}
+
+const char *pcTaskGetName(TaskHandle_t xTaskToQuery)
+{
+    host_task_t *task = xTaskToQuery ? xTaskToQuery : current_task;
+    return task ? task->name.c_str() : "main";
+}
+
+UBaseType_t uxTaskGetNumberOfTasks()
+{
+    std::lock_guard<std::mutex> guard(tasks_lock);
+    return tasks.size();
+}
+
+// Bytes of the painted stack the task never reached, counted up from the far end. The budget is the
+// painted depth, HOST_STACK_PAINT_SCALE times the device's, as the device figure means nothing for x86-64 frames.
+static uint32_t stack_high_water(const host_task_t *task)
+{
+    size_t budget = static_cast<size_t>(task->stack_depth) * HOST_STACK_PAINT_SCALE;
+    if (task->stack_top == nullptr)
+        return budget; // not painted yet
+    const uint8_t *lowest = task->stack_end;
+    while (lowest < task->stack_top && *lowest == HOST_STACK_PAINT)
+        lowest++;
+    size_t used = task->stack_top - lowest;
+    return used < budget ? budget - used : 0;
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *pxTaskStatusArray, UBaseType_t uxArraySize, uint32_t *pulTotalRunTime)
+{
+    std::lock_guard<std::mutex> guard(tasks_lock);
+    if (uxArraySize < tasks.size())
+        return 0;
+    UBaseType_t count = 0;
+    for (host_task_t *task : tasks)
+    {
+        timespec cpu = {};
+        clock_gettime(task->clock, &cpu);
+        TaskStatus_t &status = pxTaskStatusArray[count++];
+        status.xHandle = task;
+        status.pcTaskName = task->name.c_str();
+        status.xTaskNumber = task->number;
+        status.eCurrentState = task == current_task ? eRunning : eBlocked;
+        status.uxCurrentPriority = task->priority;
+        status.uxBasePriority = task->priority;
+        status.ulRunTimeCounter = static_cast<uint32_t>(cpu.tv_sec * 1000000LL + cpu.tv_nsec / 1000);
+        status.pxStackBase = nullptr;
+        status.usStackHighWaterMark = stack_high_water(task);
+    }
+    if (pulTotalRunTime)
+        *pulTotalRunTime = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - boot_time).count());
+    return count;
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t)
+{
+    return nullptr;
+}
+
+BaseType_t xPortGetCoreID()
+{
+    return (current_task && current_task->core != tskNO_AFFINITY) ? current_task->core : 0;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize)
+{
+    host_queue_t *queue = new host_queue_t();
+    queue->storage.resize(uxQueueLength * uxItemSize);
+    queue->head = 0;
+    queue->count = 0;
+    queue->length = uxQueueLength;
+    queue->item_size = uxItemSize;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t xQueue)
+{
+    delete xQueue;
+}
+
+static BaseType_t queue_send(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait, bool front)
+{
+    std::unique_lock<std::mutex> guard(xQueue->lock);
+    auto has_space = [xQueue]()
+    { return xQueue->count < xQueue->length; };
+
+    if (xTicksToWait == portMAX_DELAY)
+        xQueue->writable.wait(guard, has_space);
+    else if (!xQueue->writable.wait_until(guard, deadline(xTicksToWait), has_space))
+        return pdFALSE;
+
+    if (front)
+    {
+        xQueue->head = (xQueue->head + xQueue->length - 1) % xQueue->length;
+        xQueue->count++;
+        memcpy(xQueue->item(0), pvItemToQueue, xQueue->item_size);
+    }
+    else
+    {
+        memcpy(xQueue->item(xQueue->count++), pvItemToQueue, xQueue->item_size);
+    }
+    xQueue->readable.notify_one();
+    return pdTRUE;
+}
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait)
+{
+    return queue_send(xQueue, pvItemToQueue, xTicksToWait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait)
+{
+    return queue_send(xQueue, pvItemToQueue, xTicksToWait, true);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t xQueue, const void *pvItemToQueue)
+{
+    std::lock_guard<std::mutex> guard(xQueue->lock);
+    xQueue->head = 0;
+    xQueue->count = 1;
+    memcpy(xQueue->item(0), pvItemToQueue, xQueue->item_size);
+    xQueue->readable.notify_one();
+    return pdPASS;
+}
+
+static BaseType_t queue_receive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait, bool remove)
+{
+    std::unique_lock<std::mutex> guard(xQueue->lock);
+    auto has_item = [xQueue]()
+    { return xQueue->count != 0; };
+
+    if (xTicksToWait == portMAX_DELAY)
+        xQueue->readable.wait(guard, has_item);
+    else if (!xQueue->readable.wait_until(guard, deadline(xTicksToWait), has_item))
+        return pdFALSE;
+
+    if (xQueue->item_size)
+        memcpy(pvBuffer, xQueue->item(0), xQueue->item_size);
+    if (remove)
+    {
+        xQueue->head = (xQueue->head + 1) % xQueue->length;
+        xQueue->count--;
+        xQueue->writable.notify_one();
+    }
+    else
+    {
+        xQueue->readable.notify_one();
+    }
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait)
+{
+    return queue_receive(xQueue, pvBuffer, xTicksToWait, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait)
+{
+    return queue_receive(xQueue, pvBuffer, xTicksToWait, false);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t xQueue, const void *pvItemToQueue, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    if (pxHigherPriorityTaskWoken)
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    return queue_send(xQueue, pvItemToQueue, 0, false);
+}
+
+BaseType_t xQueueReceiveFromISR(QueueHandle_t xQueue, void *pvBuffer, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    if (pxHigherPriorityTaskWoken)
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    return queue_receive(xQueue, pvBuffer, 0, true);
+}
+
+BaseType_t xQueueReset(QueueHandle_t xQueue)
+{
+    std::lock_guard<std::mutex> guard(xQueue->lock);
+    xQueue->head = 0;
+    xQueue->count = 0;
+    xQueue->writable.notify_all();
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue)
+{
+    std::lock_guard<std::mutex> guard(xQueue->lock);
+    return xQueue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t xQueue)
+{
+    std::lock_guard<std::mutex> guard(xQueue->lock);
+    return xQueue->length - xQueue->count;
+}
+
+void vQueueAddToRegistry(QueueHandle_t xQueue, const char *pcQueueName)
+{
+    std::lock_guard<std::mutex> guard(xQueue->lock);
+    xQueue->name = pcQueueName ? pcQueueName : "";
+}
+
+const char *pcQueueGetName(QueueHandle_t xQueue)
+{
+    return xQueue->name.empty() ? nullptr : xQueue->name.c_str();
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount)
+{
+    SemaphoreHandle_t semaphore = xQueueCreate(uxMaxCount, 0);
+    for (UBaseType_t i = 0; i < uxInitialCount; i++)
+        xQueueSend(semaphore, nullptr, 0);
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary()
+{
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime)
+{
+    return xQueueReceive(xSemaphore, nullptr, xBlockTime);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore)
+{
+    return xQueueSend(xSemaphore, nullptr, 0);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t xSemaphore)
+{
+    vQueueDelete(xSemaphore);
+}
+
+struct host_event_group_t
+{
+    std::mutex lock;
+    std::condition_variable changed;
+    EventBits_t bits;
+};
+
+EventGroupHandle_t xEventGroupCreate()
+{
+    host_event_group_t *group = new host_event_group_t();
+    group->bits = 0;
+    return group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToSet)
+{
+    std::lock_guard<std::mutex> guard(xEventGroup->lock);
+    xEventGroup->bits |= uxBitsToSet;
+    xEventGroup->changed.notify_all();
+    return xEventGroup->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t xEventGroup, const EventBits_t uxBitsToClear)
+{
+    std::lock_guard<std::mutex> guard(xEventGroup->lock);
+    EventBits_t bits = xEventGroup->bits;
+    xEventGroup->bits &= ~uxBitsToClear;
+    return bits;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t xEventGroup)
+{
+    std::lock_guard<std::mutex> guard(xEventGroup->lock);
+    return xEventGroup->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t xEventGroup,
+                                const EventBits_t uxBitsToWaitFor,
+                                const BaseType_t xClearOnExit,
+                                const BaseType_t xWaitForAllBits,
+                                TickType_t xTicksToWait)
+{
+    std::unique_lock<std::mutex> guard(xEventGroup->lock);
+    auto satisfied = [&]
+    {
+        EventBits_t set = xEventGroup->bits & uxBitsToWaitFor;
+        return xWaitForAllBits ? set == uxBitsToWaitFor : set != 0;
+    };
+    if (xTicksToWait == portMAX_DELAY)
+        xEventGroup->changed.wait(guard, satisfied);
+    else
+        xEventGroup->changed.wait_until(guard, deadline(xTicksToWait), satisfied);
+
+    // Returns the bits as they were before any clearing, like FreeRTOS
+    EventBits_t bits = xEventGroup->bits;
+    if (xClearOnExit && satisfied())
+        xEventGroup->bits &= ~uxBitsToWaitFor;
+    return bits;
+}
+
+void vEventGroupDelete(EventGroupHandle_t xEventGroup)
+{
+    delete xEventGroup;
+}
@@ -0,0 +1,100 @@
+// Host versions of the ESP-WHO drawing helpers and the ESP-DL nearest
+// neighbour resize, operating on RGB565 buffers like the originals.
+
+#include "dl_image.hpp"
+#include "fb_gfx.h"
+#include "who_ai_utils.hpp"
+
+#include <cstdarg>
+#include <cstdio>
+
+#define HOST_BOX_COLOR 0x07E0
+#define HOST_KEYPOINT_COLOR 0xF800
+
+static void put_pixel(uint16_t *image, int height, int width, int x, int y, uint16_t color)
+{
+    if (x >= 0 && y >= 0 && x < width && y < height)
+        image[y * width + x] = color;
+}
+
+void draw_detection_result(uint16_t *image_ptr, int image_height, int image_width, std::list<dl::detect::result_t> &results)
+{
+    for (auto &result : results)
+    {
+        for (int x = result.box[0]; x <= result.box[2]; x++)
+        {
+            put_pixel(image_ptr, image_height, image_width, x, result.box[1], HOST_BOX_COLOR);
+            put_pixel(image_ptr, image_height, image_width, x, result.box[3], HOST_BOX_COLOR);
+        }
+        for (int y = result.box[1]; y <= result.box[3]; y++)
+        {
+            put_pixel(image_ptr, image_height, image_width, result.box[0], y, HOST_BOX_COLOR);
+            put_pixel(image_ptr, image_height, image_width, result.box[2], y, HOST_BOX_COLOR);
+        }
+        for (size_t i = 0; i + 1 < result.keypoint.size(); i += 2)
+            put_pixel(image_ptr, image_height, image_width, result.keypoint[i], result.keypoint[i + 1], HOST_KEYPOINT_COLOR);
+    }
+}
+
+void fb_gfx_fillRect(camera_fb_t *fb, int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color)
+{
+    uint16_t *pixels = reinterpret_cast<uint16_t *>(fb->buf);
+    for (int32_t row = y; row < y + h; row++)
+        for (int32_t col = x; col < x + w; col++)
+            put_pixel(pixels, fb->height, fb->width, col, row, color);
+}
+
+void fb_gfx_drawFastHLine(camera_fb_t *fb, int32_t x, int32_t y, int32_t w, uint32_t color)
+{
+    fb_gfx_fillRect(fb, x, y, w, 1, color);
+}
+
+void fb_gfx_drawFastVLine(camera_fb_t *fb, int32_t x, int32_t y, int32_t h, uint32_t color)
+{
+    fb_gfx_fillRect(fb, x, y, 1, h, color);
+}
+
+// Glyphs are drawn as solid cells of the real font's 14x20 advance; the
+// harness only needs the pixel traffic, not legible text.
+uint8_t fb_gfx_putc(camera_fb_t *fb, int32_t x, int32_t y, uint32_t color, unsigned char c)
+{
+    if (c > ' ')
+        fb_gfx_fillRect(fb, x + 2, y + 4, 10, 12, color);
+    return 14;
+}
+
+uint32_t fb_gfx_print(camera_fb_t *fb, int32_t x, int32_t y, uint32_t color, const char *str)
+{
+    uint32_t advance = 0;
+    for (; *str; str++)
+        advance += fb_gfx_putc(fb, x + advance, y, color, *str);
+    return advance;
+}
+
+uint32_t fb_gfx_printf(camera_fb_t *fb, int32_t x, int32_t y, uint32_t color, const char *format, ...)
+{
+    char buffer[64];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    return fb_gfx_print(fb, x, y, color, buffer);
+}
+
+namespace dl
+{
+    namespace image
+    {
+        void resize_image_nearest(uint16_t *input, std::vector<int> input_shape, uint16_t *output, std::vector<int> output_shape)
+        {
+            const int in_h = input_shape[0], in_w = input_shape[1];
+            const int out_h = output_shape[0], out_w = output_shape[1];
+            for (int y = 0; y < out_h; y++)
+            {
+                const uint16_t *row = input + (y * in_h / out_h) * in_w;
+                for (int x = 0; x < out_w; x++)
+                    output[y * out_w + x] = row[x * in_w / out_w];
+            }
+        }
+    }
+}
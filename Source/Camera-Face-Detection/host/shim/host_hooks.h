@@ -0,0 +1,62 @@
+#pragma once
+
+// Entry points the host harness uses to drive the emulated peripherals. None of
+// these exist on the device; application sources must not include this header.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "esp_now.h"
+
+// Called for every esp_now_send() with the destination and payload, returns whether the peer
+// acknowledged the frame, which the send callback reports. Broadcasts are always reported sent.
+typedef bool (*host_esp_now_tx_hook_t)(const uint8_t *peer_addr, const uint8_t *data, size_t len);
+
+void host_esp_now_set_tx_hook(host_esp_now_tx_hook_t hook);
+
+// While held, the send callbacks of the frames sent are kept back, as when the Wi-Fi task is
+// busy; releasing delivers them in send order.
+void host_esp_now_hold_send_callbacks(bool hold);
+
+// Deliver a frame to the registered ESP-NOW receive callback as if it came over the air.
+void host_esp_now_inject(const uint8_t *src_addr, const uint8_t *data, int len, int rssi);
+
+// Run a console command line as if typed at the REPL, returns the command's result.
+int host_console_run(const char *command_line);
+
+// Mock LCD panel: transfers completed, frames (transfer runs down the panel) completed,
+// time the emulated SPI bus was busy, transfers whose pixels changed while queued and
+// frames showing the marker color.
+typedef struct
+{
+    uint32_t transfers;
+    uint32_t frames;
+    uint64_t bytes;
+    int64_t busy_us;
+    uint32_t torn;
+    uint32_t marked;
+    uint32_t failed; // draws refused by host_lcd_set_draw_failures()
+} host_lcd_stats_t;
+
+typedef void (*host_lcd_frame_hook_t)(int64_t done_us);
+
+void host_lcd_get_stats(host_lcd_stats_t *stats);
+void host_lcd_set_frame_hook(host_lcd_frame_hook_t hook);
+
+// Refuse every Nth esp_lcd_panel_draw_bitmap(), as the SPI panel IO does when it runs out of memory; 0 refuses none.
+void host_lcd_set_draw_failures(uint32_t every);
+
+// RGB565 value, as sent on the wire, that counts a frame as marked.
+void host_lcd_set_marker_color(uint16_t color);
+
+// Value returned by adc_oneshot_read(), in mV.
+void host_adc_set_reading(int millivolts);
+
+// Back a flash partition with a file: created with `size` bytes of room, or an existing
+// recording opened read-only when size is 0. Writes only clear bits, like NOR flash.
+bool host_partition_attach(const char *label, const char *path, uint32_t size);
+
+// Called for every gpio_set_level() with the pin, the level written and the esp_timer time.
+typedef void (*host_gpio_hook_t)(int pin, int level, int64_t time_us);
+
+void host_gpio_set_hook(host_gpio_hook_t hook);
@@ -0,0 +1,21 @@
+#pragma once
+
+// Host stand-in for the ESP-DL MNP01 refinement stage, see human_face_detect_msr01.hpp.
+
+#include <cstdint>
+#include <list>
+#include <vector>
+
+#include "dl_detect_define.hpp"
+
+class HumanFaceDetectMNP01
+{
+private:
+    std::list<dl::detect::result_t> results;
+    float score_threshold;
+
+public:
+    HumanFaceDetectMNP01(const float score_threshold, const float nms_threshold, const int top_k);
+
+    std::list<dl::detect::result_t> &infer(uint16_t *input_element, std::vector<int> input_shape, std::list<dl::detect::result_t> &candidates);
+};
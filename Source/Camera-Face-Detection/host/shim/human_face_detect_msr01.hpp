@@ -0,0 +1,24 @@
+#pragma once
+
+// Host stand-in for the ESP-DL MSR01 candidate generator. It keeps the
+// constructor and infer() signatures of the real model so the application
+// sources compile unchanged; the implementation lives in ../src/host_detector.cpp.
+
+#include <cstdint>
+#include <list>
+#include <vector>
+
+#include "dl_detect_define.hpp"
+
+class HumanFaceDetectMSR01
+{
+private:
+    std::list<dl::detect::result_t> results;
+    float score_threshold;
+    float resize_scale;
+
+public:
+    HumanFaceDetectMSR01(const float score_threshold, const float nms_threshold, const int top_k, float resize_scale);
+
+    std::list<dl::detect::result_t> &infer(uint16_t *input_element, std::vector<int> input_shape);
+};
@@ -0,0 +1,205 @@
+// Mock SPI panel for the esp_lcd calls AppLCD makes. Color transfers are queued
+// like the SPI panel IO does, drained by a worker thread that takes as long as the
+// pixels would take on the wire at pclk_hz, and completed through on_color_trans_done.
+// A draw waits for the previous color transfer first, as the real window commands do.
+// Each transfer's pixels are checksummed when queued and again when sent, so a
+// buffer reused before its transfer is done shows up as torn. Frames containing the
+// marker color are counted, which lets the harness see the overlay reach the panel.
+
+#include "driver/spi_master.h"
+#include "esp_lcd_panel_io.h"
+#include "esp_lcd_panel_ops.h"
+#include "esp_lcd_panel_vendor.h"
+#include "esp_timer.h"
+
+#include "host_hooks.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+typedef struct
+{
+    const uint8_t *pixels;
+    size_t bytes;
+    int y_start;
+    uint64_t checksum;
+} transfer_t;
+
+struct esp_lcd_panel_io_t
+{
+    esp_lcd_panel_io_spi_config_t config;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<transfer_t> queue;
+    int last_y_start;
+    int64_t last_done_us;
+    bool last_marked;
+};
+
+struct esp_lcd_panel_t
+{
+    esp_lcd_panel_io_t *io;
+    unsigned int bits_per_pixel;
+};
+
+static std::mutex stats_lock;
+static host_lcd_stats_t stats;
+static host_lcd_frame_hook_t frame_hook = nullptr;
+static std::atomic<int> marker_color(-1);
+static std::atomic<uint32_t> draw_failure_period(0);
+static std::atomic<uint32_t> draws(0);
+
+void host_lcd_set_frame_hook(host_lcd_frame_hook_t hook)
+{
+    frame_hook = hook;
+}
+
+void host_lcd_set_draw_failures(uint32_t every)
+{
+    draw_failure_period = every;
+}
+
+void host_lcd_set_marker_color(uint16_t color)
+{
+    marker_color = color;
+}
+
+void host_lcd_get_stats(host_lcd_stats_t *out)
+{
+    std::lock_guard<std::mutex> guard(stats_lock);
+    *out = stats;
+}
+
+static uint64_t checksum(const uint8_t *data, size_t len)
+{
+    uint64_t hash = 1469598103934665603ull;
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    return hash;
+}
+
+static void worker(esp_lcd_panel_io_t *io)
+{
+    while (true)
+    {
+        transfer_t transfer;
+        {
+            std::unique_lock<std::mutex> guard(io->lock);
+            io->changed.wait(guard, [io]()
+                             { return !io->queue.empty(); });
+            transfer = io->queue.front();
+        }
+
+        int64_t start = esp_timer_get_time();
+        int64_t wire_us = static_cast<int64_t>(transfer.bytes) * 8 * 1000000 / io->config.pclk_hz;
+        std::this_thread::sleep_for(std::chrono::microseconds(wire_us));
+        bool torn = checksum(transfer.pixels, transfer.bytes) != transfer.checksum;
+        bool marked = false;
+        const uint16_t *pixels = reinterpret_cast<const uint16_t *>(transfer.pixels);
+        for (size_t i = 0; marker_color >= 0 && !marked && i < transfer.bytes / sizeof(uint16_t); i++)
+            marked = pixels[i] == marker_color;
+        int64_t done = esp_timer_get_time();
+
+        // A transfer that does not continue further down the panel starts a new frame
+        int64_t frame_done_us = 0;
+        bool frame_marked = false;
+        if (transfer.y_start <= io->last_y_start && io->last_done_us)
+        {
+            frame_done_us = io->last_done_us;
+            frame_marked = io->last_marked;
+            io->last_marked = false;
+        }
+        io->last_y_start = transfer.y_start;
+        io->last_done_us = done;
+        io->last_marked |= marked;
+
+        {
+            std::lock_guard<std::mutex> guard(stats_lock);
+            stats.transfers++;
+            stats.bytes += transfer.bytes;
+            stats.busy_us += done - start;
+            stats.torn += torn;
+            stats.frames += frame_done_us != 0;
+            stats.marked += frame_marked;
+        }
+        if (frame_done_us && frame_hook)
+            frame_hook(frame_done_us);
+
+        // The real driver calls back from the ISR once the transaction is off its queue
+        {
+            std::lock_guard<std::mutex> guard(io->lock);
+            io->queue.pop_front();
+        }
+        io->changed.notify_all();
+        if (io->config.on_color_trans_done)
+            io->config.on_color_trans_done(io, nullptr, io->config.user_ctx);
+    }
+}
+
+esp_err_t spi_bus_initialize(spi_host_device_t, const spi_bus_config_t *, spi_common_dma_t)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_lcd_new_panel_io_spi(esp_lcd_spi_bus_handle_t, const esp_lcd_panel_io_spi_config_t *io_config, esp_lcd_panel_io_handle_t *ret_io)
+{
+    esp_lcd_panel_io_t *io = new esp_lcd_panel_io_t();
+    io->config = *io_config;
+    io->last_y_start = 0;
+    io->last_done_us = 0;
+    io->last_marked = false;
+    std::thread(worker, io).detach();
+    *ret_io = io;
+    return ESP_OK;
+}
+
+esp_err_t esp_lcd_new_panel_st7789(const esp_lcd_panel_io_handle_t io, const esp_lcd_panel_dev_config_t *panel_dev_config, esp_lcd_panel_handle_t *ret_panel)
+{
+    *ret_panel = new esp_lcd_panel_t{io, panel_dev_config->bits_per_pixel};
+    return ESP_OK;
+}
+
+// The delays the ST7789 driver waits out after the reset and the sleep-out commands, roughly
+esp_err_t esp_lcd_panel_reset(esp_lcd_panel_handle_t)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    return ESP_OK;
+}
+
+esp_err_t esp_lcd_panel_init(esp_lcd_panel_handle_t)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    return ESP_OK;
+}
+esp_err_t esp_lcd_panel_invert_color(esp_lcd_panel_handle_t, bool) { return ESP_OK; }
+esp_err_t esp_lcd_panel_disp_on_off(esp_lcd_panel_handle_t, bool) { return ESP_OK; }
+
+esp_err_t esp_lcd_panel_draw_bitmap(esp_lcd_panel_handle_t panel, int x_start, int y_start, int x_end, int y_end, const void *color_data)
+{
+    if (panel == nullptr || color_data == nullptr || x_end <= x_start || y_end <= y_start)
+        return ESP_ERR_INVALID_ARG;
+    uint32_t every = draw_failure_period.load();
+    if (every && ++draws % every == 0)
+    {
+        std::lock_guard<std::mutex> guard(stats_lock);
+        stats.failed++;
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_lcd_panel_io_t *io = panel->io;
+    size_t bytes = static_cast<size_t>(x_end - x_start) * (y_end - y_start) * panel->bits_per_pixel / 8;
+    const uint8_t *pixels = static_cast<const uint8_t *>(color_data);
+
+    // The SPI panel IO sends CASET and RASET before the pixels, and a parameter
+    // transfer first waits for every queued color transfer to be done
+    std::unique_lock<std::mutex> guard(io->lock);
+    io->changed.wait(guard, [io]()
+                     { return io->queue.empty(); });
+    io->queue.push_back(transfer_t{pixels, bytes, y_start, checksum(pixels, bytes)});
+    io->changed.notify_all();
+    return ESP_OK;
+}
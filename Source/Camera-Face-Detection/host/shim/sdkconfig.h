@@ -0,0 +1,13 @@
+#pragma once
+
+// Subset of the project sdkconfig that the application sources depend on.
+// Keep these values in sync with ../../sdkconfig when they change there.
+
+#define CONFIG_IDF_TARGET_ESP32S3 1
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_CAMERA_MODULE_ESP_S3_EYE 1
+#define CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ 240
+#define CONFIG_SPIRAM 1
+#define CONFIG_HEAP_USE_HOOKS 1
+#define CONFIG_FREERTOS_USE_TRACE_FACILITY 1
+#define CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS 1
@@ -0,0 +1,234 @@
+// Flash partitions backed by files, and the esp32-camera JPEG converters on top
+// of libjpeg when the host has it. Writes only clear bits like NOR flash does,
+// so data written over a range that was not erased first comes out corrupted
+// as it would on the device.
+
+#include "esp_partition.h"
+#include "img_converters.h"
+
+#include "host_hooks.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if HOST_HAVE_JPEG
+#include <jpeglib.h>
+#endif
+
+#define HOST_FLASH_SECTOR 4096
+
+/* ---------------------------------------------------------------- esp_partition */
+
+typedef struct
+{
+    esp_partition_t partition;
+    FILE *file;
+} host_partition_t;
+
+static std::mutex partitions_lock;
+static std::map<std::string, host_partition_t *> partitions;
+
+bool host_partition_attach(const char *label, const char *path, uint32_t size)
+{
+    bool readonly = size == 0;
+    FILE *file = fopen(path, readonly ? "rb" : "w+b");
+    if (file == nullptr)
+        return false;
+    if (readonly)
+    {
+        fseek(file, 0, SEEK_END);
+        size = static_cast<uint32_t>(ftell(file));
+    }
+
+    host_partition_t *entry = new host_partition_t{};
+    entry->partition.type = ESP_PARTITION_TYPE_DATA;
+    entry->partition.subtype = ESP_PARTITION_SUBTYPE_ANY;
+    entry->partition.size = size;
+    entry->partition.erase_size = HOST_FLASH_SECTOR;
+    entry->partition.readonly = readonly;
+    snprintf(entry->partition.label, sizeof(entry->partition.label), "%s", label);
+    entry->file = file;
+
+    std::lock_guard<std::mutex> guard(partitions_lock);
+    partitions[label] = entry;
+    return true;
+}
+
+static host_partition_t *find(const esp_partition_t *partition)
+{
+    std::lock_guard<std::mutex> guard(partitions_lock);
+    for (auto &entry : partitions)
+        if (&entry.second->partition == partition)
+            return entry.second;
+    return nullptr;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    std::lock_guard<std::mutex> guard(partitions_lock);
+    for (auto &entry : partitions)
+    {
+        const esp_partition_t &partition = entry.second->partition;
+        if ((type == ESP_PARTITION_TYPE_ANY || type == partition.type) &&
+            (subtype == ESP_PARTITION_SUBTYPE_ANY || subtype == partition.subtype) &&
+            (label == nullptr || entry.first == label))
+            return &partition;
+    }
+    return nullptr;
+}
+
+// Bytes past the end of the file read as erased flash
+static void read_file(FILE *file, size_t offset, uint8_t *data, size_t size)
+{
+    memset(data, 0xFF, size);
+    if (fseek(file, static_cast<long>(offset), SEEK_SET) == 0)
+        (void)!fread(data, 1, size, file);
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    host_partition_t *entry = find(partition);
+    if (entry == nullptr || src_offset + size > partition->size)
+        return ESP_ERR_INVALID_ARG;
+    std::lock_guard<std::mutex> guard(partitions_lock);
+    read_file(entry->file, src_offset, static_cast<uint8_t *>(dst), size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    host_partition_t *entry = find(partition);
+    if (entry == nullptr || dst_offset + size > partition->size)
+        return ESP_ERR_INVALID_ARG;
+    if (partition->readonly)
+        return ESP_ERR_NOT_ALLOWED;
+
+    std::lock_guard<std::mutex> guard(partitions_lock);
+    std::vector<uint8_t> flash(size);
+    read_file(entry->file, dst_offset, flash.data(), size);
+    const uint8_t *bytes = static_cast<const uint8_t *>(src);
+    for (size_t i = 0; i < size; i++)
+        flash[i] &= bytes[i];
+    fseek(entry->file, static_cast<long>(dst_offset), SEEK_SET);
+    fwrite(flash.data(), 1, size, entry->file);
+    fflush(entry->file);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    host_partition_t *entry = find(partition);
+    if (entry == nullptr || offset + size > partition->size || offset % partition->erase_size || size % partition->erase_size)
+        return ESP_ERR_INVALID_ARG;
+    if (partition->readonly)
+        return ESP_ERR_NOT_ALLOWED;
+
+    std::lock_guard<std::mutex> guard(partitions_lock);
+    std::vector<uint8_t> erased(size, 0xFF);
+    fseek(entry->file, static_cast<long>(offset), SEEK_SET);
+    fwrite(erased.data(), 1, size, entry->file);
+    return ESP_OK;
+}
+
+/* ---------------------------------------------------------------- img_converters */
+
+#if HOST_HAVE_JPEG
+
+bool frame2jpg(camera_fb_t *fb, uint8_t quality, uint8_t **out, size_t *out_len)
+{
+    if (fb->format != PIXFORMAT_RGB565)
+        return false;
+
+    jpeg_compress_struct compress;
+    jpeg_error_mgr error;
+    compress.err = jpeg_std_error(&error);
+    jpeg_create_compress(&compress);
+    unsigned char *buffer = nullptr;
+    unsigned long buffer_len = 0;
+    jpeg_mem_dest(&compress, &buffer, &buffer_len);
+    compress.image_width = fb->width;
+    compress.image_height = fb->height;
+    compress.input_components = 3;
+    compress.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&compress);
+    jpeg_set_quality(&compress, quality, TRUE);
+    jpeg_start_compress(&compress, TRUE);
+
+    // Camera pixels are big endian RGB565
+    std::vector<uint8_t> row(fb->width * 3);
+    while (compress.next_scanline < compress.image_height)
+    {
+        const uint8_t *in = fb->buf + compress.next_scanline * fb->width * 2;
+        for (size_t x = 0; x < fb->width; x++)
+        {
+            uint16_t pixel = static_cast<uint16_t>((in[2 * x] << 8) | in[2 * x + 1]);
+            row[3 * x] = static_cast<uint8_t>((pixel >> 11) << 3);
+            row[3 * x + 1] = static_cast<uint8_t>(((pixel >> 5) & 0x3F) << 2);
+            row[3 * x + 2] = static_cast<uint8_t>((pixel & 0x1F) << 3);
+        }
+        JSAMPROW rows[1] = {row.data()};
+        jpeg_write_scanlines(&compress, rows, 1);
+    }
+    jpeg_finish_compress(&compress);
+    jpeg_destroy_compress(&compress);
+
+    // libjpeg allocates with malloc(), which is what the caller frees it with
+    *out = buffer;
+    *out_len = buffer_len;
+    return true;
+}
+
+bool jpg2rgb565(const uint8_t *src, size_t src_len, uint8_t *out, jpg_scale_t scale)
+{
+    if (scale != JPG_SCALE_NONE)
+        return false;
+
+    jpeg_decompress_struct decompress;
+    jpeg_error_mgr error;
+    decompress.err = jpeg_std_error(&error);
+    jpeg_create_decompress(&decompress);
+    jpeg_mem_src(&decompress, src, src_len);
+    if (jpeg_read_header(&decompress, TRUE) != JPEG_HEADER_OK)
+    {
+        jpeg_destroy_decompress(&decompress);
+        return false;
+    }
+    decompress.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&decompress);
+
+    std::vector<uint8_t> row(decompress.output_width * 3);
+    while (decompress.output_scanline < decompress.output_height)
+    {
+        uint8_t *pixels = out + decompress.output_scanline * decompress.output_width * 2;
+        JSAMPROW rows[1] = {row.data()};
+        jpeg_read_scanlines(&decompress, rows, 1);
+        for (size_t x = 0; x < decompress.output_width; x++)
+        {
+            uint16_t pixel = static_cast<uint16_t>(((row[3 * x] >> 3) << 11) | ((row[3 * x + 1] >> 2) << 5) | (row[3 * x + 2] >> 3));
+            pixels[2 * x] = static_cast<uint8_t>(pixel >> 8);
+            pixels[2 * x + 1] = static_cast<uint8_t>(pixel);
+        }
+    }
+    jpeg_finish_decompress(&decompress);
+    jpeg_destroy_decompress(&decompress);
+    return true;
+}
+
+#else
+
+bool frame2jpg(camera_fb_t *, uint8_t, uint8_t **, size_t *)
+{
+    return false;
+}
+
+bool jpg2rgb565(const uint8_t *, size_t, uint8_t *, jpg_scale_t)
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <list>
+
+#include "dl_detect_define.hpp"
+
+void draw_detection_result(uint16_t *image_ptr, int image_height, int image_width, std::list<dl::detect::result_t> &results);
@@ -0,0 +1,355 @@
+// esp32-camera replacement. Frames come from a raw RGB565 file, from a
+// recording made by AppRecorder, or from a generator that draws a face-coloured
+// ellipse moving over a textured background, captured on the sensor's frame
+// grid like CAMERA_GRAB_WHEN_EMPTY.
+
+#include "host_harness.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "img_converters.h"
+
+#include "app_recorder.hpp"
+
+static const char TAG[] = "Host/Camera";
+
+const resolution_info_t resolution[FRAMESIZE_INVALID] = {
+    {96, 96},    // FRAMESIZE_96X96
+    {160, 120},  // FRAMESIZE_QQVGA
+    {176, 144},  // FRAMESIZE_QCIF
+    {240, 176},  // FRAMESIZE_HQVGA
+    {240, 240},  // FRAMESIZE_240X240
+    {320, 240},  // FRAMESIZE_QVGA
+    {400, 296},  // FRAMESIZE_CIF
+    {480, 320},  // FRAMESIZE_HVGA
+    {640, 480},  // FRAMESIZE_VGA
+    {800, 600},  // FRAMESIZE_SVGA
+    {1024, 768}, // FRAMESIZE_XGA
+    {1280, 720}, // FRAMESIZE_HD
+    {1280, 1024},// FRAMESIZE_SXGA
+    {1600, 1200},// FRAMESIZE_UXGA
+};
+
+static struct
+{
+    std::mutex lock;
+    std::condition_variable returned;
+    host_camera_config_t config;
+    std::vector<camera_fb_t> fbs;
+    std::vector<bool> in_use;
+    FILE *input;
+    RecordReader recording;
+    std::vector<record_index_entry_t> recorded_frames;
+    std::vector<uint8_t> chunk;
+    int64_t replay_offset;
+    uint32_t captured;
+    bool exhausted;
+    int64_t next_capture_us;
+    int64_t face_left_us;
+    sensor_t sensor;
+} camera;
+
+static int sensor_set_noop(sensor_t *, int) { return 0; }
+static int sensor_set_framesize(sensor_t *, framesize_t) { return 0; }
+
+void host_camera_configure(const host_camera_config_t &config)
+{
+    camera.config = config;
+}
+
+bool host_camera_exhausted()
+{
+    std::lock_guard<std::mutex> guard(camera.lock);
+    return camera.exhausted;
+}
+
+uint32_t host_camera_frames_captured()
+{
+    std::lock_guard<std::mutex> guard(camera.lock);
+    return camera.captured;
+}
+
+int64_t host_camera_face_left_time()
+{
+    std::lock_guard<std::mutex> guard(camera.lock);
+    return camera.face_left_us;
+}
+
+uint32_t host_camera_frames_in_use()
+{
+    std::lock_guard<std::mutex> guard(camera.lock);
+    uint32_t count = 0;
+    for (bool used : camera.in_use)
+        count += used;
+    return count;
+}
+
+int64_t host_camera_replay_offset()
+{
+    std::lock_guard<std::mutex> guard(camera.lock);
+    return camera.replay_offset;
+}
+
+// Bytes swapped, the order the sensor delivers RGB565 in
+static inline uint16_t rgb565(int r, int g, int b)
+{
+    uint16_t pixel = static_cast<uint16_t>(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+    return static_cast<uint16_t>((pixel >> 8) | (pixel << 8));
+}
+
+static bool face_away(uint32_t index)
+{
+    return camera.config.away && index / camera.config.away % 2 == 1;
+}
+
+static void generate_frame(uint16_t *pixels, int width, int height, uint32_t index, uint32_t dropout, uint32_t still, float face_scale)
+{
+    // Background: cool gradient with a little texture so the frame is not trivially compressible.
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            int noise = ((x * 73 + y * 151 + index * 17) & 15);
+            pixels[y * width + x] = rgb565(40 + noise, 60 + (y * 80) / height, 140 + (x * 100) / width);
+        }
+    }
+
+    // Dropouts emulate frames the detectors miss: the face keeps moving but is not drawn.
+    if (index % HOST_CAMERA_DROPOUT_PERIOD < dropout || face_away(index))
+        return;
+
+    // Face: ellipse on a Lissajous path, growing and shrinking to exercise the forward control.
+    // It stops for the first `still` frames of every HOST_CAMERA_STILL_PERIOD; sensor noise goes on.
+    uint32_t moving = index / HOST_CAMERA_STILL_PERIOD * (HOST_CAMERA_STILL_PERIOD - still) +
+                      (index % HOST_CAMERA_STILL_PERIOD > still ? index % HOST_CAMERA_STILL_PERIOD - still : 0);
+    double t = moving / 30.0;
+    double scale = std::min(width, height);
+    double cx = width / 2.0 + std::sin(t * 0.9) * width * 0.35;
+    double cy = height / 2.0 + std::sin(t * 0.6) * height * 0.25;
+    double rx = scale * face_scale * (0.12 + 0.06 * std::sin(t * 0.4));
+    double ry = rx * 1.25;
+    uint16_t skin = rgb565(224, 172, 140);
+    uint16_t feature = rgb565(60, 30, 30);
+
+    int y0 = std::max(0, static_cast<int>(cy - ry)), y1 = std::min(height - 1, static_cast<int>(cy + ry));
+    int x0 = std::max(0, static_cast<int>(cx - rx)), x1 = std::min(width - 1, static_cast<int>(cx + rx));
+    for (int y = y0; y <= y1; y++)
+    {
+        for (int x = x0; x <= x1; x++)
+        {
+            double dx = (x - cx) / rx, dy = (y - cy) / ry;
+            if (dx * dx + dy * dy > 1.0)
+                continue;
+            bool eye = std::fabs(dy + 0.3) < 0.1 && std::fabs(std::fabs(dx) - 0.4) < 0.12;
+            bool mouth = std::fabs(dy - 0.45) < 0.06 && std::fabs(dx) < 0.35;
+            pixels[y * width + x] = (eye || mouth) ? feature : skin;
+        }
+    }
+}
+
+// Wait for the frame's recorded capture time, shifted to start now, and decode it
+static bool replay_frame(camera_fb_t *fb, uint32_t index, int64_t *capture_us)
+{
+    record_chunk_t chunk;
+    camera.recording.seek(camera.recorded_frames[index].offset);
+    if (!camera.recording.next(&chunk, &camera.chunk) || chunk.type != RECORD_CHUNK_FRAME || camera.chunk.size() < sizeof(record_frame_t))
+        return false;
+    record_frame_t header;
+    memcpy(&header, camera.chunk.data(), sizeof(header));
+    if (header.width != fb->width || header.height != fb->height)
+    {
+        ESP_LOGE(TAG, "Recorded frame %u is %ux%u, the camera was set up for %zux%zu", index, header.width, header.height, fb->width, fb->height);
+        return false;
+    }
+
+    int64_t now = esp_timer_get_time();
+    if (index == 0)
+        camera.replay_offset = now - header.capture_time;
+    *capture_us = header.capture_time + camera.replay_offset;
+    if (*capture_us > now)
+        std::this_thread::sleep_for(std::chrono::microseconds(*capture_us - now));
+
+    const uint8_t *pixels = camera.chunk.data() + sizeof(header);
+    size_t len = camera.chunk.size() - sizeof(header);
+    if (header.format == RECORD_FORMAT_JPEG)
+    {
+        if (jpg2rgb565(pixels, len, fb->buf, JPG_SCALE_NONE))
+            return true;
+        ESP_LOGE(TAG, "Recorded frame %u is JPEG, the host build has no decoder or the data is corrupt", index);
+        return false;
+    }
+    if (len != fb->len)
+        return false;
+    memcpy(fb->buf, pixels, len);
+    return true;
+}
+
+esp_err_t esp_camera_init(const camera_config_t *config)
+{
+    // Roughly what probing the sensor over SCCB and loading its registers takes on the robot
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    std::lock_guard<std::mutex> guard(camera.lock);
+    if (config->pixel_format != PIXFORMAT_RGB565 || config->frame_size >= FRAMESIZE_INVALID)
+        return ESP_ERR_INVALID_ARG;
+
+    camera.config.frame_size = config->frame_size;
+    const resolution_info_t &res = resolution[config->frame_size];
+    camera.fbs.resize(config->fb_count);
+    camera.in_use.assign(config->fb_count, false);
+    for (camera_fb_t &fb : camera.fbs)
+    {
+        fb.width = res.width;
+        fb.height = res.height;
+        fb.len = res.width * res.height * sizeof(uint16_t);
+        fb.format = PIXFORMAT_RGB565;
+        fb.buf = new uint8_t[fb.len];
+    }
+
+    camera.input = nullptr;
+    if (!camera.config.input_path.empty())
+    {
+        camera.input = fopen(camera.config.input_path.c_str(), "rb");
+        if (camera.input == nullptr)
+        {
+            ESP_LOGE(TAG, "Cannot open %s", camera.config.input_path.c_str());
+            return ESP_FAIL;
+        }
+    }
+
+    camera.recorded_frames.clear();
+    camera.replay_offset = 0;
+    if (camera.config.replay)
+    {
+        if (!camera.recording.open(esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, HOST_REPLAY_PARTITION)) ||
+            !camera.recording.frames(&camera.recorded_frames))
+        {
+            ESP_LOGE(TAG, "No frames to replay");
+            return ESP_FAIL;
+        }
+    }
+
+    camera.sensor = {};
+    camera.sensor.id.PID = OV2640_PID;
+    camera.sensor.set_vflip = sensor_set_noop;
+    camera.sensor.set_hmirror = sensor_set_noop;
+    camera.sensor.set_brightness = sensor_set_noop;
+    camera.sensor.set_saturation = sensor_set_noop;
+    camera.sensor.set_sharpness = sensor_set_noop;
+    camera.sensor.set_awb_gain = sensor_set_noop;
+    camera.sensor.set_framesize = sensor_set_framesize;
+
+    camera.captured = 0;
+    camera.face_left_us = 0;
+    camera.exhausted = false;
+    camera.next_capture_us = esp_timer_get_time();
+    return ESP_OK;
+}
+
+esp_err_t esp_camera_deinit()
+{
+    std::lock_guard<std::mutex> guard(camera.lock);
+    for (camera_fb_t &fb : camera.fbs)
+        delete[] fb.buf;
+    camera.fbs.clear();
+    camera.in_use.clear();
+    if (camera.input)
+        fclose(camera.input);
+    camera.input = nullptr;
+    return ESP_OK;
+}
+
+sensor_t *esp_camera_sensor_get()
+{
+    return &camera.sensor;
+}
+
+camera_fb_t *esp_camera_fb_get()
+{
+    std::unique_lock<std::mutex> guard(camera.lock);
+    if (camera.exhausted || camera.captured >= camera.config.frames || (camera.config.replay && camera.captured >= camera.recorded_frames.size()))
+    {
+        camera.exhausted = true;
+        guard.unlock();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return nullptr;
+    }
+
+    size_t slot = 0;
+    camera.returned.wait(guard, [&slot]()
+                         {
+                             for (slot = 0; slot < camera.in_use.size(); slot++)
+                                 if (!camera.in_use[slot])
+                                     return true;
+                             return false;
+                         });
+    camera.in_use[slot] = true;
+    camera_fb_t *fb = &camera.fbs[slot];
+    guard.unlock();
+
+    // The sensor free-runs: a frame is only available on the next edge of its frame grid.
+    int64_t now = esp_timer_get_time();
+    if (camera.config.fps && !camera.config.replay) // Recorded frames come at their own pace
+    {
+        int64_t period = 1000000 / camera.config.fps;
+        while (camera.next_capture_us < now)
+            camera.next_capture_us += period;
+        std::this_thread::sleep_for(std::chrono::microseconds(camera.next_capture_us - now));
+        now = camera.next_capture_us;
+        camera.next_capture_us += period;
+    }
+
+    bool ok = true;
+    if (camera.config.replay)
+        ok = replay_frame(fb, camera.captured, &now);
+    else if (camera.input)
+        ok = fread(fb->buf, 1, fb->len, camera.input) == fb->len;
+    else
+        generate_frame(reinterpret_cast<uint16_t *>(fb->buf), fb->width, fb->height, camera.captured, camera.config.dropout, camera.config.still, camera.config.face_scale);
+
+    guard.lock();
+    if (!ok)
+    {
+        camera.exhausted = true;
+        camera.in_use[slot] = false;
+        return nullptr;
+    }
+    fb->timestamp.tv_sec = now / 1000000;
+    fb->timestamp.tv_usec = now % 1000000;
+    if (!camera.config.replay && !camera.input && face_away(camera.captured) && !face_away(camera.captured - 1))
+        camera.face_left_us = now;
+    camera.captured++;
+    guard.unlock();
+
+    host_record_capture(fb->buf, now);
+    return fb;
+}
+
+void esp_camera_fb_return(camera_fb_t *fb)
+{
+    std::lock_guard<std::mutex> guard(camera.lock);
+    for (size_t slot = 0; slot < camera.fbs.size(); slot++)
+    {
+        if (&camera.fbs[slot] == fb)
+        {
+            if (!camera.in_use[slot])
+            {
+                ESP_LOGE(TAG, "Frame buffer %p returned twice", fb);
+                abort();
+            }
+            camera.in_use[slot] = false;
+            camera.returned.notify_all();
+            host_record_release(fb->buf, esp_timer_get_time());
+            return;
+        }
+    }
+    ESP_LOGE(TAG, "esp_camera_fb_return() with a foreign buffer %p", fb);
+    abort();
+}
@@ -0,0 +1,136 @@
+// Stand-ins for the ESP-DL face detectors. MSR01 scans a subsampled grid for
+// skin-coloured pixels and proposes their bounding box; MNP01 rescans each
+// candidate at full resolution and adds the five landmarks. Both can be padded
+// with busy time to match the cost of the real models on the ESP32-S3.
+
+#include "human_face_detect_mnp01.hpp"
+#include "human_face_detect_msr01.hpp"
+
+#include "host_harness.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include "esp_timer.h"
+
+static std::atomic<int64_t> stage_cost_us[HOST_STAGE_MAX];
+
+void host_detector_set_cost(host_stage_t stage, int64_t cost_us)
+{
+    stage_cost_us[stage] = cost_us;
+}
+
+static void pad_to_cost(int64_t start_us, int64_t cost_us)
+{
+    int64_t until = start_us + cost_us;
+    while (esp_timer_get_time() < until)
+    {
+    }
+}
+
+static inline bool is_skin(uint16_t pixel)
+{
+    pixel = static_cast<uint16_t>((pixel >> 8) | (pixel << 8)); // Camera byte order
+    int r = pixel >> 11, g = (pixel >> 5) & 0x3F, b = pixel & 0x1F;
+    return r >= 24 && g >= 36 && g <= 50 && b >= 13 && b <= 21;
+}
+
+typedef struct
+{
+    int left, top, right, bottom;
+    int hits;
+} skin_box_t;
+
+static skin_box_t scan_skin(const uint16_t *pixels, int width, int x0, int y0, int x1, int y1, int step)
+{
+    skin_box_t box = {x1, y1, x0, y0, 0};
+    for (int y = y0; y <= y1; y += step)
+    {
+        const uint16_t *row = pixels + y * width;
+        for (int x = x0; x <= x1; x += step)
+        {
+            if (is_skin(row[x]))
+            {
+                box.left = std::min(box.left, x);
+                box.right = std::max(box.right, x);
+                box.top = std::min(box.top, y);
+                box.bottom = std::max(box.bottom, y);
+                box.hits++;
+            }
+        }
+    }
+    return box;
+}
+
+HumanFaceDetectMSR01::HumanFaceDetectMSR01(const float score_threshold, const float nms_threshold, const int top_k, float resize_scale) : score_threshold(score_threshold),
+                                                                                                                                         resize_scale(resize_scale)
+{
+    (void)nms_threshold;
+    (void)top_k;
+}
+
+std::list<dl::detect::result_t> &HumanFaceDetectMSR01::infer(uint16_t *input_element, std::vector<int> input_shape)
+{
+    int64_t start = esp_timer_get_time();
+    const int height = input_shape[0], width = input_shape[1];
+    const int step = std::max(1, static_cast<int>(std::lround(1.0f / this->resize_scale)));
+
+    this->results.clear();
+    skin_box_t box = scan_skin(input_element, width, 0, 0, width - 1, height - 1, step);
+    if (box.hits * step * step >= 64)
+    {
+        dl::detect::result_t candidate;
+        candidate.category = 0;
+        candidate.score = 0.9f;
+        candidate.box = {std::max(0, box.left - step), std::max(0, box.top - step),
+                         std::min(width - 1, box.right + step), std::min(height - 1, box.bottom + step)};
+        if (candidate.score >= this->score_threshold)
+            this->results.push_back(candidate);
+    }
+
+    pad_to_cost(start, stage_cost_us[HOST_STAGE_MSR01] * width * height / (240 * 240));
+    host_record_stage(HOST_STAGE_MSR01, start, esp_timer_get_time(), width * height);
+    return this->results;
+}
+
+HumanFaceDetectMNP01::HumanFaceDetectMNP01(const float score_threshold, const float nms_threshold, const int top_k) : score_threshold(score_threshold)
+{
+    (void)nms_threshold;
+    (void)top_k;
+}
+
+std::list<dl::detect::result_t> &HumanFaceDetectMNP01::infer(uint16_t *input_element, std::vector<int> input_shape, std::list<dl::detect::result_t> &candidates)
+{
+    int64_t start = esp_timer_get_time();
+    const int width = input_shape[1];
+
+    this->results.clear();
+    for (auto &candidate : candidates)
+    {
+        skin_box_t box = scan_skin(input_element, width, candidate.box[0], candidate.box[1], candidate.box[2], candidate.box[3], 1);
+        int area = (box.right - box.left + 1) * (box.bottom - box.top + 1);
+        if (box.hits == 0 || area <= 0)
+            continue;
+
+        dl::detect::result_t result;
+        result.category = 0;
+        result.score = std::min(1.0f, static_cast<float>(box.hits) / (area * static_cast<float>(M_PI) / 4.0f));
+        if (result.score < this->score_threshold)
+            continue;
+
+        int w = box.right - box.left, h = box.bottom - box.top;
+        result.box = {box.left, box.top, box.right, box.bottom};
+        // left eye, left mouth corner, nose, right eye, right mouth corner
+        result.keypoint = {box.left + w * 3 / 10, box.top + h * 7 / 20,
+                           box.left + w / 3, box.top + h * 29 / 40,
+                           box.left + w / 2, box.top + h / 2,
+                           box.left + w * 7 / 10, box.top + h * 7 / 20,
+                           box.left + w * 2 / 3, box.top + h * 29 / 40};
+        this->results.push_back(result);
+    }
+
+    pad_to_cost(start, stage_cost_us[HOST_STAGE_MNP01] * static_cast<int64_t>(candidates.size()));
+    host_record_stage(HOST_STAGE_MNP01, start, esp_timer_get_time(), input_shape[0] * width);
+    return this->results;
+}
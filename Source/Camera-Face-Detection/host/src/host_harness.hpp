@@ -0,0 +1,69 @@
+#pragma once
+
+// Shared state between the emulated camera/detectors and the harness driver.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "esp_camera.h"
+
+typedef struct
+{
+    framesize_t frame_size;
+    std::string input_path; // raw RGB565 frames; empty selects the generator
+    uint32_t frames;        // number of frames to capture before the source ends
+    uint32_t fps;           // sensor frame rate, 0 for "as fast as buffers are returned"
+    uint32_t dropout;       // generator frames without a face out of every HOST_CAMERA_DROPOUT_PERIOD
+    uint32_t still;         // generator frames where the scene holds still out of every HOST_CAMERA_STILL_PERIOD
+    float face_scale;       // generated face size, 1 fills about a quarter of the frame height
+    bool replay;            // frames from the recording attached as HOST_REPLAY_PARTITION, at their recorded pace
+    uint32_t away;          // generator frames after which the face leaves the scene, and as many after which it is back; 0 keeps it in
+} host_camera_config_t;
+
+#define HOST_REPLAY_PARTITION "replay"
+
+#define HOST_CAMERA_DROPOUT_PERIOD 30
+#define HOST_CAMERA_STILL_PERIOD 90
+
+void host_camera_configure(const host_camera_config_t &config);
+bool host_camera_exhausted();
+uint32_t host_camera_frames_captured();
+uint32_t host_camera_frames_in_use();
+
+// Capture time of the last frame the face left the scene on, 0 if it never did, us
+int64_t host_camera_face_left_time();
+
+// Replayed frames are stamped with their recorded capture time plus this, us
+int64_t host_camera_replay_offset();
+
+typedef enum
+{
+    HOST_STAGE_MSR01 = 0,
+    HOST_STAGE_MNP01,
+    HOST_STAGE_MAX
+} host_stage_t;
+
+// Busy time added to each inference call to emulate device model cost: MSR01 per
+// 240x240 input, scaled with the input area, MNP01 per candidate it refines.
+void host_detector_set_cost(host_stage_t stage, int64_t cost_us);
+
+// Inference calls, with the number of input pixels they searched.
+void host_record_stage(host_stage_t stage, int64_t start_us, int64_t end_us, uint32_t pixels);
+
+// Per-frame timing, keyed by the camera frame buffer.
+void host_record_capture(const void *frame_buf, int64_t capture_us);
+void host_record_display(const void *frame_buf, int64_t display_us);
+void host_record_release(const void *frame_buf, int64_t release_us);
+
+class HostLatency
+{
+private:
+    std::vector<double> samples;
+
+public:
+    void add(double value_ms) { this->samples.push_back(value_ms); }
+    void reserve(size_t count) { this->samples.reserve(count); }
+    size_t count() const { return this->samples.size(); }
+    void print(const char *name);
+};
@@ -0,0 +1,1659 @@
+// Desktop harness for the face-tracking pipeline. It wires the shipping
+// AppCamera, AppFanout, AppFace and AppTransmission sources together exactly
+// as app_main() does, runs AppLCD against a mock SPI panel, plays the Alvik side of the ESP-NOW link, and reports throughput and
+// per-stage latency.
+
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <getopt.h>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "dl_image.hpp"
+
+#include "app_alloc.hpp"
+#include "app_arena.hpp"
+#include "app_boot.hpp"
+#include "app_button.hpp"
+#include "app_camera.hpp"
+#include "app_console.hpp"
+#include "app_control.hpp"
+#include "app_face.hpp"
+#include "app_fanout.hpp"
+#include "app_frame_link.hpp"
+#include "app_frame_pool.hpp"
+#include "app_latency.hpp"
+#include "app_lcd.hpp"
+#include "app_led.hpp"
+#include "app_motion.hpp"
+#include "app_recorder.hpp"
+#include "app_scaler.hpp"
+#include "app_telemetry.hpp"
+#include "app_transmission.hpp"
+#include "app_wire.hpp"
+
+#include "host_harness.hpp"
+#include "host_hooks.h"
+
+static const char TAG[] = "Host";
+
+/* ---------------------------------------------------------------- statistics */
+
+void HostLatency::print(const char *name)
+{
+    if (this->samples.empty())
+    {
+        printf("  %-22s %8s\n", name, "-");
+        return;
+    }
+    std::sort(this->samples.begin(), this->samples.end());
+    double sum = 0;
+    for (double sample : this->samples)
+        sum += sample;
+    size_t p50 = (this->samples.size() - 1) / 2;
+    size_t p99 = (this->samples.size() - 1) * 99 / 100;
+    printf("  %-22s %8.2f %8.2f %8.2f %8.2f %8.2f %8zu\n", name, this->samples.front(), sum / this->samples.size(),
+           this->samples[p50], this->samples[p99], this->samples.back(), this->samples.size());
+}
+
+typedef struct
+{
+    int64_t capture_us;
+    int64_t display_us;
+} frame_record_t;
+
+static std::mutex records_lock;
+static std::map<const void *, frame_record_t> records;
+
+static HostLatency stage_latency[HOST_STAGE_MAX];
+static HostLatency stage_pixels[HOST_STAGE_MAX];
+static HostLatency capture_to_display;
+static HostLatency capture_to_release;
+static uint32_t frames_displayed = 0;
+
+void host_record_capture(const void *frame_buf, int64_t capture_us)
+{
+    std::lock_guard<std::mutex> guard(records_lock);
+    records[frame_buf] = frame_record_t{capture_us, 0};
+}
+
+// Each stage is only ever called from one task, so its samples need no lock.
+void host_record_stage(host_stage_t stage, int64_t start_us, int64_t end_us, uint32_t pixels)
+{
+    stage_latency[stage].add((end_us - start_us) / 1000.0);
+    stage_pixels[stage].add(pixels / 1000.0);
+}
+
+void host_record_display(const void *frame_buf, int64_t display_us)
+{
+    std::lock_guard<std::mutex> guard(records_lock);
+    auto it = records.find(frame_buf);
+    if (it != records.end())
+        it->second.display_us = display_us;
+}
+
+// The driver gets the buffer back once every consumer is done with it.
+void host_record_release(const void *frame_buf, int64_t release_us)
+{
+    std::lock_guard<std::mutex> guard(records_lock);
+    auto it = records.find(frame_buf);
+    if (it == records.end())
+        return;
+    const frame_record_t &record = it->second;
+
+    capture_to_release.add((release_us - record.capture_us) / 1000.0);
+    if (record.display_us)
+    {
+        frames_displayed++;
+        capture_to_display.add((record.display_us - record.capture_us) / 1000.0);
+    }
+    records.erase(it);
+}
+
+/* ---------------------------------------------------------------- display */
+
+// AppLCD gives the camera frame back once its pixels are in a display buffer
+static void lcd_release_pooled(camera_fb_t *frame)
+{
+    host_record_display(frame->buf, esp_timer_get_time());
+    frame_pool_release(frame);
+}
+
+static void lcd_release_direct(camera_fb_t *frame)
+{
+    host_record_display(frame->buf, esp_timer_get_time());
+    esp_camera_fb_return(frame);
+}
+
+static HostLatency panel_interval;
+static int64_t panel_last_frame_us = 0;
+static int64_t panel_start_us = 0;
+
+static void panel_frame_done(int64_t done_us)
+{
+    if (done_us < panel_start_us) // Boot screens
+        return;
+    if (panel_last_frame_us)
+        panel_interval.add((done_us - panel_last_frame_us) / 1000.0);
+    panel_last_frame_us = done_us;
+}
+
+/* ---------------------------------------------------------------- simulated Alvik */
+
+static const uint8_t alvik_mac[ESP_NOW_ETH_ALEN] = {0x24, 0x58, 0x7c, 0x00, 0xa1, 0x1c};
+static const char alvik_hello[] = "ARDUINO_ALVIK_CAMERA_ROBOT_:D";
+static const char camera_hello[] = "ARDUINO_ALVIK_CAMERA_FACEDETECTOR_:P";
+
+#define HOST_ALVIK_LINK_TIMEOUT 300 // ms, camera_comms.LINK_TIMEOUT_MS: the Alvik stops when no frame came for this long
+#define HOST_ALVIK_ECHO_DELAY_US 6000 // from a frame handed to the radio to its heartbeat coming in: air time both ways and main.py's poll
+#define HOST_ALVIK_RTT_TOLERANCE_US 2000 // the measured round trip may exceed the simulated one by this much on average
+#define HOST_CALLBACK_STALL_START_US 1000000 // into the run, when --callback-stall holds the send callbacks back
+
+static std::atomic<uint32_t> alvik_handshakes{0};
+static std::atomic<uint32_t> alvik_orders{0};
+static std::atomic<uint32_t> alvik_predicted{0};
+static std::atomic<uint32_t> alvik_malformed{0};
+static std::atomic<uint32_t> alvik_sequence_gaps{0};
+static std::atomic<uint32_t> alvik_heartbeats{0};
+static std::atomic<uint32_t> alvik_no_target{0};
+static movement_orders_t alvik_last_orders = {};
+static std::atomic<uint64_t> alvik_bytes{0};
+static std::atomic<uint32_t> alvik_max_frame{0};
+
+// The Alvik drives while frames bring orders on a face, as main.py does
+static std::atomic<bool> alvik_link_cut{false}; // frames are lost on the air both ways
+static uint32_t alvik_loss_percent = 0;            // frames to the Alvik lost on the air, out of every 100
+static std::atomic<bool> alvik_moving{false};
+static std::atomic<int64_t> alvik_frame_time{0}; // last frame received
+static std::atomic<int64_t> alvik_stop_time{0};  // last time a no-target frame stopped it
+
+static int16_t read_le16(const uint8_t *data) { return static_cast<int16_t>(data[0] | (data[1] << 8)); }
+
+// Heartbeats on their way back, each sent HOST_ALVIK_ECHO_DELAY_US after the frame it echoes
+typedef struct
+{
+    std::chrono::steady_clock::time_point due;
+    wire_heartbeat_t heartbeat;
+} host_alvik_echo_t;
+
+// Never destroyed, the thread outlives main()
+static std::mutex &alvik_echo_lock = *new std::mutex;
+static std::condition_variable &alvik_echo_queued = *new std::condition_variable;
+static std::deque<host_alvik_echo_t> &alvik_echoes = *new std::deque<host_alvik_echo_t>();
+
+static void alvik_echo_thread()
+{
+    std::unique_lock<std::mutex> guard(alvik_echo_lock);
+    while (true)
+    {
+        // All are delayed alike, the oldest is always the next one due
+        alvik_echo_queued.wait(guard, [] { return !alvik_echoes.empty(); });
+        host_alvik_echo_t echo = alvik_echoes.front();
+        alvik_echoes.pop_front();
+        guard.unlock();
+        std::this_thread::sleep_until(echo.due);
+        if (!alvik_link_cut)
+            host_esp_now_inject(alvik_mac, reinterpret_cast<const uint8_t *>(&echo.heartbeat), sizeof(echo.heartbeat), -40);
+        guard.lock();
+    }
+}
+
+static void alvik_echo(uint16_t sequence)
+{
+    static std::once_flag started;
+    std::call_once(started, [] { std::thread(alvik_echo_thread).detach(); });
+    host_alvik_echo_t echo;
+    echo.due = std::chrono::steady_clock::now() + std::chrono::microseconds(HOST_ALVIK_ECHO_DELAY_US);
+    wire_encode_heartbeat(sequence, &echo.heartbeat);
+    {
+        std::lock_guard<std::mutex> guard(alvik_echo_lock);
+        alvik_echoes.push_back(echo);
+    }
+    alvik_echo_queued.notify_one();
+}
+
+// Whether a frame is lost on the air, the same pattern on every run
+static bool alvik_frame_lost()
+{
+    static uint32_t state = 0x2545F491;
+    state = state * 1664525 + 1013904223;
+    return (state >> 8) % 100 < alvik_loss_percent;
+}
+
+// Returns whether the frame reached the Alvik, which the radio acknowledges
+static bool alvik_receive(const uint8_t *peer_addr, const uint8_t *data, size_t len)
+{
+    (void)peer_addr;
+    if (alvik_link_cut || alvik_frame_lost())
+        return false;
+    alvik_bytes += len;
+    alvik_max_frame = std::max<uint32_t>(alvik_max_frame, len);
+
+    if (len >= strlen(camera_hello) && memcmp(data, camera_hello, strlen(camera_hello)) == 0)
+    {
+        alvik_handshakes++;
+        return true;
+    }
+
+    // Unpacked field by field like camera_comms.poll_camera() ('<HBBHIhhhB'), then
+    // checked against wire_decode_orders() so both ends agree on the layout.
+    movement_orders_t orders;
+    uint16_t sequence;
+    wire_kind_t kind;
+    if (len < 17 || static_cast<uint16_t>(read_le16(data)) != WIRE_MAGIC || data[2] != WIRE_VERSION ||
+        !wire_decode_orders(data, len, &orders, &sequence, &kind))
+    {
+        alvik_malformed++;
+        return true;
+    }
+    float horizontal = read_le16(data + 10) / 100.0F;
+    float vertical = read_le16(data + 12) / 100.0F;
+    float forward = read_le16(data + 14) / 100.0F;
+    float confidence = data[16] / 255.0F;
+    if (data[3] != kind || static_cast<uint16_t>(read_le16(data + 4)) != sequence || horizontal != orders.horizontalRotationAmount ||
+        vertical != orders.verticalRotationAmount || forward != orders.forwardDisplacementAmount || confidence != orders.confidence)
+    {
+        alvik_malformed++;
+        return true;
+    }
+
+    static uint16_t expected_sequence = 0;
+    if (alvik_orders && sequence != expected_sequence)
+        alvik_sequence_gaps++;
+    expected_sequence = sequence + 1;
+
+    if (kind == WIRE_KIND_HEARTBEAT)
+        alvik_heartbeats++;
+    if (kind == WIRE_KIND_NO_TARGET)
+        alvik_no_target++;
+    alvik_last_orders = orders;
+
+    alvik_orders++;
+    if (confidence > 0 && confidence < 1.0)
+        alvik_predicted++;
+
+    int64_t now = esp_timer_get_time();
+    alvik_frame_time = now;
+    if (alvik_moving && kind == WIRE_KIND_NO_TARGET)
+        alvik_stop_time = now;
+    alvik_moving = kind != WIRE_KIND_NO_TARGET && confidence > 0;
+
+    // Every frame is answered with a heartbeat echoing its sequence number, after the time it takes the real one
+    alvik_echo(sequence);
+    return true;
+}
+
+/* ---------------------------------------------------------------- wire codec */
+
+static bool wire_expect(const char *what, bool ok)
+{
+    printf("  %-52s %s\n", what, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+static bool wire_decodes(const wire_movement_orders_t &frame, size_t len = sizeof(wire_movement_orders_t))
+{
+    movement_orders_t orders;
+    return wire_decode_orders(reinterpret_cast<const uint8_t *>(&frame), len, &orders, nullptr);
+}
+
+// Encode and decode edge cases of both frames, as camera_comms.py relies on them.
+static bool wire_check()
+{
+    bool ok = true;
+    movement_orders_t orders = {};
+    movement_orders_t decoded;
+    wire_movement_orders_t frame;
+    uint16_t sequence;
+    wire_kind_t kind;
+    printf("wire: version %u, %zu B movement orders, %zu B heartbeat\n", WIRE_VERSION, sizeof(wire_movement_orders_t),
+           sizeof(wire_heartbeat_t));
+
+    orders.horizontalRotationAmount = 12.34F;
+    orders.verticalRotationAmount = -5.67F;
+    orders.forwardDisplacementAmount = 8.9F;
+    orders.confidence = 0.5F;
+    orders.captureTime = 0x123456789LL;
+    wire_encode_orders(orders, WIRE_KIND_ORDERS, 0xFFFF, &frame);
+    ok &= wire_expect("orders round trip", wire_decode_orders(reinterpret_cast<const uint8_t *>(&frame), sizeof(frame), &decoded, &sequence, &kind) &&
+                                               decoded.horizontalRotationAmount == 12.34F && decoded.verticalRotationAmount == -5.67F &&
+                                               decoded.forwardDisplacementAmount == 8.9F && frame.confidence == 128 && decoded.target &&
+                                               decoded.captureTime == 0x23456789 && sequence == 0xFFFF && kind == WIRE_KIND_ORDERS);
+
+    orders.horizontalRotationAmount = 1000.0F;
+    orders.verticalRotationAmount = -1000.0F;
+    orders.forwardDisplacementAmount = 1e9F;
+    wire_encode_orders(orders, WIRE_KIND_HEARTBEAT, 1, &frame);
+    ok &= wire_expect("amounts saturate at the int16 range", frame.horizontal_rotation == INT16_MAX && frame.vertical_rotation == INT16_MIN &&
+                                                                 frame.forward_displacement == INT16_MAX);
+    orders.horizontalRotationAmount = 327.675F; // rounds to 32768
+    orders.forwardDisplacementAmount = -327.685F;
+    wire_encode_orders(orders, WIRE_KIND_HEARTBEAT, 1, &frame);
+    ok &= wire_expect("amounts one LSB past the range saturate", frame.horizontal_rotation == INT16_MAX &&
+                                                                     frame.forward_displacement == INT16_MIN);
+
+    orders.confidence = 1.5F;
+    wire_encode_orders(orders, WIRE_KIND_ORDERS, 2, &frame);
+    bool high = frame.confidence == WIRE_CONFIDENCE_SCALE;
+    orders.confidence = -0.5F;
+    wire_encode_orders(orders, WIRE_KIND_ORDERS, 2, &frame);
+    ok &= wire_expect("confidence clamped to 0..1", high && frame.confidence == 0);
+
+    orders.confidence = 1.0F;
+    wire_encode_orders(orders, WIRE_KIND_NO_TARGET, 3, &frame);
+    ok &= wire_expect("no target carries no movement", wire_decode_orders(reinterpret_cast<const uint8_t *>(&frame), sizeof(frame), &decoded, nullptr, &kind) &&
+                                                           kind == WIRE_KIND_NO_TARGET && !decoded.target && frame.horizontal_rotation == 0 &&
+                                                           frame.vertical_rotation == 0 && frame.forward_displacement == 0 && frame.confidence == 0);
+
+    wire_encode_orders(orders, WIRE_KIND_ORDERS, 4, &frame);
+    wire_movement_orders_t bad = frame;
+    bad.magic = WIRE_MAGIC ^ 0x0100;
+    ok &= wire_expect("wrong magic rejected", !wire_decodes(bad));
+    bad = frame;
+    bad.version = WIRE_VERSION - 1;
+    ok &= wire_expect("wrong version rejected", !wire_decodes(bad));
+    bad = frame;
+    bad.kind = WIRE_KIND_ALVIK_HEARTBEAT;
+    bool heartbeat_kind = !wire_decodes(bad);
+    bad.kind = WIRE_KIND_ALVIK_HEARTBEAT + 1;
+    ok &= wire_expect("unknown kind rejected", heartbeat_kind && !wire_decodes(bad));
+    ok &= wire_expect("short buffer rejected", !wire_decodes(frame, sizeof(frame) - 1) && wire_decodes(frame));
+
+    wire_heartbeat_t heartbeat;
+    wire_encode_heartbeat(0xBEEF, &heartbeat);
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&heartbeat);
+    sequence = 0;
+    ok &= wire_expect("heartbeat round trip", wire_decode_heartbeat(bytes, sizeof(heartbeat), &sequence) && sequence == 0xBEEF &&
+                                                  bytes[0] == 0xCA && bytes[1] == 0xA1 && bytes[3] == WIRE_KIND_ALVIK_HEARTBEAT);
+    ok &= wire_expect("short heartbeat rejected", !wire_decode_heartbeat(bytes, sizeof(heartbeat) - 1, nullptr));
+    ok &= wire_expect("orders are not a heartbeat, nor a heartbeat orders",
+                      !wire_decode_heartbeat(reinterpret_cast<const uint8_t *>(&frame), sizeof(frame), nullptr) &&
+                          !wire_decode_orders(bytes, sizeof(heartbeat), &decoded, nullptr));
+    wire_heartbeat_t bad_heartbeat = heartbeat;
+    bad_heartbeat.version = WIRE_VERSION + 1;
+    bool version = !wire_decode_heartbeat(reinterpret_cast<const uint8_t *>(&bad_heartbeat), sizeof(bad_heartbeat), nullptr);
+    bad_heartbeat = heartbeat;
+    bad_heartbeat.magic = 0x4241; // "AB", the start of a text message
+    ok &= wire_expect("heartbeat with a wrong version or magic rejected",
+                      version && !wire_decode_heartbeat(reinterpret_cast<const uint8_t *>(&bad_heartbeat), sizeof(bad_heartbeat), nullptr));
+    return ok;
+}
+
+/* ---------------------------------------------------------------- link check */
+
+#define HOST_LINK_CHECK_AWAY 60 // frames the face is in, then away, then back for, at 30 frames/s
+
+typedef struct
+{
+    int64_t face_left;   // capture time of the first frame without the face
+    int64_t stopped;     // a no-target frame stopped the Alvik
+    int64_t cut;         // the radio was cut while the Alvik drove
+    int64_t alvik_lost;  // the Alvik's link timeout ran out
+    int64_t camera_lost; // AppTransmission reported the link down
+} host_link_check_t;
+
+// Called every tick while frames flow: the face leaves, the Alvik has to stop on the no-target
+// order; the face comes back and the radio goes, both ends have to notice
+static void link_check_step(host_link_check_t *check, const AppTransmission *transmission)
+{
+    int64_t now = esp_timer_get_time();
+    if (check->face_left == 0)
+    {
+        check->face_left = host_camera_face_left_time();
+    }
+    else if (check->stopped == 0)
+    {
+        if (alvik_stop_time > check->face_left)
+            check->stopped = alvik_stop_time;
+    }
+    else if (check->cut == 0)
+    {
+        if (alvik_moving && host_camera_frames_captured() >= 2 * HOST_LINK_CHECK_AWAY + HOST_LINK_CHECK_AWAY / 2)
+        {
+            check->cut = now;
+            alvik_link_cut = true;
+        }
+    }
+    else
+    {
+        if (check->alvik_lost == 0 && now - alvik_frame_time > HOST_ALVIK_LINK_TIMEOUT * 1000)
+            check->alvik_lost = alvik_frame_time + HOST_ALVIK_LINK_TIMEOUT * 1000;
+        if (check->camera_lost == 0 && !transmission->link_alive)
+            check->camera_lost = now;
+    }
+}
+
+static bool link_check_report(const host_link_check_t &check, uint32_t send_period_ms)
+{
+    // The track outlives the face by TRACKER_PREDICTION_TIMEOUT, the no-target order follows within a period or two
+    // of the frame it ends on. Both ends poll at their own pace, the harness a tick at a time.
+    int64_t stop_limit = TRACKER_PREDICTION_TIMEOUT + 2 * send_period_ms * 1000;
+    int64_t alvik_limit = (send_period_ms + HOST_ALVIK_LINK_TIMEOUT + portTICK_PERIOD_MS) * 1000;
+    int64_t camera_limit = (send_period_ms + TRANSMISSION_LINK_TIMEOUT + portTICK_PERIOD_MS) * 1000;
+    if (check.stopped == 0 || check.alvik_lost == 0 || check.camera_lost == 0)
+    {
+        printf("link: %s\n", check.face_left == 0 ? "the face never left" : check.stopped == 0 ? "the Alvik did not stop once the face left"
+                                                                         : check.cut == 0    ? "the Alvik never drove again, the radio was not cut"
+                                                                                             : "the loss of the radio went unnoticed");
+        return false;
+    }
+
+    int64_t stop = check.stopped - check.face_left;
+    int64_t alvik_lost = check.alvik_lost - check.cut;
+    int64_t camera_lost = check.camera_lost - check.cut;
+    printf("link: face gone -> Alvik stopped in %.0f ms (limit %.0f: %d ms of track prediction and the no-target order)\n",
+           stop / 1000.0, stop_limit / 1000.0, TRACKER_PREDICTION_TIMEOUT / 1000);
+    printf("link: radio cut -> Alvik stopped in %.0f ms (limit %.0f), camera reported the link down in %.0f ms (limit %.0f)\n",
+           alvik_lost / 1000.0, alvik_limit / 1000.0, camera_lost / 1000.0, camera_limit / 1000.0);
+    return stop <= stop_limit && alvik_lost <= alvik_limit && camera_lost <= camera_limit;
+}
+
+/* ---------------------------------------------------------------- scaler benchmark */
+
+#define HOST_SCALER_BENCH_FRAMES 200
+
+// Time one panel frame from a camera frame: the resize of the whole frame into a
+// panel-sized buffer AppLCD used to do, against FrameScaler bands into a single
+// LCD_BAND_HEIGHT buffer. Bars left by the old path are not counted.
+static void scaler_benchmark()
+{
+    static const struct
+    {
+        const char *name;
+        framesize_t size;
+    } sizes[] = {{"svga", FRAMESIZE_SVGA}, {"vga", FRAMESIZE_VGA}, {"qvga", FRAMESIZE_QVGA}, {"240x240", FRAMESIZE_240X240}};
+
+    std::vector<uint16_t> panel(BOARD_LCD_H_RES * BOARD_LCD_V_RES);
+    std::vector<uint16_t> band(BOARD_LCD_H_RES * LCD_BAND_HEIGHT);
+    printf("  %-8s %-10s %12s %12s %10s %12s\n", "source", "picture", "before (us)", "bands (us)", "speedup", "tables (us)");
+    for (auto &size : sizes)
+    {
+        int width = resolution[size.size].width;
+        int height = resolution[size.size].height;
+        std::vector<uint16_t> source(width * height);
+        for (size_t i = 0; i < source.size(); i++)
+            source[i] = static_cast<uint16_t>(i * 2654435761u >> 16);
+
+        int64_t start = esp_timer_get_time();
+        FrameScaler scaler(BOARD_LCD_H_RES, BOARD_LCD_V_RES);
+        scaler.configure(width, height);
+        int64_t tables_us = esp_timer_get_time() - start;
+
+        start = esp_timer_get_time();
+        bool native = width == BOARD_LCD_H_RES && height == BOARD_LCD_V_RES; // The old path only copied these
+        for (int i = 0; i < HOST_SCALER_BENCH_FRAMES; i++)
+        {
+            if (native)
+                memcpy(panel.data(), source.data(), source.size() * sizeof(uint16_t));
+            else
+                dl::image::resize_image_nearest(source.data(), {height, width, 1}, panel.data(), {scaler.height, scaler.width, 1});
+        }
+        double resize_us = static_cast<double>(esp_timer_get_time() - start) / HOST_SCALER_BENCH_FRAMES;
+
+        start = esp_timer_get_time();
+        for (int i = 0; i < HOST_SCALER_BENCH_FRAMES; i++)
+            for (int y_start = 0; y_start < BOARD_LCD_V_RES; y_start += LCD_BAND_HEIGHT)
+                scaler.scale(source.data(), band.data(), y_start, std::min(y_start + LCD_BAND_HEIGHT, BOARD_LCD_V_RES));
+        double bands_us = static_cast<double>(esp_timer_get_time() - start) / HOST_SCALER_BENCH_FRAMES;
+
+        char picture[16];
+        snprintf(picture, sizeof(picture), "%dx%d", scaler.width, scaler.height);
+        printf("  %-8s %-10s %12.1f %12.1f %9.1fx %12lld\n", size.name, picture, resize_us, bands_us, resize_us / bands_us,
+               static_cast<long long>(tables_us));
+    }
+}
+
+/* ---------------------------------------------------------------- event bus */
+
+#define HOST_EVENT_STRESS_EVENTS 200000
+#define HOST_EVENT_STRESS_SUBSCRIBERS 3     // polling flat out, plus one that sleeps on every event
+#define HOST_EVENT_STRESS_SLOW_US 50
+#define HOST_EVENT_STRESS_PACED_EVENTS 600
+#define HOST_EVENT_STRESS_PERIOD_US (BUTTON_ACTIVE_INTERVAL * 1000) // between two events in the paced run, the fastest the button task publishes
+
+typedef struct
+{
+    Subscription subscription;
+    bool slow;
+    uint32_t delivered;
+    uint32_t reordered;  // sequence not above the previous one
+    uint32_t torn;       // button or menu not the ones published with the sequence
+    uint32_t last_sequence;
+    uint8_t last_menu;
+} host_event_subscriber_t;
+
+// Every field of an event is derived from its sequence so a torn copy shows
+static uint8_t stress_button(uint32_t sequence) { return static_cast<uint8_t>(sequence * 7 % 251); }
+static uint8_t stress_menu(uint32_t sequence) { return static_cast<uint8_t>(sequence % MENU_MAX); }
+
+static void stress_subscriber(host_event_subscriber_t *subscriber, const std::atomic<bool> *done)
+{
+    event_t event;
+    while (true)
+    {
+        bool finished = done->load(); // read before polling, so nothing published before it is left behind
+        while (subscriber->subscription.poll(&event))
+        {
+            subscriber->reordered += event.sequence <= subscriber->last_sequence;
+            subscriber->torn += event.button != stress_button(event.sequence) || event.menu != stress_menu(event.sequence);
+            subscriber->last_sequence = event.sequence;
+            subscriber->last_menu = event.menu;
+            subscriber->delivered++;
+            if (subscriber->slow)
+                std::this_thread::sleep_for(std::chrono::microseconds(HOST_EVENT_STRESS_SLOW_US));
+        }
+        if (finished)
+            return;
+        std::this_thread::yield();
+    }
+}
+
+// Publish mode changes to subscribers on their own threads, flat out or one every period_us.
+// Each must see them in order and untorn and end on the last one. Only events that found its
+// ring full may be missed, and at a steady pace none may be.
+static bool event_stress_run(uint32_t events, uint32_t period_us)
+{
+    EventBus bus;
+    host_event_subscriber_t subscribers[HOST_EVENT_STRESS_SUBSCRIBERS + 1] = {};
+    for (size_t i = 0; i <= HOST_EVENT_STRESS_SUBSCRIBERS; i++)
+    {
+        subscribers[i].slow = i == HOST_EVENT_STRESS_SUBSCRIBERS;
+        bus.subscribe(&subscribers[i].subscription);
+    }
+
+    std::atomic<bool> done{false};
+    std::vector<std::thread> threads;
+    for (host_event_subscriber_t &subscriber : subscribers)
+        threads.emplace_back(stress_subscriber, &subscriber, &done);
+
+    HostLatency publish_time;
+    uint32_t full = 0;
+    auto next = std::chrono::steady_clock::now();
+    for (uint32_t sequence = 1; sequence <= events; sequence++)
+    {
+        // Sleeping, not spinning, so the subscribers get the CPU on a single core host too
+        if (period_us)
+            std::this_thread::sleep_until(next);
+        next += std::chrono::microseconds(period_us);
+        auto start = std::chrono::steady_clock::now();
+        full += !bus.publish(stress_button(sequence), stress_menu(sequence));
+        publish_time.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    done = true;
+    for (std::thread &thread : threads)
+        thread.join();
+
+    bool ok = true;
+    printf("events: %u published %s, %u found a subscriber full\n", events, period_us ? "paced" : "flat out", full);
+    for (size_t i = 0; i <= HOST_EVENT_STRESS_SUBSCRIBERS; i++)
+    {
+        host_event_subscriber_t &subscriber = subscribers[i];
+        uint32_t missed = subscriber.subscription.missed;
+        uint32_t overflows = subscriber.subscription.overflows;
+        bool subscriber_ok = subscriber.reordered == 0 && subscriber.torn == 0 && subscriber.delivered + missed == events &&
+                             missed <= overflows && (period_us == 0 || missed == 0) &&
+                             subscriber.last_sequence == events && subscriber.last_menu == stress_menu(events);
+        printf("  subscriber %zu%s: %u delivered, %u missed of %u that found the ring full, %u reordered, %u torn, last menu %u -> %s\n", i,
+               subscriber.slow ? " (slow)" : "", subscriber.delivered, missed, overflows, subscriber.reordered, subscriber.torn,
+               subscriber.last_menu, subscriber_ok ? "ok" : "FAILED");
+        ok &= subscriber_ok;
+    }
+    printf("  %-22s %8s %8s %8s %8s %8s %8s\n", "latency (ms)", "min", "avg", "p50", "p99", "max", "n");
+    publish_time.print("publish");
+    return ok;
+}
+
+static bool event_stress()
+{
+    bool burst = event_stress_run(HOST_EVENT_STRESS_EVENTS, 0);
+    bool paced = event_stress_run(HOST_EVENT_STRESS_PACED_EVENTS, HOST_EVENT_STRESS_PERIOD_US);
+    return burst && paced;
+}
+
+/* ---------------------------------------------------------------- LED patterns */
+
+#define HOST_LED_PIN GPIO_NUM_3
+#define HOST_LED_TOLERANCE_US 20000  // edge later or earlier than the table says, well below what the eye notices
+#define HOST_LED_LOOP_WINDOW_US 2500000 // looping status patterns are watched this long
+#define HOST_LED_SETTLE_US 100000
+
+typedef struct
+{
+    int64_t at_us;
+    int level;
+} host_led_edge_t;
+
+static std::mutex led_trace_lock;
+static std::vector<host_led_edge_t> led_trace;
+
+static void led_traced(int pin, int level, int64_t time_us)
+{
+    if (pin != HOST_LED_PIN)
+        return;
+    std::lock_guard<std::mutex> guard(led_trace_lock);
+    led_trace.push_back({time_us, level});
+}
+
+// The edges a pattern should produce from `prior`, ending on `after` unless it holds or loops
+static std::vector<host_led_edge_t> led_expected(led_mode_t mode, int prior, int after, int64_t window_us)
+{
+    const led_pattern_t *pattern = led_pattern(mode);
+    std::vector<host_led_edge_t> edges;
+    int level = prior;
+    int64_t at = 0;
+    auto emit = [&](int next_level) {
+        if (next_level != level && at < window_us)
+            edges.push_back({at, next_level});
+        level = next_level;
+    };
+    for (int loop = 0; pattern->loops == 0 || loop < pattern->loops; loop++)
+    {
+        for (int step = 0; step < pattern->steps; step++)
+        {
+            emit(pattern->level ^ (step & 1));
+            if (pattern->duration[step] == LED_HOLD)
+                return edges;
+            at += pattern->duration[step] * 1000LL;
+            if (at >= window_us)
+                return edges;
+        }
+    }
+    emit(after);
+    return edges;
+}
+
+static int64_t led_duration(const std::vector<host_led_edge_t> &expected)
+{
+    return expected.empty() ? 0 : expected.back().at_us;
+}
+
+// Run `change`, then watch the pin for `window_us` and compare its edges with the expected ones
+static bool led_check_case(const char *name, const std::function<void()> &change, const std::vector<host_led_edge_t> &expected,
+                           int64_t window_us, HostLatency *error_ms)
+{
+    {
+        std::lock_guard<std::mutex> guard(led_trace_lock);
+        led_trace.clear();
+    }
+    int64_t start = esp_timer_get_time();
+    change();
+    std::this_thread::sleep_for(std::chrono::microseconds(window_us));
+    std::vector<host_led_edge_t> edges;
+    {
+        std::lock_guard<std::mutex> guard(led_trace_lock);
+        for (const host_led_edge_t &edge : led_trace)
+            if (edge.at_us - start < window_us)
+                edges.push_back(edge);
+    }
+
+    int64_t worst = 0;
+    bool ok = edges.size() == expected.size();
+    for (size_t i = 0; ok && i < edges.size(); i++)
+    {
+        int64_t error = std::llabs(edges[i].at_us - start - expected[i].at_us);
+        worst = std::max(worst, error);
+        error_ms->add(error / 1000.0);
+        ok = edges[i].level == expected[i].level && error <= HOST_LED_TOLERANCE_US;
+    }
+    printf("  %-28s %3zu edges, %3zu expected, worst %5.2f ms -> %s\n", name, edges.size(), expected.size(), worst / 1000.0,
+           ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// Plays every pattern over the status, then a press published on the bus, then walks the
+// status through the pipeline states, and checks the pin against the table
+static bool led_check(AppButton *key)
+{
+    host_gpio_set_hook(led_traced);
+    AppLED *led = new AppLED(HOST_LED_PIN, key);
+    led->run();
+    std::this_thread::sleep_for(std::chrono::microseconds(HOST_LED_SETTLE_US));
+
+    HostLatency error_ms;
+    bool ok = true;
+    printf("led: patterns over a dark status\n");
+    for (int mode = LED_ALWAYS_OFF; mode <= LED_BLINK_4S; mode++)
+    {
+        led_mode_t led_mode = static_cast<led_mode_t>(mode);
+        std::vector<host_led_edge_t> expected = led_expected(led_mode, 0, 0, INT64_MAX);
+        char name[32];
+        snprintf(name, sizeof(name), "pattern %d", mode);
+        ok &= led_check_case(name, [=] { led_play(led_mode); }, expected, led_duration(expected) + HOST_LED_SETTLE_US, &error_ms);
+        // Patterns ending on a hold stay until stopped
+        ok &= led_check_case("  stop", [] { led_stop(); }, gpio_get_level(HOST_LED_PIN) ? std::vector<host_led_edge_t>{{0, 0}} : std::vector<host_led_edge_t>{},
+                             HOST_LED_SETTLE_US, &error_ms);
+    }
+
+    // The button task is not running, this thread is the bus's only publisher
+    printf("led: press\n");
+    ok &= led_check_case("press", [key] { key->publish(BUTTON_PLAY, MENU_MAX); },
+                         led_expected(LED_BLINK_1S, 0, 0, INT64_MAX), 1000000 + HOST_LED_SETTLE_US, &error_ms);
+
+    printf("led: status\n");
+    ok &= led_check_case("detecting, link down", [] { led_set_status(LED_STATUS_DETECTING, LED_STATUS_DETECTING); },
+                         led_expected(LED_LINK_DOWN, 0, 0, HOST_LED_LOOP_WINDOW_US), HOST_LED_LOOP_WINDOW_US, &error_ms);
+    ok &= led_check_case("link up, searching", [] { led_set_status(LED_STATUS_LINK_UP, LED_STATUS_LINK_UP); },
+                         led_expected(LED_SEARCHING, gpio_get_level(HOST_LED_PIN), 0, HOST_LED_LOOP_WINDOW_US), HOST_LED_LOOP_WINDOW_US, &error_ms);
+    ok &= led_check_case("tracking", [] { led_set_status(LED_STATUS_TRACKING, LED_STATUS_TRACKING); },
+                         led_expected(LED_TRACKING, gpio_get_level(HOST_LED_PIN), 0, HOST_LED_LOOP_WINDOW_US), HOST_LED_SETTLE_US, &error_ms);
+    ok &= led_check_case("press over tracking", [] { led_play(LED_BLINK_1S); },
+                         led_expected(LED_BLINK_1S, 1, 1, INT64_MAX), 1000000 + HOST_LED_SETTLE_US, &error_ms);
+    // Searching takes over under the flashes and is dark by the time they end
+    std::vector<host_led_edge_t> lost = led_expected(LED_TARGET_LOST, 1, 0, INT64_MAX);
+    ok &= led_check_case("target lost", [] { led_set_status(LED_STATUS_TRACKING, 0); }, lost, led_duration(lost) + HOST_LED_SETTLE_US, &error_ms);
+    ok &= led_check_case("detection off", [] { led_set_status(LED_STATUS_DETECTING | LED_STATUS_LINK_UP, 0); }, {},
+                         HOST_LED_SETTLE_US, &error_ms);
+
+    led_stats_t stats;
+    led_get_stats(&stats);
+    printf("led: %u edges in %u timer wakeups\n", stats.edges, stats.wakeups);
+    printf("  %-22s %8s %8s %8s %8s %8s %8s\n", "edge error (ms)", "min", "avg", "p50", "p99", "max", "n");
+    error_ms.print("edge vs table");
+    return ok;
+}
+
+/* ---------------------------------------------------------------- button traces */
+
+#define HOST_BUTTON_IDLE_MV 3300     // ladder voltage with no button down
+#define HOST_BUTTON_PHASES BUTTON_IDLE_INTERVAL // each trace is replayed with the first sample at every ms of the idle interval
+#define HOST_BUTTON_LEGACY_PERIOD 10 // ms, and the lockout in us, of the sampling AppButton used to do
+#define HOST_BUTTON_LEGACY_LOCKOUT 500000
+
+// Voltage on the ladder over time: each step holds until the next one
+typedef std::vector<std::pair<int64_t, int>> host_adc_trace_t;
+
+typedef struct
+{
+    int64_t at_us;
+    button_name_t button;
+    button_action_t action;
+} host_button_event_t;
+
+static int trace_reading(const host_adc_trace_t &trace, int64_t at_us)
+{
+    int reading = HOST_BUTTON_IDLE_MV;
+    for (const auto &step : trace)
+    {
+        if (step.first > at_us)
+            break;
+        reading = step.second;
+    }
+    return reading;
+}
+
+// A press of `hold_ms` at `at_ms`, with the contacts bouncing for `bounce_ms` on both edges
+static void trace_press(host_adc_trace_t *trace, int at_ms, int millivolts, int hold_ms, int bounce_ms = 0)
+{
+    int64_t at = at_ms * 1000LL;
+    for (int i = 0; i < bounce_ms; i++)
+        trace->push_back({at + i * 1000LL, i % 2 ? HOST_BUTTON_IDLE_MV : millivolts});
+    trace->push_back({at + bounce_ms * 1000LL, millivolts});
+    int64_t release = at + hold_ms * 1000LL;
+    for (int i = 0; i < bounce_ms; i++)
+        trace->push_back({release + i * 1000LL, i % 2 ? millivolts : HOST_BUTTON_IDLE_MV});
+    trace->push_back({release + bounce_ms * 1000LL, HOST_BUTTON_IDLE_MV});
+}
+
+// Run a trace through the debouncer at the sampling times the button task would pick
+static std::vector<host_button_event_t> trace_replay(const std::vector<key_config_t> &key_configs, const host_adc_trace_t &trace,
+                                                     int64_t phase_us, uint32_t *samples, uint32_t *glitches)
+{
+    ButtonDebouncer debouncer(&key_configs);
+    std::vector<host_button_event_t> events;
+    int64_t end = trace.empty() ? 0 : trace.back().first + 2000000;
+    *samples = 0;
+    for (int64_t now = phase_us; now < end;)
+    {
+        button_name_t button;
+        button_action_t action;
+        uint32_t interval = debouncer.sample(trace_reading(trace, now), now, &button, &action);
+        (*samples)++;
+        if (button != BUTTON_IDLE)
+            events.push_back({now, button, action});
+        now += interval * 1000LL;
+    }
+    *glitches = debouncer.glitches;
+    return events;
+}
+
+// What the old 10 ms polling with a 500 ms lockout made of the same trace
+static uint32_t trace_legacy_presses(const std::vector<key_config_t> &key_configs, const host_adc_trace_t &trace)
+{
+    uint32_t presses = 0;
+    int64_t last = -HOST_BUTTON_LEGACY_LOCKOUT - 1;
+    int64_t end = trace.empty() ? 0 : trace.back().first + 2000000;
+    for (int64_t now = 0; now < end; now += HOST_BUTTON_LEGACY_PERIOD * 1000)
+    {
+        int reading = trace_reading(trace, now);
+        for (const key_config_t &key_config : key_configs)
+        {
+            if (reading >= key_config.min && reading <= key_config.max && now - last > HOST_BUTTON_LEGACY_LOCKOUT)
+            {
+                last = now;
+                presses++;
+                break;
+            }
+        }
+    }
+    return presses;
+}
+
+static const char *button_event_name(const host_button_event_t &event)
+{
+    static const char *buttons[] = {"idle", "menu", "play", "up", "down"};
+    static const char *actions[] = {"press", "long", "repeat"};
+    static char name[32];
+    snprintf(name, sizeof(name), "%s %s", buttons[event.button], actions[event.action]);
+    return name;
+}
+
+// Replay a trace file, one "ms millivolts" pair per line, and print what the debouncer made of it
+static bool button_trace_file(const std::vector<key_config_t> &key_configs, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return false;
+    }
+    host_adc_trace_t trace;
+    char line[128];
+    while (fgets(line, sizeof(line), file))
+    {
+        double ms;
+        int millivolts;
+        if (line[0] != '#' && sscanf(line, "%lf %d", &ms, &millivolts) == 2)
+            trace.push_back({static_cast<int64_t>(ms * 1000), millivolts});
+    }
+    fclose(file);
+
+    uint32_t samples, glitches;
+    std::vector<host_button_event_t> events = trace_replay(key_configs, trace, 0, &samples, &glitches);
+    printf("button trace %s: %zu readings, %u samples, %u glitches ignored, %zu events\n", path, trace.size(), samples, glitches, events.size());
+    for (const host_button_event_t &event : events)
+        printf("  %10.1f ms %s\n", event.at_us / 1000.0, button_event_name(event));
+    return true;
+}
+
+// Replays generated ladder traces, bouncing contacts, glitches and fast taps among them, at
+// every sampling phase, and checks the debouncer turns each into the expected events
+static bool button_check(const std::vector<key_config_t> &key_configs)
+{
+    typedef struct
+    {
+        const char *name;
+        host_adc_trace_t trace;
+        std::vector<std::pair<button_name_t, button_action_t>> expected;
+    } scenario_t;
+
+    const int menu = 2900, play = 2350, up = 400, down = 950;
+    std::vector<scenario_t> scenarios(8);
+    scenarios[0].name = "clean press";
+    trace_press(&scenarios[0].trace, 100, menu, 200);
+    scenarios[0].expected = {{BUTTON_MENU, BUTTON_ACTION_PRESS}};
+
+    scenarios[1].name = "bouncing contacts";
+    trace_press(&scenarios[1].trace, 100, menu, 150, 8);
+    scenarios[1].expected = {{BUTTON_MENU, BUTTON_ACTION_PRESS}};
+
+    scenarios[2].name = "fast taps";
+    for (int i = 0; i < 3; i++)
+        trace_press(&scenarios[2].trace, 100 + i * 160, menu, 80, 3);
+    scenarios[2].expected = {{BUTTON_MENU, BUTTON_ACTION_PRESS}, {BUTTON_MENU, BUTTON_ACTION_PRESS}, {BUTTON_MENU, BUTTON_ACTION_PRESS}};
+
+    scenarios[3].name = "glitches";
+    for (int i = 0; i < 5; i++)
+        trace_press(&scenarios[3].trace, 100 + i * 100, play, 3);
+
+    scenarios[4].name = "ladder settling";
+    scenarios[4].trace = {{100000, menu}, {101000, play}, {102000, down}, {400000, play}, {401000, menu}, {402000, HOST_BUTTON_IDLE_MV}};
+    scenarios[4].expected = {{BUTTON_DOWN, BUTTON_ACTION_PRESS}};
+
+    scenarios[5].name = "long press";
+    trace_press(&scenarios[5].trace, 100, play, 1500, 5);
+    scenarios[5].expected = {{BUTTON_PLAY, BUTTON_ACTION_PRESS}, {BUTTON_PLAY, BUTTON_ACTION_LONG_PRESS}};
+
+    scenarios[6].name = "held for repeats";
+    trace_press(&scenarios[6].trace, 100, up, 1200, 5);
+    scenarios[6].expected = {{BUTTON_UP, BUTTON_ACTION_PRESS}};
+    for (int i = 0; i < 5; i++)
+        scenarios[6].expected.push_back({BUTTON_UP, BUTTON_ACTION_REPEAT});
+
+    scenarios[7].name = "short press, no long";
+    trace_press(&scenarios[7].trace, 100, play, 600, 5);
+    scenarios[7].expected = {{BUTTON_PLAY, BUTTON_ACTION_PRESS}};
+
+    bool ok = true;
+    printf("button: %d phases per trace, idle sampling every %d ms, active every %d ms\n", HOST_BUTTON_PHASES, BUTTON_IDLE_INTERVAL,
+           BUTTON_ACTIVE_INTERVAL);
+    HostLatency press_latency;
+    for (const scenario_t &scenario : scenarios)
+    {
+        uint32_t failed = 0, samples_total = 0, glitches_total = 0;
+        for (int phase = 0; phase < HOST_BUTTON_PHASES; phase++)
+        {
+            uint32_t samples, glitches;
+            int64_t phase_us = phase * BUTTON_IDLE_INTERVAL * 1000LL / HOST_BUTTON_PHASES;
+            std::vector<host_button_event_t> events = trace_replay(key_configs, scenario.trace, phase_us, &samples, &glitches);
+            samples_total += samples;
+            glitches_total += glitches;
+            bool match = events.size() == scenario.expected.size();
+            for (size_t i = 0; match && i < events.size(); i++)
+                match = events[i].button == scenario.expected[i].first && events[i].action == scenario.expected[i].second;
+            if (!match)
+            {
+                failed++;
+                printf("    phase %d:", phase);
+                for (const host_button_event_t &event : events)
+                    printf(" [%.0f ms %s]", event.at_us / 1000.0, button_event_name(event));
+                printf("\n");
+            }
+            if (!events.empty() && events[0].action == BUTTON_ACTION_PRESS)
+                press_latency.add((events[0].at_us - scenario.trace.front().first) / 1000.0);
+        }
+        int64_t duration = scenario.trace.back().first + 2000000;
+        printf("  %-22s %zu events expected, %u of %d phases wrong, %.0f samples/s, %u glitches ignored, old sampling: %u presses -> %s\n",
+               scenario.name, scenario.expected.size(), failed, HOST_BUTTON_PHASES,
+               samples_total * 1e6 / HOST_BUTTON_PHASES / duration, glitches_total,
+               trace_legacy_presses(key_configs, scenario.trace), failed ? "FAILED" : "ok");
+        ok &= failed == 0;
+    }
+    printf("  %-22s %8s %8s %8s %8s %8s %8s\n", "latency (ms)", "min", "avg", "p50", "p99", "max", "n");
+    press_latency.print("touch -> press");
+    return ok;
+}
+
+/* ---------------------------------------------------------------- replay */
+
+#define HOST_RECORD_SIZE (1024u * 1024 * 1024) // Room given to the recording file, it only grows as written
+#define HOST_ALLOC_WARMUP_FRAMES 30            // Frames through AppFace before its allocations are counted
+#define HOST_REPLAY_JPEG_TOLERANCE 4           // px a box may move on replayed JPEG frames, the robot detected on the raw ones
+
+typedef struct
+{
+    std::map<int64_t, std::vector<uint8_t>> results; // RSLT payloads by capture time
+    std::map<int64_t, record_orders_t> orders;
+    uint32_t frames;
+    uint32_t jpeg_frames;
+} host_recording_t;
+
+static bool load_recording(const char *label, int64_t time_offset, host_recording_t *recording)
+{
+    RecordReader reader;
+    if (!reader.open(esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label)))
+        return false;
+
+    *recording = host_recording_t{};
+    record_chunk_t chunk;
+    std::vector<uint8_t> payload;
+    while (reader.next(&chunk, &payload))
+    {
+        if (chunk.type == RECORD_CHUNK_FRAME && payload.size() >= sizeof(record_frame_t))
+        {
+            record_frame_t frame;
+            memcpy(&frame, payload.data(), sizeof(frame));
+            recording->frames++;
+            recording->jpeg_frames += frame.format == RECORD_FORMAT_JPEG;
+        }
+        else if (chunk.type == RECORD_CHUNK_RESULTS && payload.size() >= sizeof(record_results_t))
+        {
+            record_results_t results;
+            memcpy(&results, payload.data(), sizeof(results));
+            recording->results[results.capture_time - time_offset] = payload;
+        }
+        else if (chunk.type == RECORD_CHUNK_ORDERS && payload.size() >= sizeof(record_orders_t))
+        {
+            record_orders_t orders;
+            memcpy(&orders, payload.data(), sizeof(orders));
+            recording->orders[orders.capture_time - time_offset] = orders;
+        }
+    }
+    return true;
+}
+
+// Compare what AppFace produced on the replayed frames with what the recording says it
+// produced on the robot, frame by frame, matched on capture time
+static bool replay_diff(const char *output_path)
+{
+    host_recording_t recorded, replayed;
+    if (!load_recording(HOST_REPLAY_PARTITION, 0, &recorded) ||
+        !load_recording(RECORD_PARTITION, host_camera_replay_offset(), &replayed))
+    {
+        printf("replay: no recording to compare with\n");
+        return false;
+    }
+
+    uint32_t matched = 0, identical = 0, count_differs = 0;
+    int box_error_max = 0;
+    double box_error_total = 0;
+    uint32_t boxes = 0;
+    HostLatency recorded_face, replayed_face;
+    for (auto &entry : recorded.results)
+    {
+        auto it = replayed.results.find(entry.first);
+        if (it == replayed.results.end())
+            continue;
+        matched++;
+        record_results_t a, b;
+        memcpy(&a, entry.second.data(), sizeof(a));
+        memcpy(&b, it->second.data(), sizeof(b));
+        recorded_face.add(a.elapsed_us / 1000.0);
+        replayed_face.add(b.elapsed_us / 1000.0);
+        if (a.count != b.count)
+        {
+            count_differs++;
+            continue;
+        }
+
+        int frame_error = 0;
+        for (uint8_t i = 0; i < a.count && sizeof(a) + (i + 1) * sizeof(record_face_t) <= std::min(entry.second.size(), it->second.size()); i++)
+        {
+            record_face_t face_a, face_b;
+            memcpy(&face_a, entry.second.data() + sizeof(a) + i * sizeof(face_a), sizeof(face_a));
+            memcpy(&face_b, it->second.data() + sizeof(b) + i * sizeof(face_b), sizeof(face_b));
+            int error = 0;
+            for (int j = 0; j < 4; j++)
+                error = std::max(error, std::abs(face_a.box[j] - face_b.box[j]));
+            frame_error = std::max(frame_error, error);
+            box_error_total += error;
+            boxes++;
+        }
+        box_error_max = std::max(box_error_max, frame_error);
+        identical += frame_error == 0;
+    }
+
+    uint32_t orders_matched = 0;
+    float rotation_error = 0, forward_error = 0, confidence_error = 0;
+    HostLatency recorded_orders, replayed_orders;
+    for (auto &entry : recorded.orders)
+    {
+        auto it = replayed.orders.find(entry.first);
+        if (it == replayed.orders.end())
+            continue;
+        orders_matched++;
+        const record_orders_t &a = entry.second, &b = it->second;
+        rotation_error = std::max({rotation_error, std::fabs(a.horizontal_rotation - b.horizontal_rotation),
+                                   std::fabs(a.vertical_rotation - b.vertical_rotation)});
+        forward_error = std::max(forward_error, std::fabs(a.forward_displacement - b.forward_displacement));
+        confidence_error = std::max(confidence_error, std::fabs(a.confidence - b.confidence));
+        recorded_orders.add(a.latency_us / 1000.0);
+        replayed_orders.add(b.latency_us / 1000.0);
+    }
+
+    printf("replay: %u frames (%u JPEG) replayed, output in %s\n", recorded.frames, recorded.jpeg_frames, output_path);
+    printf("replay: results on %u of %u recorded frames, %u identical, %u with another face count, box error max %d px avg %.2f px\n",
+           matched, static_cast<unsigned>(recorded.results.size()), identical, count_differs, box_error_max,
+           boxes ? box_error_total / boxes : 0.0);
+    printf("replay: orders on %u of %u recorded frames, max difference %.2f deg/s, %.2f cm/s, confidence %.2f\n",
+           orders_matched, static_cast<unsigned>(recorded.orders.size()), rotation_error, forward_error, confidence_error);
+    printf("  %-22s %8s %8s %8s %8s %8s %8s\n", "replay timing (ms)", "min", "avg", "p50", "p99", "max", "n");
+    recorded_face.print("AppFace recorded");
+    replayed_face.print("AppFace replayed");
+    recorded_orders.print("capture->orders rec");
+    replayed_orders.print("capture->orders rep");
+    int tolerance = recorded.jpeg_frames ? HOST_REPLAY_JPEG_TOLERANCE : 0;
+    return matched == recorded.results.size() && count_differs == 0 && box_error_max <= tolerance;
+}
+
+/* ---------------------------------------------------------------- driver */
+
+static framesize_t parse_frame_size(const char *name)
+{
+    static const struct
+    {
+        const char *name;
+        framesize_t size;
+    } sizes[] = {{"240x240", FRAMESIZE_240X240}, {"qvga", FRAMESIZE_QVGA}, {"hvga", FRAMESIZE_HVGA}, {"vga", FRAMESIZE_VGA}, {"svga", FRAMESIZE_SVGA}};
+    for (auto &size : sizes)
+        if (strcasecmp(name, size.name) == 0)
+            return size.size;
+    fprintf(stderr, "Unknown frame size %s\n", name);
+    exit(2);
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --frames N          frames to capture (default 300)\n"
+            "  --fps N             sensor frame rate, 0 = unpaced (default 0)\n"
+            "  --frame-size NAME   240x240, qvga, hvga, vga or svga (default 240x240)\n"
+            "  --fb-count N        camera frame buffers, at most FRAME_POOL_SIZE (default FACE_CAMERA_FB_COUNT, 4 pipelined, 3 single-task)\n"
+            "  --input FILE        raw RGB565 frames instead of the generator\n"
+            "  --dropout N         generator frames without a face out of every 30 (default 0)\n"
+            "  --still N           generator frames where the scene holds still out of every 90 (default 0)\n"
+            "  --face-scale X      generated face size, smaller is further away (default 1)\n"
+            "  --msr-cost-ms X     emulated MSR01 inference time for a 240x240 input\n"
+            "  --mnp-cost-ms X     emulated MNP01 inference time per candidate\n"
+            "  --serial            detection before display (app_main PARALLEL_PREVIEW 0)\n"
+            "  --link MODE         latest or queue, for the links into AppFace and the display (default latest)\n"
+            "  --cascade MODE      pipeline or single, MSR01 and MNP01 in two tasks or one (default FACE_PIPELINE)\n"
+            "  --control-bench     compare and time the controller numeric policies, then exit\n"
+            "  --scaler-bench      time the display scaler for svga, vga, qvga and 240x240 frames, then exit\n"
+            "  --event-stress      publish button events to subscribers on other threads, check the paced run loses none and none is reordered, then exit\n"
+            "  --led-check         play every LED pattern and status and check the pin against the pattern table, then exit\n"
+            "  --button-check      replay generated ADC traces through the button debouncer and check the events, then exit\n"
+            "  --button-trace FILE replay an ADC trace, \"ms millivolts\" per line, through the button debouncer, then exit\n"
+            "  --wire-check        encode and decode edge cases of the ESP-NOW frames and check the results, then exit\n"
+            "  --link-check        take the face out of the scene, then cut the radio, and check how soon the Alvik stops\n"
+            "  --lcd-failures N    refuse every Nth LCD draw, as the panel IO does when out of memory (default 0, none)\n"
+            "  --send-period-ms N  AppTransmission period (default TRANSMISSION_PERIOD)\n"
+            "  --radio-loss N      frames to the Alvik lost on the air out of every 100 (default 0)\n"
+            "  --callback-stall MS hold the ESP-NOW send callbacks back for MS ms, 1 s into the run (default 0)\n"
+            "  --record FILE       record frames, results and orders through AppRecorder\n"
+            "  --record-quality Q  JPEG quality of recorded frames, 0 for raw (default 0)\n"
+            "  --replay FILE       take frames from a recording and compare the results with it\n"
+            "  --verbose           application logs at debug level\n",
+            argv0);
+}
+
+int main(int argc, char **argv)
+{
+    host_camera_config_t camera_config = {FRAMESIZE_240X240, "", 300, 0, 0, 0, 1.0F, false, 0};
+    int fb_count = 0; // FACE_CAMERA_FB_COUNT for the cascade chosen
+    frame_link_mode_t link_mode = FRAME_LINK_LATEST;
+    bool verbose = false;
+    bool parallel_preview = true;
+    bool face_pipeline = FACE_PIPELINE;
+    uint32_t send_period_ms = TRANSMISSION_PERIOD;
+    bool control_bench = false;
+    bool scaler_bench = false;
+    bool event_bench = false;
+    bool led_bench = false;
+    bool button_bench = false;
+    const char *button_trace_path = nullptr;
+    bool link_check = false;
+    bool wire_bench = false;
+    const char *record_path = nullptr;
+    const char *replay_path = nullptr;
+    int record_quality = 0;
+    bool frames_given = false;
+    uint32_t callback_stall_ms = 0;
+
+    static const struct option options[] = {
+        {"frames", required_argument, nullptr, 'n'},
+        {"fps", required_argument, nullptr, 'f'},
+        {"frame-size", required_argument, nullptr, 's'},
+        {"fb-count", required_argument, nullptr, 'b'},
+        {"input", required_argument, nullptr, 'i'},
+        {"dropout", required_argument, nullptr, 'd'},
+        {"still", required_argument, nullptr, 'T'},
+        {"face-scale", required_argument, nullptr, 'F'},
+        {"msr-cost-ms", required_argument, nullptr, 'm'},
+        {"mnp-cost-ms", required_argument, nullptr, 'p'},
+        {"serial", no_argument, nullptr, 'S'},
+        {"link", required_argument, nullptr, 'l'},
+        {"cascade", required_argument, nullptr, 'c'},
+        {"send-period-ms", required_argument, nullptr, 'P'},
+        {"radio-loss", required_argument, nullptr, 'W'},
+        {"callback-stall", required_argument, nullptr, 'G'},
+        {"lcd-failures", required_argument, nullptr, 'Y'},
+        {"control-bench", no_argument, nullptr, 'C'},
+        {"scaler-bench", no_argument, nullptr, 'L'},
+        {"event-stress", no_argument, nullptr, 'E'},
+        {"led-check", no_argument, nullptr, 'D'},
+        {"button-check", no_argument, nullptr, 'B'},
+        {"button-trace", required_argument, nullptr, 'A'},
+        {"link-check", no_argument, nullptr, 'K'},
+        {"wire-check", no_argument, nullptr, 'w'},
+        {"record", required_argument, nullptr, 'r'},
+        {"record-quality", required_argument, nullptr, 'q'},
+        {"replay", required_argument, nullptr, 'R'},
+        {"verbose", no_argument, nullptr, 'v'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}};
+
+    int option;
+    while ((option = getopt_long(argc, argv, "", options, nullptr)) != -1)
+    {
+        switch (option)
+        {
+        case 'n':
+            camera_config.frames = strtoul(optarg, nullptr, 10);
+            frames_given = true;
+            break;
+        case 'f':
+            camera_config.fps = strtoul(optarg, nullptr, 10);
+            break;
+        case 's':
+            camera_config.frame_size = parse_frame_size(optarg);
+            break;
+        case 'b':
+            fb_count = atoi(optarg);
+            break;
+        case 'i':
+            camera_config.input_path = optarg;
+            break;
+        case 'd':
+            camera_config.dropout = strtoul(optarg, nullptr, 10);
+            break;
+        case 'F':
+            camera_config.face_scale = static_cast<float>(atof(optarg));
+            break;
+        case 'T':
+            camera_config.still = std::min<uint32_t>(strtoul(optarg, nullptr, 10), HOST_CAMERA_STILL_PERIOD);
+            break;
+        case 'm':
+            host_detector_set_cost(HOST_STAGE_MSR01, static_cast<int64_t>(atof(optarg) * 1000));
+            break;
+        case 'p':
+            host_detector_set_cost(HOST_STAGE_MNP01, static_cast<int64_t>(atof(optarg) * 1000));
+            break;
+        case 'S':
+            parallel_preview = false;
+            break;
+        case 'l':
+            link_mode = strcasecmp(optarg, "queue") == 0 ? FRAME_LINK_QUEUE : FRAME_LINK_LATEST;
+            break;
+        case 'c':
+            face_pipeline = strcasecmp(optarg, "single") != 0;
+            break;
+        case 'P':
+            send_period_ms = strtoul(optarg, nullptr, 10);
+            break;
+        case 'W':
+            alvik_loss_percent = strtoul(optarg, nullptr, 10);
+            break;
+        case 'G':
+            callback_stall_ms = strtoul(optarg, nullptr, 10);
+            break;
+        case 'Y':
+            host_lcd_set_draw_failures(strtoul(optarg, nullptr, 10));
+            break;
+        case 'C':
+            control_bench = true;
+            break;
+        case 'L':
+            scaler_bench = true;
+            break;
+        case 'E':
+            event_bench = true;
+            break;
+        case 'D':
+            led_bench = true;
+            break;
+        case 'B':
+            button_bench = true;
+            break;
+        case 'A':
+            button_trace_path = optarg;
+            break;
+        case 'K':
+            link_check = true;
+            break;
+        case 'w':
+            wire_bench = true;
+            break;
+        case 'r':
+            record_path = optarg;
+            break;
+        case 'q':
+            record_quality = atoi(optarg);
+            break;
+        case 'R':
+            replay_path = optarg;
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            usage(argv[0]);
+            return option == 'h' ? 0 : 2;
+        }
+    }
+
+    esp_log_level_set("*", verbose ? ESP_LOG_DEBUG : ESP_LOG_ERROR);
+
+    // A replay is recorded too, that is what it is compared with
+    std::string replay_output;
+    if (replay_path)
+    {
+        if (!host_partition_attach(HOST_REPLAY_PARTITION, replay_path, 0))
+        {
+            fprintf(stderr, "Cannot open %s\n", replay_path);
+            return 2;
+        }
+        RecordReader reader;
+        std::vector<record_index_entry_t> frames;
+        std::vector<uint8_t> payload;
+        record_chunk_t chunk;
+        record_frame_t first;
+        if (!reader.open(esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, HOST_REPLAY_PARTITION)) ||
+            !reader.frames(&frames) || (reader.seek(frames[0].offset), !reader.next(&chunk, &payload)) || payload.size() < sizeof(first))
+        {
+            fprintf(stderr, "%s holds no frames\n", replay_path);
+            return 2;
+        }
+        memcpy(&first, payload.data(), sizeof(first));
+        camera_config.frame_size = FRAMESIZE_INVALID;
+        for (int size = 0; size < FRAMESIZE_INVALID; size++)
+            if (resolution[size].width == first.width && resolution[size].height == first.height)
+                camera_config.frame_size = static_cast<framesize_t>(size);
+        if (camera_config.frame_size == FRAMESIZE_INVALID)
+        {
+            fprintf(stderr, "%s has %ux%u frames, no camera frame size\n", replay_path, first.width, first.height);
+            return 2;
+        }
+        camera_config.replay = true;
+        if (!frames_given)
+            camera_config.frames = frames.size();
+        if (record_path == nullptr)
+        {
+            replay_output = std::string(replay_path) + ".out";
+            record_path = replay_output.c_str();
+        }
+    }
+    if (record_path && !host_partition_attach(RECORD_PARTITION, record_path, HOST_RECORD_SIZE))
+    {
+        fprintf(stderr, "Cannot create %s\n", record_path);
+        return 2;
+    }
+    // frame_pool_share() aborts on a frame it has no slot for
+    if (fb_count == 0)
+        fb_count = FACE_CAMERA_FB_COUNT(face_pipeline);
+    if (fb_count < 1 || fb_count > FRAME_POOL_SIZE)
+    {
+        fprintf(stderr, "--fb-count must be 1 to FRAME_POOL_SIZE (%d)\n", FRAME_POOL_SIZE);
+        return 2;
+    }
+    if (link_check)
+    {
+        // In for 2 s, away for 2 s and back, at the sensor's own pace
+        camera_config.away = HOST_LINK_CHECK_AWAY;
+        if (camera_config.fps == 0)
+            camera_config.fps = 30;
+        if (!frames_given)
+            camera_config.frames = 3 * HOST_LINK_CHECK_AWAY;
+    }
+    host_camera_configure(camera_config);
+    host_esp_now_set_tx_hook(alvik_receive);
+
+    // Same wiring as app_main(), with the LCD replaced by the display sink.
+    AppConsole *console = new AppConsole();
+    latency_start(60 * 60 * 1000); // The harness prints the summary itself at the end
+    telemetry_start(60 * 60 * 1000);
+    control_register_commands();
+    button_register_commands();
+    motion_register_commands();
+    record_register_commands();
+    led_register_commands();
+    boot_register_commands();
+    arena_register_commands();
+    alloc_register_commands();
+    transmission_register_commands();
+    console->run();
+    arena_init();
+
+    if (event_bench)
+        return event_stress() ? 0 : 1;
+    if (wire_bench)
+        return wire_check() ? 0 : 1;
+
+    if (scaler_bench)
+    {
+        scaler_benchmark();
+        return 0;
+    }
+
+    if (control_bench)
+    {
+        // Fails the run when a policy strays from the double controller by more than one wire LSB
+        esp_log_level_set("App/Control", ESP_LOG_INFO);
+        float error = control_benchmark();
+        return error <= 1.0F / WIRE_ROTATION_SCALE ? 0 : 1;
+    }
+
+    QueueHandle_t xQueueFrame_0 = frame_link_create("frame_0", parallel_preview ? FRAME_LINK_QUEUE : link_mode);
+    QueueHandle_t xQueueFrame_1 = frame_link_create("frame_1", parallel_preview ? link_mode : FRAME_LINK_QUEUE);
+    QueueHandle_t xQueueFrame_2 = frame_link_create("frame_2", link_mode);
+    // Unlike the robot's, the host recorder holds the camera up rather than drop frames, so a replay sees them all
+    QueueHandle_t xQueueFrame_3 = frame_link_create("frame_3", FRAME_LINK_QUEUE);
+    QueueHandle_t xQueueMovementOrders = xQueueCreate(1, sizeof(movement_orders_t));
+    QueueHandle_t xQueueOverlay = xQueueCreate(1, sizeof(overlay_t));
+    telemetry_watch_queue(xQueueFrame_0, "frame_0");
+    telemetry_watch_queue(xQueueFrame_1, "frame_1");
+    telemetry_watch_queue(xQueueFrame_2, "frame_2");
+    telemetry_watch_queue(xQueueFrame_3, "frame_3");
+    telemetry_watch_queue(xQueueMovementOrders, "orders");
+    telemetry_watch_queue(xQueueOverlay, "overlay");
+
+    AppButton *key = new AppButton();
+    if (led_bench)
+        return led_check(key) ? 0 : 1;
+    if (button_bench)
+        return button_check(key->key_configs) ? 0 : 1;
+    if (button_trace_path)
+        return button_trace_file(key->key_configs, button_trace_path) ? 0 : 1;
+    host_gpio_set_hook(led_traced);
+    AppLED *led = new AppLED(HOST_LED_PIN, key);
+    AppTransmission *transmission = new AppTransmission(1, xQueueMovementOrders, send_period_ms);
+    transmission->stats_period_ms = 60 * 60 * 1000; // The harness prints the statistics itself at the end
+    AppCamera *camera = nullptr;
+    AppFanout *fanout = nullptr;
+    AppRecorder *recorder = nullptr;
+    AppFace *face = nullptr;
+    AppLCD *lcd = nullptr;
+    if (!parallel_preview && record_path)
+        fprintf(stderr, "--serial has no fanout to record from, not recording\n");
+
+    // The drivers come up as app_main() brings them up, side by side; the harness starts the tasks itself
+    AppBoot *boot = new AppBoot();
+    boot->add("camera", [&]
+              { camera = new AppCamera(PIXFORMAT_RGB565, camera_config.frame_size, fb_count, xQueueFrame_0); });
+    boot->add("radio", [&]
+              { transmission->init(); });
+    boot->add("lcd", [&]
+              {
+                  if (parallel_preview)
+                      lcd = new AppLCD(key, xQueueFrame_2, nullptr, xQueueOverlay, lcd_release_pooled);
+                  else
+                      lcd = new AppLCD(key, xQueueFrame_1, nullptr, xQueueOverlay, lcd_release_direct);
+              });
+    boot->add("face", [&]
+              {
+                  if (parallel_preview)
+                  {
+                      std::vector<QueueHandle_t> outputs = {xQueueFrame_1, xQueueFrame_2};
+                      if (record_path)
+                      {
+                          outputs.push_back(xQueueFrame_3);
+                          recorder = new AppRecorder(xQueueFrame_3, RECORD_PARTITION, frame_pool_release);
+                      }
+                      fanout = new AppFanout(xQueueFrame_0, outputs);
+                      face = new AppFace(key, xQueueFrame_1, nullptr, xQueueMovementOrders, xQueueOverlay, frame_pool_release);
+                  }
+                  else
+                  {
+                      face = new AppFace(key, xQueueFrame_0, xQueueFrame_1, xQueueMovementOrders, xQueueOverlay);
+                  }
+              });
+    esp_log_level_set("App/Boot", ESP_LOG_WARN); // Printed below with the other results
+    boot->run();
+    face->pipeline = face_pipeline;
+
+    led->run();
+    transmission->run();
+    lcd->run();
+    face->run();
+    if (recorder)
+    {
+        recorder->jpeg_quality = record_quality;
+        recorder->run();
+        record_start();
+    }
+    if (fanout)
+        fanout->run();
+
+    // ESP-NOW is up since the boot, pair like camera_comms.connect_to_camera().
+    host_esp_now_inject(alvik_mac, reinterpret_cast<const uint8_t *>(alvik_hello), sizeof(alvik_hello), -40);
+
+    key->run();
+    key->press(BUTTON_MENU, MENU_FACE_RECOGNITION);
+    vTaskDelay(pdMS_TO_TICKS(50)); // Published by the button task before the first frame
+
+    host_lcd_stats_t boot_panel;
+    host_lcd_get_stats(&boot_panel);
+    int64_t start = esp_timer_get_time();
+    panel_start_us = start;
+    host_lcd_set_frame_hook(panel_frame_done);
+    host_lcd_set_marker_color(OVERLAY_COLOR_GREEN); // Detected boxes, the generated scene has no such green
+    // The shims record these from the face tasks, room for every frame keeps them out of the allocation counts
+    for (int stage = 0; stage < HOST_STAGE_MAX; stage++)
+    {
+        stage_latency[stage].reserve(camera_config.frames);
+        stage_pixels[stage].reserve(camera_config.frames);
+    }
+    capture_to_display.reserve(camera_config.frames);
+    capture_to_release.reserve(camera_config.frames);
+    camera->run();
+    std::thread callback_stall;
+    if (callback_stall_ms)
+        callback_stall = std::thread([callback_stall_ms]
+                                     {
+                                         std::this_thread::sleep_for(std::chrono::microseconds(HOST_CALLBACK_STALL_START_US));
+                                         host_esp_now_hold_send_callbacks(true);
+                                         std::this_thread::sleep_for(std::chrono::milliseconds(callback_stall_ms));
+                                         host_esp_now_hold_send_callbacks(false);
+                                     });
+
+    // Lists, vectors and buffers are set up by the first frames; after that AppFace should not allocate
+    bool alloc_counting = false;
+    uint32_t alloc_frames = 0;
+    host_link_check_t check = {};
+    while (!host_camera_exhausted() || host_camera_frames_in_use() != 0)
+    {
+        if (link_check)
+            link_check_step(&check, transmission);
+        latency_histogram_t face_frames;
+        latency_get(LATENCY_STAGE_FACE, &face_frames);
+        if (!alloc_counting && face_frames.count >= HOST_ALLOC_WARMUP_FRAMES)
+        {
+            alloc_reset();
+            alloc_counting = true;
+            alloc_frames = face_frames.count;
+        }
+        vTaskDelay(1);
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+
+    // Once the camera stops, the sender repeats the last orders and then has to settle on no target.
+    int64_t settled = esp_timer_get_time() + (TRANSMISSION_ORDERS_TIMEOUT + 3 * send_period_ms) * 1000;
+    while (esp_timer_get_time() < settled)
+    {
+        if (link_check)
+            link_check_step(&check, transmission);
+        vTaskDelay(1);
+    }
+
+    uint32_t captured = host_camera_frames_captured();
+    printf("frames: %u captured, %u displayed in %.2f s -> %.1f frames/s\n",
+           captured, frames_displayed, elapsed / 1e6, frames_displayed / (elapsed / 1e6));
+    latency_histogram_t face_stage;
+    latency_get(LATENCY_STAGE_FACE, &face_stage);
+    printf("detection: %u frames through the %s cascade -> %.1f frames/s\n", face_stage.count,
+           face->pipeline ? "pipelined" : "single-task", face_stage.count / (elapsed / 1e6));
+    printf("  %-22s %8s %8s %8s %8s %8s %8s\n", "latency (ms)", "min", "avg", "p50", "p99", "max", "n");
+    stage_latency[HOST_STAGE_MSR01].print("MSR01 infer");
+    stage_latency[HOST_STAGE_MNP01].print("MNP01 infer");
+    capture_to_display.print("capture -> LCD copy");
+    capture_to_release.print("capture -> fb return");
+    panel_interval.print("panel frame interval");
+    stage_pixels[HOST_STAGE_MSR01].print("MSR01 input (kpx)");
+    // Application-side instrumentation, as printed by the `latency` console command on the device.
+    esp_log_level_set("App/Latency", ESP_LOG_INFO);
+    host_console_run("latency");
+
+    for (QueueHandle_t link : {xQueueFrame_0, xQueueFrame_1, xQueueFrame_2, xQueueFrame_3})
+    {
+        frame_link_stats_t stats;
+        if (frame_link_get_stats(link, &stats) && stats.sent)
+            printf("link %s: %u sent, %u consumed, %u dropped\n", pcQueueGetName(link), stats.sent, stats.consumed, stats.dropped);
+    }
+    host_lcd_stats_t panel;
+    host_lcd_get_stats(&panel);
+    printf("panel: %u frames in %u transfers, SPI busy %.0f%%, %u torn transfers, %u frames with a detection box, %u draws refused\n",
+           panel.frames - boot_panel.frames, panel.transfers - boot_panel.transfers,
+           100.0 * (panel.busy_us - boot_panel.busy_us) / elapsed, panel.torn, panel.marked - boot_panel.marked, panel.failed);
+    printf("esp-now: %u handshakes, %u movement orders (%u predicted, %u heartbeats, %u no target), %u malformed, %u sequence gaps, %.1f kB on air, largest frame %u B\n",
+           alvik_handshakes.load(), alvik_orders.load(), alvik_predicted.load(), alvik_heartbeats.load(), alvik_no_target.load(),
+           alvik_malformed.load(), alvik_sequence_gaps.load(), alvik_bytes / 1024.0, alvik_max_frame.load());
+    if (callback_stall.joinable())
+        callback_stall.join();
+    transmission_stats_t radio;
+    transmission_get_stats(&radio);
+    uint32_t acknowledged = radio.delivered + radio.failed;
+    printf("radio: %u of %u frames delivered (%.1f%%), %u retries, %u send errors, %u held, longest gap %.0f ms, RTT avg %.2f ms over %u echoes, RSSI %d dBm\n",
+           radio.delivered, acknowledged, acknowledged ? 100.0 * radio.delivered / acknowledged : 0.0, radio.retries, radio.send_errors, radio.held,
+           radio.longest_gap_us / 1000.0, radio.echoes ? radio.rtt_total_us / 1000.0 / radio.echoes : 0.0, radio.echoes, radio.rssi);
+    // Every echo is sent back after the same delay, the round trip the link reports must not come in below it
+    int64_t rtt_avg_us = radio.echoes ? radio.rtt_total_us / radio.echoes : 0;
+    bool rtt_ok = radio.echoes == 0 || (rtt_avg_us >= HOST_ALVIK_ECHO_DELAY_US && rtt_avg_us <= HOST_ALVIK_ECHO_DELAY_US + HOST_ALVIK_RTT_TOLERANCE_US);
+    printf("  %-52s %s\n", "RTT vs the simulated Alvik's echo delay", rtt_ok ? "ok" : "FAILED");
+    // Every callback is credited to a frame in flight, none is left over from one given up on
+    bool callbacks_ok = acknowledged == radio.sent;
+    if (callback_stall_ms)
+        printf("  %-52s %s\n", "send callbacks matched with the frames sent", callbacks_ok ? "ok" : "FAILED");
+    motion_stats_t motion;
+    motion_get_stats(&motion);
+    double inference_avg_us = motion.inferences ? static_cast<double>(motion.inference_us) / motion.inferences : 0;
+    printf("motion: %u of %u frames skipped (%.0f%%), signature %.0f us/frame, inference %.0f us/run, %.2f s of CPU saved\n",
+           motion.skipped, motion.frames, motion.frames ? 100.0 * motion.skipped / motion.frames : 0.0,
+           motion.frames ? static_cast<double>(motion.signature_us) / motion.frames : 0.0, inference_avg_us,
+           (motion.skipped * inference_avg_us - motion.signature_us) / 1e6);
+    led_stats_t led_stats;
+    led_get_stats(&led_stats);
+    printf("led: shows %s, %u edges in %u timer wakeups\n", led_stats.shown[LED_LAYER_STATUS] == LED_TRACKING ? "tracking" : "no track",
+           led_stats.edges, led_stats.wakeups);
+    printf("alvik: last orders %.2f deg/s, %.2f deg/s, %.2f cm/s, confidence %.2f\n", alvik_last_orders.horizontalRotationAmount,
+           alvik_last_orders.verticalRotationAmount, alvik_last_orders.forwardDisplacementAmount, alvik_last_orders.confidence);
+    bool link_ok = !link_check || link_check_report(check, send_period_ms);
+
+    latency_histogram_t face_frames;
+    latency_get(LATENCY_STAGE_FACE, &face_frames);
+    alloc_stats_t allocs;
+    alloc_get_stats(&allocs);
+    alloc_frames = alloc_counting ? face_frames.count - alloc_frames : 0;
+    printf("alloc: %u heap allocations over %u frames in the %u face tasks, %u (%.1f kB) inside ESP-WHO calls\n",
+           allocs.allocations[ALLOC_SCOPE_APP], alloc_frames, allocs.tasks, allocs.allocations[ALLOC_SCOPE_LIBRARY],
+           allocs.bytes[ALLOC_SCOPE_LIBRARY] / 1024.0);
+
+    esp_log_level_set("App/Boot", ESP_LOG_INFO);
+    host_console_run("boot");
+    esp_log_level_set("App/Arena", ESP_LOG_INFO);
+    host_console_run("arena");
+    // Loads and stack marks are those of the host threads, the heaps are only reported on the robot
+    printf("telemetry: host threads, stack free is of %d times the device stack, host only\n", HOST_STACK_PAINT_SCALE);
+    fflush(stdout);
+    esp_log_level_set("App/Telemetry", ESP_LOG_INFO);
+    host_console_run("telemetry");
+
+    bool replay_matches = true;
+    if (recorder)
+    {
+        record_stop();
+        record_stats_t record;
+        do
+        {
+            vTaskDelay(pdMS_TO_TICKS(10));
+            record_get_stats(&record);
+        } while (record.recording);
+        printf("record: %u frames (%u dropped), %u results, %u orders, %u lost, %.1f MB, encode %.2f ms/frame, write %.2f ms/frame\n",
+               record.frames, record.dropped, record.results, record.orders, record.items_lost, record.bytes / 1048576.0,
+               record.frames ? record.encode_us / 1000.0 / record.frames : 0.0, record.frames ? record.write_us / 1000.0 / record.frames : 0.0);
+        if (replay_path)
+            replay_matches = replay_diff(record_path);
+    }
+
+    ESP_LOGI(TAG, "Done");
+    return replay_matches && link_ok && rtt_ok && callbacks_ok && allocs.allocations[ALLOC_SCOPE_APP] == 0 ? 0 : 1;
+}
@@ -1,59 +1,146 @@
 #define AUTO_ENABLE_FACE_RECOGNITION 0
+#define PARALLEL_PREVIEW 1 // Show frames while they are being detected instead of after, AppLCD draws the latest boxes over them
+#define CAMERA_FRAME_SIZE FRAMESIZE_240X240 // FRAMESIZE_VGA or FRAMESIZE_SVGA keep far away faces trackable, AppFace searches them downscaled or through a native-resolution ROI
 
 #include "driver/gpio.h"
 #include "esp_log.h"
 
+#include "app_alloc.hpp"
+#include "app_arena.hpp"
+#include "app_boot.hpp"
 #include "app_button.hpp"
 #include "app_camera.hpp"
+#include "app_console.hpp"
+#include "app_control.hpp"
+#include "app_fanout.hpp"
+#include "app_frame_link.hpp"
+#include "app_frame_pool.hpp"
+#include "app_latency.hpp"
 #include "app_lcd.hpp"
 #include "app_led.hpp"
+#include "app_motion.hpp"
 #include "app_face.hpp"
+#include "app_recorder.hpp"
+#include "app_telemetry.hpp"
 #include "app_transmission.hpp"
 
+// frame_pool_share() aborts on a frame it has no slot for
+static_assert(FACE_CAMERA_FB_COUNT(FACE_PIPELINE) <= FRAME_POOL_SIZE, "FRAME_POOL_SIZE must cover every camera buffer");
+
 extern "C" void app_main()
 {
     esp_log_level_set("camera", ESP_LOG_DEBUG);
 
-    QueueHandle_t xQueueFrame_0 = xQueueCreate(2, sizeof(camera_fb_t *)); // Union from appCamera to appFace
-    QueueHandle_t xQueueFrame_1 = xQueueCreate(2, sizeof(camera_fb_t *)); // Union from appFace to appLcd
+    // FRAME_LINK_LATEST links always hand the consumer the newest frame and drop the ones it had no time for
+#if PARALLEL_PREVIEW
+    QueueHandle_t xQueueFrame_0 = frame_link_create("frame_0", FRAME_LINK_QUEUE);  // Union from appCamera to appFanout
+    QueueHandle_t xQueueFrame_1 = frame_link_create("frame_1", FRAME_LINK_LATEST); // Union from appFanout to appFace
+    QueueHandle_t xQueueFrame_2 = frame_link_create("frame_2", FRAME_LINK_LATEST); // Union from appFanout to appLcd
+    QueueHandle_t xQueueFrame_3 = frame_link_create("frame_3", FRAME_LINK_LATEST); // Union from appFanout to appRecorder
+#else
+    QueueHandle_t xQueueFrame_0 = frame_link_create("frame_0", FRAME_LINK_LATEST); // Union from appCamera to appFace
+    QueueHandle_t xQueueFrame_1 = frame_link_create("frame_1", FRAME_LINK_QUEUE);  // Union from appFace to appLcd
+#endif
+
+    QueueHandle_t xQueueMovementOrders = xQueueCreate(1, sizeof(movement_orders_t)); // Latest orders slot from appFace to appTransmission
+    QueueHandle_t xQueueOverlay = xQueueCreate(1, sizeof(overlay_t));                // Latest detection results from appFace to appLcd
+
+#if PARALLEL_PREVIEW
+    telemetry_watch_queue(xQueueFrame_0, "frame_0");
+    telemetry_watch_queue(xQueueFrame_1, "frame_1");
+    telemetry_watch_queue(xQueueFrame_2, "frame_2");
+    telemetry_watch_queue(xQueueFrame_3, "frame_3");
+#else
+    telemetry_watch_queue(xQueueFrame_0, "frame_0");
+    telemetry_watch_queue(xQueueFrame_1, "frame_1");
+#endif
+    telemetry_watch_queue(xQueueMovementOrders, "orders");
+    telemetry_watch_queue(xQueueOverlay, "overlay");
 
-    QueueHandle_t xQueueMovementOrders = xQueueCreate(2, sizeof(movement_orders_t));
+    AppConsole *console = new AppConsole();
+    latency_start();
+    telemetry_start();
+    control_register_commands();
+    button_register_commands();
+    motion_register_commands();
+    record_register_commands();
+    led_register_commands();
+    boot_register_commands();
+    arena_register_commands();
+    alloc_register_commands();
+    transmission_register_commands();
+
+    // Every fixed-size buffer comes out of the arena, reserved before the heap is carved up
+    arena_init();
 
-    vTaskDelay(100 / portTICK_PERIOD_MS);
     AppButton *key = new AppButton();
-    vTaskDelay(100 / portTICK_PERIOD_MS);
     AppLED *led = new AppLED(GPIO_NUM_3, key);
-    vTaskDelay(100 / portTICK_PERIOD_MS);
-    //AppCamera *camera = new AppCamera(PIXFORMAT_RGB565, FRAMESIZE_SVGA, 2, xQueueFrame_0);
-    AppCamera *camera = new AppCamera(PIXFORMAT_RGB565, FRAMESIZE_240X240, 2, xQueueFrame_0);
-    vTaskDelay(100 / portTICK_PERIOD_MS);
-    AppFace *face = new AppFace(key, xQueueFrame_0, xQueueFrame_1, xQueueMovementOrders);
-    vTaskDelay(100 / portTICK_PERIOD_MS);
     AppTransmission *transmission = new AppTransmission(1, xQueueMovementOrders);
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
-    AppLCD *lcd = new AppLCD(key, xQueueFrame_1);
-    vTaskDelay(100 / portTICK_PERIOD_MS);
-    key->attach(face);
-    key->attach(led);
-    key->attach(lcd);
-
-    transmission->run();
-    vTaskDelay(100 / portTICK_PERIOD_MS);
-    lcd->run();
-    vTaskDelay(100 / portTICK_PERIOD_MS);
-    face->run();
-    vTaskDelay(100 / portTICK_PERIOD_MS);
-    camera->run();
-    vTaskDelay(100 / portTICK_PERIOD_MS);
-    key->run();
-    vTaskDelay(100 / portTICK_PERIOD_MS);
+    AppCamera *camera = nullptr;
+    AppLCD *lcd = nullptr;
+    AppFace *face = nullptr;
+#if PARALLEL_PREVIEW
+    AppFanout *fanout = nullptr;
+    AppRecorder *recorder = nullptr;
+#endif
+
+    // The drivers come up side by side; each start waits for what it needs, not for a fixed delay
+    AppBoot *boot = new AppBoot();
+    int camera_phase = boot->add("camera", [&]
+                                 {
+                                     // Enough buffers for the camera to keep capturing while the cascade holds its frames and another waits in a mailbox
+                                     // Other sizes are letterboxed on the panel by AppLCD's scaler; the frame buffers are in PSRAM
+                                     camera = new AppCamera(PIXFORMAT_RGB565, CAMERA_FRAME_SIZE, FACE_CAMERA_FB_COUNT(FACE_PIPELINE), xQueueFrame_0);
+                                 });
+    // Bringing Wi-Fi up and building the models take more stack than the other phases
+    int radio_phase = boot->add("radio", [&]
+                                { transmission->init(); }, {}, 2 * BOOT_STACK_SIZE);
+    int lcd_phase = boot->add("lcd", [&]
+                              {
+#if PARALLEL_PREVIEW
+                                  lcd = new AppLCD(key, xQueueFrame_2, nullptr, xQueueOverlay, frame_pool_release);
+#else
+                                  lcd = new AppLCD(key, xQueueFrame_1, nullptr, xQueueOverlay);
+#endif
+                              });
+    int face_phase = boot->add("face", [&]
+                               {
+#if PARALLEL_PREVIEW
+                                   // The recorder only holds on to frames while a recording is in progress, see the `record` command
+                                   fanout = new AppFanout(xQueueFrame_0, {xQueueFrame_1, xQueueFrame_2, xQueueFrame_3});
+                                   recorder = new AppRecorder(xQueueFrame_3, RECORD_PARTITION, frame_pool_release);
+                                   face = new AppFace(key, xQueueFrame_1, nullptr, xQueueMovementOrders, xQueueOverlay, frame_pool_release);
+#else
+                                   face = new AppFace(key, xQueueFrame_0, xQueueFrame_1, xQueueMovementOrders, xQueueOverlay);
+#endif
+                               }, {}, 2 * BOOT_STACK_SIZE);
+    // Tracking does not wait for the radio, orders wait in their slot until it is up
+    boot->add("transmission", [&]
+              { transmission->run(); }, {radio_phase});
+    boot->add("pipeline", [&]
+              {
+                  // Consumers first, the camera last
+                  lcd->run();
+                  face->run();
+#if PARALLEL_PREVIEW
+                  recorder->run();
+                  fanout->run();
+#endif
+                  camera->run();
+              }, {camera_phase, lcd_phase, face_phase});
+    // Every subscriber is in place, the button task may start publishing
+    boot->add("buttons", [&]
+              {
+                  led->run();
+                  key->run();
+              }, {lcd_phase, face_phase});
+    boot->run();
+    arena_log_report();
+
+    console->run();
 
     #if AUTO_ENABLE_FACE_RECOGNITION
-        vTaskDelay(2000 / portTICK_PERIOD_MS);
-        key->pressed = BUTTON_MENU;
-        key->menu = MENU_FACE_RECOGNITION;
-        key->notify();
-        key->pressed = BUTTON_IDLE;
+        key->press(BUTTON_MENU, MENU_FACE_RECOGNITION);
     #endif
     vTaskDelete(nullptr);
 }
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <atomic>
 #include <list>
+#include <stdlib.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
@@ -8,6 +10,7 @@
 #include "freertos/semphr.h"
 
 #include "esp_camera.h"
+#include "esp_log.h"
 
 typedef enum
 {
@@ -20,42 +23,173 @@ typedef enum
 
 typedef struct movement_orders_struct_t // For the program to work, all members must be default initialized to NO_MOVEMENT.
 {
-    double horizontalRotationAmount = 0; // in deg/s
-    double verticalRotationAmount = 0;   // in deg/s
-    double forwardDisplacementAmount = 0; // in cm/s
+    float horizontalRotationAmount = 0;  // in deg/s
+    float verticalRotationAmount = 0;    // in deg/s
+    float forwardDisplacementAmount = 0; // in cm/s
+    float confidence = 0;                // 1 on a detected box, decays towards 0 while the box is only predicted
+    bool target = false;                 // a face is followed; false on the explicit no-target orders sent when the track ends
+
+    int64_t captureTime = 0;  // esp_timer time at which the frame these orders come from was captured, in us
+    int64_t producedTime = 0; // esp_timer time at which AppFace handed the orders over, in us
 } movement_orders_t;
 
-class Observer
+#define EVENT_QUEUE_LENGTH 8    // Events a subscriber can fall behind by, a power of two
+#define EVENT_MAX_SUBSCRIBERS 4 // Subscribing one more aborts at boot
+
+typedef struct
 {
-public:
-    virtual void update() = 0;
-};
+    uint32_t sequence; // numbered by the bus from 1, a subscriber that skips one missed it
+    uint8_t button;    // button_name_t that was pressed
+    uint8_t menu;      // command_word_t in force after the press
+    uint8_t action;    // button_action_t, 0 for the press itself
+} event_t;
 
-class Subject
+/**
+ * @brief One subscriber's events, in publishing order. A single-producer single-consumer
+ *        ring: the bus pushes from the publishing task, the subscriber polls from its own,
+ *        and neither ever waits for the other. Only an event that finds the ring full, the
+ *        subscriber EVENT_QUEUE_LENGTH events behind, goes to an overflow slot where it replaces
+ *        the previous one. Events go back to the ring as soon as it has room, so the subscriber
+ *        always ends on the latest state and only events that met a full ring can be missed.
+ *        A subscriber that has nothing else to do blocks in wait() instead of polling.
+ */
+class Subscription
 {
 private:
-    std::list<Observer *> observers;
+    event_t ring[EVENT_QUEUE_LENGTH];
+    std::atomic<uint32_t> head; // events pushed, written by the publisher
+    std::atomic<uint32_t> tail; // events polled, written by the subscriber
+    std::atomic<bool> overflowed;
+    std::atomic<uint64_t> latest; // sequence, action, button and menu of the newest event that found the ring full
+    std::atomic<TaskHandle_t> waiter; // task blocked in wait(), notified on every push once it has waited
+    uint32_t last_sequence;
 
 public:
-    void attach(Observer *observer)
+    uint32_t missed;    // events skipped because the ring was full, subscriber side
+    uint32_t overflows; // events that found the ring full, publisher side; missed can only be fewer
+
+    Subscription() : ring{}, head(0), tail(0), overflowed(false), latest(0), waiter(nullptr), last_sequence(0), missed(0), overflows(0) {}
+
+    /**
+     * @brief Publisher side, never waits.
+     *
+     * @return false if the event only went to the overflow slot
+     */
+    bool push(const event_t &event)
+    {
+        // An event in the overflow slot is older than this one, the subscriber drops it once it has read this
+        uint32_t position = this->head.load(std::memory_order_relaxed);
+        if (position - this->tail.load(std::memory_order_acquire) < EVENT_QUEUE_LENGTH)
+        {
+            this->ring[position % EVENT_QUEUE_LENGTH] = event;
+            this->head.store(position + 1, std::memory_order_release);
+            this->wake();
+            return true;
+        }
+        this->latest.store((uint64_t)event.sequence << 24 | event.action << 16 | event.button << 8 | event.menu, std::memory_order_relaxed);
+        this->overflowed.store(true, std::memory_order_release);
+        this->overflows++;
+        this->wake();
+        return false;
+    }
+
+    /**
+     * @brief Subscriber side, never waits. Events come out with increasing sequence numbers.
+     *
+     * @return false if there is no new event
+     */
+    bool poll(event_t *event)
+    {
+        while (true)
+        {
+            uint32_t position = this->tail.load(std::memory_order_relaxed);
+            if (position != this->head.load(std::memory_order_acquire))
+            {
+                *event = this->ring[position % EVENT_QUEUE_LENGTH];
+                this->tail.store(position + 1, std::memory_order_release);
+            }
+            else if (this->overflowed.exchange(false, std::memory_order_acquire))
+            {
+                uint64_t packed = this->latest.load(std::memory_order_relaxed);
+                *event = {(uint32_t)(packed >> 24), (uint8_t)(packed >> 8), (uint8_t)packed, (uint8_t)(packed >> 16)};
+            }
+            else
+            {
+                return false;
+            }
+
+            // The overflow slot can hand out an event the ring already delivered
+            if (event->sequence <= this->last_sequence)
+                continue;
+            this->missed += event->sequence - this->last_sequence - 1;
+            this->last_sequence = event->sequence;
+            return true;
+        }
+    }
+
+    /**
+     * @brief Subscriber side, blocks until there is a new event. Must always be called from
+     *        the same task, the one that polls.
+     */
+    void wait(event_t *event)
     {
-        this->observers.push_back(observer);
+        // Registered before looking, so an event pushed in between leaves a notification behind
+        this->waiter.store(xTaskGetCurrentTaskHandle(), std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!this->poll(event))
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
     }
 
-    void detach(Observer *observer)
+private:
+    void wake()
     {
-        this->observers.remove(observer);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        TaskHandle_t task = this->waiter.load(std::memory_order_relaxed);
+        if (task != nullptr)
+            xTaskNotifyGive(task);
     }
+};
+
+/**
+ * @brief Fans events out to the subscriptions. Publishing only copies the event into each
+ *        subscription, whatever the subscribers are doing. There must be a single publishing
+ *        task, and every subscription must be added before it starts, from any task.
+ */
+class EventBus
+{
+private:
+    Subscription *subscribers[EVENT_MAX_SUBSCRIBERS];
+    uint8_t subscribers_count;
+    uint32_t sequence;
+    portMUX_TYPE subscribe_lock; // subscribers construct in parallel at boot
+
+public:
+    EventBus() : subscribers{}, subscribers_count(0), sequence(0), subscribe_lock(portMUX_INITIALIZER_UNLOCKED) {}
 
-    void detach_all()
+    void subscribe(Subscription *subscription)
     {
-        this->observers.clear();
+        portENTER_CRITICAL(&this->subscribe_lock);
+        bool room = this->subscribers_count < EVENT_MAX_SUBSCRIBERS;
+        if (room)
+            this->subscribers[this->subscribers_count++] = subscription;
+        portEXIT_CRITICAL(&this->subscribe_lock);
+        if (!room)
+        {
+            ESP_LOGE("App/Events", "No room for another subscriber, %d at most", EVENT_MAX_SUBSCRIBERS);
+            abort();
+        }
     }
 
-    void notify()
+    /**
+     * @return false if a subscriber had fallen behind and will miss events
+     */
+    bool publish(uint8_t button, uint8_t menu, uint8_t action = 0)
     {
-        for (auto observer : this->observers)
-            observer->update();
+        event_t event = {++this->sequence, button, menu, action};
+        bool delivered = true;
+        for (uint8_t i = 0; i < this->subscribers_count; i++)
+            delivered &= this->subscribers[i]->push(event);
+        return delivered;
     }
 };
 
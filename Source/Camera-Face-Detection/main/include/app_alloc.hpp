@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+#define ALLOC_MAX_TASKS 4 // Tasks whose allocations can be counted at once
+
+typedef enum
+{
+    ALLOC_SCOPE_APP = 0, // the application's own code
+    ALLOC_SCOPE_LIBRARY, // inside ESP-WHO calls, which allocate tensors and take shapes by value
+    ALLOC_SCOPE_MAX,
+} alloc_scope_t;
+
+typedef struct
+{
+    uint32_t allocations[ALLOC_SCOPE_MAX]; // heap allocations made by the watched tasks
+    uint32_t bytes[ALLOC_SCOPE_MAX];
+    uint32_t tasks;                        // watched
+} alloc_stats_t;
+
+/**
+ * @brief Count the calling task's heap allocations from now on, in ALLOC_SCOPE_APP. The
+ *        counts come from the heap hooks (CONFIG_HEAP_USE_HOOKS), which see every
+ *        allocation, from malloc, new or heap_caps_malloc alike.
+ */
+void alloc_watch();
+
+/**
+ * @brief Count the calling task's next allocations in `scope`.
+ *
+ * @return the scope they were counted in, to go back to
+ */
+alloc_scope_t alloc_enter(alloc_scope_t scope);
+
+void alloc_get_stats(alloc_stats_t *stats);
+
+/**
+ * @brief Zero the counts, typically once the pipeline has warmed up.
+ */
+void alloc_reset();
+
+/**
+ * @brief Register the `alloc` console command.
+ */
+void alloc_register_commands();
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#define ARENA_DMA_SIZE (40 * 1024)     // Internal DMA-capable SRAM: the LCD band buffers
+#define ARENA_SPIRAM_SIZE (344 * 1024) // PSRAM: AppFace's detection images, one per pipeline slot, and AppLCD's frame copy
+#define ARENA_ALIGN 64                 // Every buffer starts on a data cache line, as PSRAM DMA wants
+#define ARENA_MAX_BUFFERS 16           // Buffers listed in the report
+
+typedef enum
+{
+    ARENA_DMA = 0, // SPI DMA reads it without a bounce through internal memory
+    ARENA_SPIRAM,  // large buffers only the CPU touches
+    ARENA_MAX,
+} arena_region_t;
+
+typedef struct
+{
+    const char *owner;
+    arena_region_t region;
+    size_t size;
+    void *buffer;
+} arena_buffer_t;
+
+typedef struct
+{
+    size_t capacity[ARENA_MAX]; // bytes reserved by arena_init(), 0 if the reservation failed
+    size_t used[ARENA_MAX];
+    bool dma_in_spiram;         // internal DMA memory was short, the DMA region lives in PSRAM
+    uint32_t buffers;
+    uint32_t failed;            // arena_alloc() calls that did not fit
+} arena_stats_t;
+
+/**
+ * @brief Reserve the regions, once, before any stage is constructed. Every fixed-size
+ *        buffer the pipeline needs is then carved out of them, so nothing is allocated
+ *        or freed while frames flow and the heap cannot fragment.
+ */
+void arena_init();
+
+/**
+ * @brief Hand out a buffer for the life of the application, there is no free. Safe to
+ *        call from several tasks at once.
+ *
+ * @param owner shown in the report
+ * @return ARENA_ALIGN aligned memory, nullptr if the region is full
+ */
+void *arena_alloc(arena_region_t region, size_t size, const char *owner);
+
+void arena_get_stats(arena_stats_t *stats);
+
+/**
+ * @brief Log each region's use and every buffer handed out.
+ */
+void arena_log_report();
+
+/**
+ * @brief Register the `arena` console command.
+ */
+void arena_register_commands();
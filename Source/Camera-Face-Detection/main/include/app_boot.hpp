@@ -0,0 +1,66 @@
+#pragma once
+
+#include <functional>
+#include <initializer_list>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+
+#define BOOT_MAX_PHASES 16          // One event group bit per phase
+#define BOOT_STACK_SIZE (4 * 1024)  // Default stack of a phase task, freed when the phase is done
+#define BOOT_TASK_PRIORITY 5
+#define BOOT_CORE 0                 // Drivers install their interrupts on the core they are initialised from, as app_main did
+
+typedef struct
+{
+    const char *name;
+    std::function<void()> init;
+    EventBits_t bit;     // set in the event group once the phase is done
+    EventBits_t depends; // bits of the phases that have to be done before this one starts
+    uint32_t stack_size;
+    EventGroupHandle_t group;
+    int64_t start_us;    // esp_timer time the phase started and finished, 0 before
+    int64_t end_us;
+} boot_phase_t;
+
+/**
+ * @brief Brings the application up as a graph of phases. Each phase runs in a task of its own
+ *        as soon as the phases it depends on are done, so the sensor, the radio and the panel
+ *        come up side by side instead of one after the other with fixed delays in between.
+ */
+class AppBoot
+{
+public:
+    std::vector<boot_phase_t> phases;
+    EventGroupHandle_t group;
+    int64_t start_us; // esp_timer time run() was called and returned
+    int64_t end_us;
+
+    AppBoot();
+
+    /**
+     * @brief Add a phase. It can only depend on phases added before it, so the graph has no cycles.
+     *
+     * @param depends ids returned by earlier add() calls
+     * @return the id of the phase
+     */
+    int add(const char *name, std::function<void()> init, std::initializer_list<int> depends = {}, uint32_t stack_size = BOOT_STACK_SIZE);
+
+    /**
+     * @brief Start every phase, wait until all of them are done and log how long each took.
+     */
+    void run();
+};
+
+/**
+ * @brief Log each phase of the last boot: when it started, how long it took, and what it
+ *        waited for, with the time from reset to the end of the boot.
+ */
+void boot_log_summary();
+
+/**
+ * @brief Register the `boot` console command.
+ */
+void boot_register_commands();
@@ -4,6 +4,10 @@
 
 #include "__base__.hpp"
 
+#define BUTTON_IDLE_INTERVAL 30    // ms between two samples while no button is down
+#define BUTTON_ACTIVE_INTERVAL 5   // ms between two samples from the first one that reads a button until it is released
+#define BUTTON_DEBOUNCE_SAMPLES 3  // samples in a row a button has to read, or not read, to count as pressed or released
+
 typedef enum
 {
     BUTTON_IDLE = 0,
@@ -13,23 +17,101 @@ typedef enum
     BUTTON_DOWN
 } button_name_t;
 
+typedef enum
+{
+    BUTTON_ACTION_PRESS = 0,  // the button went down
+    BUTTON_ACTION_LONG_PRESS, // held for long_press ms, for buttons that do not repeat
+    BUTTON_ACTION_REPEAT,     // held for long_press ms, then every repeat ms
+} button_action_t;
+
 typedef struct
 {
-    button_name_t key; /**< button index on the channel */
-    int min;           /**< min voltage in mv corresponding to the button */
-    int max;           /**< max voltage in mv corresponding to the button */
+    button_name_t key;   /**< button index on the channel */
+    int min;             /**< min voltage in mv corresponding to the button */
+    int max;             /**< max voltage in mv corresponding to the button */
+    uint16_t long_press; /**< ms the button is held before a long press or the first repeat, 0 for neither */
+    uint16_t repeat;     /**< ms between two repeats, 0 for a single long press */
 } key_config_t;
 
-class AppButton : public Subject
+typedef enum
+{
+    BUTTON_STATE_RELEASED = 0,
+    BUTTON_STATE_PRESSING,  // a button reads, not for long enough yet
+    BUTTON_STATE_PRESSED,
+    BUTTON_STATE_RELEASING, // the button stopped reading, not for long enough yet
+} button_state_t;
+
+typedef struct
+{
+    uint32_t samples;   // ADC reads, one per wakeup of the button task
+    uint32_t presses;
+    uint32_t long_presses;
+    uint32_t repeats;
+    uint32_t glitches;  // readings that did not hold long enough to count
+} button_stats_t;
+
+/**
+ * @brief Debounce state machine over the voltages read on the button ladder. Only one button
+ *        reads at a time; it has to read BUTTON_DEBOUNCE_SAMPLES times in a row to be pressed,
+ *        so contact bounce and the ladder passing through other buttons' ranges are ignored,
+ *        and stop reading as many times to be released.
+ */
+class ButtonDebouncer
+{
+private:
+    const std::vector<key_config_t> *key_configs;
+    button_state_t state;
+    button_name_t candidate; // being pressed, or the one held
+    uint8_t count;           // samples in a row that agree with the state change under way
+    int64_t next_action;     // esp_timer time of the next long press or repeat, INT64_MAX for none
+
+    const key_config_t *config(button_name_t button) const;
+
+public:
+    uint32_t glitches;
+
+    ButtonDebouncer(const std::vector<key_config_t> *key_configs);
+
+    /**
+     * @brief Decode one sample.
+     *
+     * @param now    esp_timer time the sample was taken, us
+     * @param button set to the button that produced an event, BUTTON_IDLE if none did
+     * @param action what it did
+     * @return ms until the next sample is due
+     */
+    uint32_t sample(int voltage, int64_t now, button_name_t *button, button_action_t *action);
+};
+
+/**
+ * @brief Reads the buttons and publishes every press, long press and repeat, with the menu
+ *        in force, on its event bus. Presses can also be injected with press(); the button
+ *        task publishes them too, so events keep a single publisher and a single order.
+ */
+class AppButton : public EventBus
 {
 public:
     std::vector<key_config_t> key_configs;
-    button_name_t pressed;
+    ButtonDebouncer debouncer;
 
-    uint8_t menu;
+    uint8_t menu; // only changed by the button task
+    QueueHandle_t queue_presses; // event_t injected by press(), sequence unused
 
     AppButton();
     ~AppButton();
 
+    /**
+     * @brief Act as if a button was pressed, and for BUTTON_MENU select `menu`. Never waits,
+     *        the press is dropped if the button task has a backlog.
+     */
+    void press(button_name_t button, uint8_t menu = MENU_MAX);
+
     void run();
 };
+
+void button_get_stats(button_stats_t *stats);
+
+/**
+ * @brief Register the `button` console command.
+ */
+void button_register_commands();
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "esp_console.h"
+
+class AppConsole
+{
+private:
+    esp_console_repl_t *repl;
+
+public:
+    AppConsole();
+
+    void run();
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+
+#include "__base__.hpp"
+
+#define CONTROL_FIXED_POINT 0 // 1 runs the controller in Q16.16 instead of single precision
+
+#define TARGET_HORIZONTAL_EXCLUSION_PROPORTION 0.3
+#define MAX_HORIZONTAL_ROTATION_MOVEMENT 30.0
+#define MIN_HORIZONTAL_ROTATION_MOVEMENT 1.0
+
+// VERTICAL ROTATION UNTESTED
+#define TARGET_VERTICAL_EXCLUSION_PROPORTION 0.20
+#define MAX_VERTICAL_ROTATION_MOVEMENT 30.0
+#define MIN_VERTICAL_ROTATION_MOVEMENT 1.0
+
+#define TARGET_AREA_PROPORTION 0.15
+#define TARGET_AREA_PROPORTION_TOLERANCE 0.05
+#define MAX_FORWARD_MOVEMENT 20.0
+#define MIN_FORWARD_MOVEMENT 0.5
+#define MAX_AREA_PROPORTION ((2*TARGET_AREA_PROPORTION) + TARGET_AREA_PROPORTION_TOLERANCE)
+
+#define CONTROL_BENCHMARK_ITERATIONS 20000
+
+/*
+ * Numeric policies for the controller. The ESP32-S3 FPU is single precision only,
+ * double arithmetic is emulated in software. Constants are converted at compile time.
+ */
+struct ControlDouble // Reference, the behaviour the controller was tuned with
+{
+    typedef double value_t;
+    static constexpr value_t constant(double value) { return value; }
+    static value_t ratio(int32_t numerator, int32_t denominator) { return static_cast<double>(numerator) / denominator; }
+    static value_t mul(value_t a, value_t b) { return a * b; }
+    static value_t div(value_t a, value_t b) { return a / b; }
+    static float to_float(value_t value) { return static_cast<float>(value); }
+};
+
+struct ControlFloat
+{
+    typedef float value_t;
+    static constexpr value_t constant(double value) { return static_cast<float>(value); }
+    static value_t ratio(int32_t numerator, int32_t denominator) { return static_cast<float>(numerator) / denominator; }
+    static value_t mul(value_t a, value_t b) { return a * b; }
+    static value_t div(value_t a, value_t b) { return a / b; }
+    static float to_float(value_t value) { return value; }
+};
+
+template <int FRACTION_BITS>
+struct ControlFixed
+{
+    typedef int32_t value_t;
+    static constexpr value_t constant(double value) { return static_cast<value_t>(value * (1 << FRACTION_BITS) + (value < 0 ? -0.5 : 0.5)); }
+    static value_t ratio(int32_t numerator, int32_t denominator) { return static_cast<value_t>(((static_cast<int64_t>(numerator) << FRACTION_BITS) + denominator / 2) / denominator); } // Rounded like constant(), so thresholds compare as in double
+    static value_t mul(value_t a, value_t b) { return static_cast<value_t>((static_cast<int64_t>(a) * b) >> FRACTION_BITS); }
+    static value_t div(value_t a, value_t b) { return static_cast<value_t>((static_cast<int64_t>(a) << FRACTION_BITS) / b); }
+    static float to_float(value_t value) { return static_cast<float>(value) / (1 << FRACTION_BITS); }
+};
+
+#if CONTROL_FIXED_POINT
+typedef ControlFixed<16> ControlNumeric;
+#else
+typedef ControlFloat ControlNumeric;
+#endif
+
+template <class N>
+static inline typename N::value_t control_fmap(typename N::value_t value, typename N::value_t in_min, typename N::value_t in_max, typename N::value_t out_min, typename N::value_t out_max)
+{
+    return N::div(N::mul(value - in_min, out_max - out_min), in_max - in_min) + out_min;
+}
+
+/**
+ * @brief Movement orders that bring the target box to the middle of the frame at the target size.
+ *
+ * @param left, top, right, bottom target box in frame coordinates
+ * @param width, height            frame size
+ * @param orders                   rotation and displacement amounts are written, the other members are left alone
+ */
+template <class N>
+void control_compute_orders(int32_t left, int32_t top, int32_t right, int32_t bottom, int32_t width, int32_t height, movement_orders_t *orders)
+{
+    typedef typename N::value_t value_t;
+
+    value_t right_proportion = N::ratio(right, width);
+    value_t left_proportion = N::ratio(left, width);
+    value_t top_proportion = N::ratio(top, height);
+    value_t bottom_proportion = N::ratio(bottom, height);
+    value_t area_proportion = N::ratio((right - left) * (bottom - top), width * height);
+
+    constexpr value_t zero = N::constant(0);
+    constexpr value_t one = N::constant(1);
+
+    constexpr value_t horizontal_exclusion = N::constant(TARGET_HORIZONTAL_EXCLUSION_PROPORTION);
+    constexpr value_t max_horizontal = N::constant(MAX_HORIZONTAL_ROTATION_MOVEMENT);
+    constexpr value_t min_horizontal = N::constant(MIN_HORIZONTAL_ROTATION_MOVEMENT);
+    value_t horizontal = zero;
+    if(left_proportion < horizontal_exclusion)
+    {
+        horizontal = control_fmap<N>(left_proportion, zero, horizontal_exclusion, -max_horizontal, -min_horizontal);
+    }
+    else if(right_proportion > one - horizontal_exclusion)
+    {
+        horizontal = control_fmap<N>(right_proportion, one - horizontal_exclusion, one, min_horizontal, max_horizontal);
+    }
+
+    constexpr value_t vertical_exclusion = N::constant(TARGET_VERTICAL_EXCLUSION_PROPORTION);
+    constexpr value_t max_vertical = N::constant(MAX_VERTICAL_ROTATION_MOVEMENT);
+    constexpr value_t min_vertical = N::constant(MIN_VERTICAL_ROTATION_MOVEMENT);
+    value_t vertical = zero;
+    if(top_proportion < vertical_exclusion)
+    {
+        vertical = control_fmap<N>(top_proportion, zero, vertical_exclusion, -max_vertical, -min_vertical);
+    }
+    else if(bottom_proportion > one - vertical_exclusion)
+    {
+        vertical = control_fmap<N>(bottom_proportion, one - vertical_exclusion, one, min_vertical, max_vertical);
+    }
+
+    constexpr value_t area_low = N::constant(TARGET_AREA_PROPORTION - TARGET_AREA_PROPORTION_TOLERANCE);
+    constexpr value_t area_high = N::constant(TARGET_AREA_PROPORTION + TARGET_AREA_PROPORTION_TOLERANCE);
+    constexpr value_t area_max = N::constant(MAX_AREA_PROPORTION);
+    constexpr value_t max_forward = N::constant(MAX_FORWARD_MOVEMENT);
+    constexpr value_t min_forward = N::constant(MIN_FORWARD_MOVEMENT);
+    value_t forward = zero;
+    if(area_proportion < area_low)
+    {
+        forward = control_fmap<N>(area_proportion, zero, area_low, max_forward, min_forward);
+    }
+    else if(area_proportion > area_high)
+    {
+        forward = control_fmap<N>(area_proportion, area_high, area_max, -min_forward, -max_forward);
+    }
+
+    orders->horizontalRotationAmount = N::to_float(horizontal);
+    orders->verticalRotationAmount = N::to_float(vertical);
+    orders->forwardDisplacementAmount = N::to_float(forward);
+}
+
+/**
+ * @brief Register the `control` console command: compares the float and Q16.16 controllers
+ *        with the double reference over a sweep of boxes and reports the time per call.
+ */
+void control_register_commands();
+
+/**
+ * @brief Run the comparison and benchmark of the `control` command.
+ *
+ * @return the largest difference with the double reference, in deg/s or cm/s
+ */
+float control_benchmark(uint32_t iterations = CONTROL_BENCHMARK_ITERATIONS);
@@ -16,13 +16,55 @@
 #include "__base__.hpp"
 #include "app_camera.hpp"
 #include "app_button.hpp"
+#include "app_motion.hpp"
+#include "app_results.hpp"
+#include "app_tracker.hpp"
 
+#define FACE_ROI_PADDING 0.5F       // ROI margin on each side of the tracked box, as a fraction of its size
+#define FACE_ROI_MIN_SIZE 96        // Smallest ROI side in pixels, MSR01 needs some context around the face
+#define FACE_ROI_RESCAN_INTERVAL 10 // Frames searched through the ROI between two full-frame rescans
+#define FACE_DETECT_INTERVAL 1      // Run the detectors every N frames while a track exists, the tracker predicts the rest
+#define FACE_DETECT_SIDE 240        // Longest side of the MSR01 input, larger frames and ROIs are searched downscaled
+#define FACE_ZOOM_INTERVAL 2        // Without a track, every Nth scan of a larger frame searches a native-resolution window at its center instead, 0 never
+#define FACE_PIPELINE 1             // MSR01 and MNP01 run as two tasks on different cores, overlapping consecutive frames
+#define FACE_PIPELINE_SLOTS 2       // Frames in the cascade at once: one being refined while the next gets its candidates
+// Camera buffers for the sensor never to wait on detection: one per frame in the cascade, one in the frame_1 mailbox and
+// one being captured. The LCD behind frame_2 and a recording behind frame_3 share those frames through the frame pool,
+// they only hold one more while they fall behind detection. Can be no more than FRAME_POOL_SIZE.
+#define FACE_CAMERA_FB_COUNT(pipeline) (((pipeline) ? FACE_PIPELINE_SLOTS : 1) + 2)
 
-class AppFace : public Observer, public Frame
+typedef enum
 {
-private:
-    AppButton *key;
+    FACE_STAGE_IDLE = 0, // detection is off, the frame only passes through
+    FACE_STAGE_PREDICT,  // skipped by FACE_DETECT_INTERVAL, the tracker predicts
+    FACE_STAGE_REUSE,    // nothing moved, the last results stand
+    FACE_STAGE_DETECT,   // MSR01 candidates to refine with MNP01
+} face_stage_mode_t;
 
+typedef enum
+{
+    FACE_SEARCH_FRAME = 0, // whole frame, downscaled when larger than FACE_DETECT_SIDE
+    FACE_SEARCH_ROI,       // padded region around the tracked face
+    FACE_SEARCH_ZOOM,      // native-resolution window at the center of a larger frame
+} face_search_t;
+
+// A frame on its way from the candidate stage to the refinement stage
+typedef struct
+{
+    camera_fb_t *frame;
+    int64_t start_time; // esp_timer time AppFace took the frame, us
+    face_stage_mode_t mode;
+    bool restart;       // the menu changed before this frame, the refinement stage drops the track
+    face_search_t search;
+    int region[4];          // searched part of the frame, inclusive
+    bool downscaled;        // MSR01 saw the region at less than full resolution
+    uint16_t *detect_image; // this slot's MSR01 input, FACE_DETECT_SIDE x FACE_DETECT_SIDE pixels of room
+    int64_t candidates_us;  // MSR01 time
+    FaceResults candidates; // in frame coordinates, read out of the detector, which reuses its list on the next frame
+} face_stage_t;
+
+class AppFace : public Frame
+{
 public:
     HumanFaceDetectMSR01 detector;
     HumanFaceDetectMNP01 detector2;
@@ -30,14 +72,47 @@ public:
     face_info_t recognize_result;
 
     QueueHandle_t queue_o_movement_orders;
+    QueueHandle_t queue_o_overlay; // single slot of overlay_t, the latest results for AppLCD
+
+    // Button events are taken by the candidate stage before each frame, switch_on is its own
+    Subscription events;
     bool switch_on;
 
+    // Tracking mode: once a face is found only a padded region around it is searched. The
+    // refinement stage moves the ROI and the candidate stage reads it, under roi_lock.
+    portMUX_TYPE roi_lock;
+    bool tracking;
+    bool track_active; // box_tracker.active as the refinement stage last left it, for the candidate stage
+    int roi[4]; // left, top, right, bottom in frame coordinates, inclusive
+    uint8_t frames_since_rescan;
+    uint8_t scans_since_zoom;
+
+    // Slots carry frames through the cascade; the candidate stage waits for a free one
+    bool pipeline;
+    face_stage_t stages[FACE_PIPELINE_SLOTS];
+    QueueHandle_t queue_free_stages;
+    QueueHandle_t queue_stages; // face_stage_t * from the candidate stage to the refinement stage
+
+    // Movement orders follow the tracker, so they keep coming at camera rate between detections.
+    // The tracker belongs to the refinement stage, frames_since_detection to the candidate stage.
+    BoxTracker box_tracker;
+    uint8_t frames_since_detection;
+    bool target_sent; // the last orders handed over followed a face, a no-target order ends them
+
+    // The refinement stage's results, and the candidates it hands MNP01, never allocate.
+    // On a still scene the detectors are skipped and the last results stand.
+    FaceResults results;
+    ResultList candidate_list;
+    MotionGate motion_gate;
+    bool has_results; // the candidate stage sent a frame to detect since the last reset
+    FaceResults *last_results; // &results, nullptr until the refinement stage has some
+
     AppFace(AppButton *key,
             QueueHandle_t queue_i = nullptr,
             QueueHandle_t queue_o = nullptr,
             QueueHandle_t queue_o_movement_orders = nullptr,
+            QueueHandle_t queue_o_overlay = nullptr,
             void (*callback)(camera_fb_t *) = esp_camera_fb_return);
 
-    void update();
     void run();
 };
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+
+#include "__base__.hpp"
+#include "app_frame_link.hpp"
+#include "app_frame_pool.hpp"
+
+/**
+ * @brief Forwards every frame from queue_i to all the output queues at once. Each
+ *        consumer holds a reference from the frame pool and must give it back with
+ *        frame_pool_release() (set it as the consumer's callback).
+ */
+class AppFanout : public Frame
+{
+public:
+    std::vector<QueueHandle_t> queues_o;
+
+    AppFanout(QueueHandle_t queue_i,
+              std::vector<QueueHandle_t> queues_o,
+              void (*callback)(camera_fb_t *) = esp_camera_fb_return);
+
+    void run();
+};
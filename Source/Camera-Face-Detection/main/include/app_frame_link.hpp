@@ -0,0 +1,42 @@
+#pragma once
+
+#include "__base__.hpp"
+
+#define FRAME_LINK_MAX 8
+#define FRAME_LINK_LOG_INTERVAL 300 // Frames sent on a link between two statistics logs
+
+typedef enum
+{
+    FRAME_LINK_QUEUE = 0, // Depth-2 queue, the producer blocks until the consumer catches up
+    FRAME_LINK_LATEST,    // Single-slot mailbox, a new frame displaces the one still waiting
+} frame_link_mode_t;
+
+typedef struct
+{
+    uint32_t sent;     // Frames handed to the link by the producer
+    uint32_t dropped;  // Frames displaced before the consumer got them
+    uint32_t consumed; // Frames received by the consumer
+} frame_link_stats_t;
+
+/**
+ * @brief Create a link carrying camera_fb_t pointers between two stages.
+ *
+ * @param name shown in the statistics log and the queue registry
+ * @param mode FRAME_LINK_QUEUE or FRAME_LINK_LATEST
+ * @return the queue to pass as a stage's queue_i/queue_o, nullptr if out of memory
+ */
+QueueHandle_t frame_link_create(const char *name, frame_link_mode_t mode);
+
+/**
+ * @brief Hand a frame to the next stage. On a FRAME_LINK_LATEST link a frame still
+ *        waiting is given back with frame_pool_release() and counted as dropped.
+ *        Queues not created by frame_link_create() behave as a blocking xQueueSend().
+ */
+void frame_link_send(QueueHandle_t link, camera_fb_t *frame);
+
+/**
+ * @brief Receive a frame from the previous stage, same contract as xQueueReceive().
+ */
+bool frame_link_receive(QueueHandle_t link, camera_fb_t **frame, TickType_t ticks_to_wait);
+
+bool frame_link_get_stats(QueueHandle_t link, frame_link_stats_t *stats);
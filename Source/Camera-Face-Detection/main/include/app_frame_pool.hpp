@@ -0,0 +1,21 @@
+#pragma once
+
+#include "__base__.hpp"
+
+#define FRAME_POOL_SIZE 4 // Must be at least the camera fb_count
+
+/**
+ * @brief Hand out `references` references to a camera frame. Every holder gives its
+ *        reference back with frame_pool_release(), and the last one returns the
+ *        buffer to the camera driver.
+ *
+ * @param frame      frame obtained from esp_camera_fb_get()
+ * @param references number of consumers that will call frame_pool_release()
+ */
+void frame_pool_share(camera_fb_t *frame, uint8_t references);
+
+/**
+ * @brief Drop one reference to a frame. Frames that were never shared are returned
+ *        to the driver straight away, so this can be used as any Frame callback.
+ */
+void frame_pool_release(camera_fb_t *frame);
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "__base__.hpp"
+
+#define LATENCY_BUCKETS 66           // 4 buckets per octave from 64 us to ~4 s
+#define LATENCY_SUMMARY_PERIOD 10000 // ms between two summary logs
+
+typedef enum
+{
+    LATENCY_HOP_CAPTURE_TO_FACE = 0,  // sensor capture -> AppFace takes the frame
+    LATENCY_STAGE_FACE,               // AppFace detection and movement orders
+    LATENCY_HOP_FACE_TO_TRANSMISSION, // AppFace -> AppTransmission takes the orders
+    LATENCY_STAGE_SEND,               // esp_now_send() call
+    LATENCY_CAPTURE_TO_SEND,          // sensor capture -> orders handed to the radio
+
+    LATENCY_MAX
+} latency_point_t;
+
+typedef struct
+{
+    uint32_t count;
+    int64_t min_us;
+    int64_t max_us;
+    int64_t total_us;
+    uint32_t buckets[LATENCY_BUCKETS];
+} latency_histogram_t;
+
+/**
+ * @brief Capture time of a frame in the esp_timer_get_time() time base, as stamped by the camera driver.
+ */
+int64_t latency_frame_time(const camera_fb_t *frame);
+
+void latency_record(latency_point_t point, int64_t elapsed_us);
+
+/**
+ * @brief Count movement orders overwritten in the transmission slot by newer ones.
+ */
+void latency_count_coalesced();
+
+/**
+ * @brief Copy the histogram of the current window.
+ */
+void latency_get(latency_point_t point, latency_histogram_t *histogram);
+
+/**
+ * @brief 99th percentile of a histogram, rounded up to its bucket bound.
+ */
+int64_t latency_percentile(const latency_histogram_t *histogram, uint32_t percent);
+
+/**
+ * @brief Log min/avg/p99 of every point and start a new window.
+ */
+void latency_log_summary();
+
+/**
+ * @brief Register the `latency` console command and start logging a summary every period_ms.
+ */
+void latency_start(uint32_t period_ms = LATENCY_SUMMARY_PERIOD);
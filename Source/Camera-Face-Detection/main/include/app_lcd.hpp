@@ -9,6 +9,8 @@
 #include "__base__.hpp"
 #include "app_camera.hpp"
 #include "app_button.hpp"
+#include "app_overlay.hpp"
+#include "app_scaler.hpp"
 
 #define BOARD_LCD_MOSI 47
 #define BOARD_LCD_MISO -1
@@ -26,25 +28,63 @@
 #define BOARD_LCD_PARAM_BITS 8
 // #define LCD_HOST SPI2_HOST
 
-class AppLCD : public Observer, public Frame
+#define LCD_BUFFER_COUNT 2  // Band DMA buffers from the arena, one is filled while the other is on the wire
+#define LCD_BAND_HEIGHT 40  // Rows scaled, composited and sent per transfer, 19 KB of internal SRAM per buffer
+#define LCD_TRANS_QUEUE_DEPTH (LCD_BUFFER_COUNT * BOARD_LCD_V_RES / LCD_BAND_HEIGHT) // Color transfers the panel IO can have queued
+
+#define OVERLAY_TEXT_Y 10      // HUD line position, it must fit in the first band
+#define OVERLAY_TEXT_HEIGHT 20
+
+typedef struct
+{
+    const uint16_t *pixels;
+    uint16_t *release; // display buffer to hand back once this transfer is done, or nullptr
+    bool queued;       // false if the panel IO refused it, it only waits for the transfers before it
+} lcd_transfer_t;
+
+class AppLCD : public Frame
 {
-private:
-    AppButton *key;
 public:
     esp_lcd_panel_handle_t panel_handle;
+    Subscription events; // button events, taken by the LCD task before each frame
     bool switch_on;
     bool paper_drawn;
     bool black_drawn;
 
+    // Frames, the wallpaper and fills go band by band through a free display buffer and are sent
+    // asynchronously; the color transfer done callback hands the buffer back once the panel has it.
+    FrameScaler scaler;
+    uint16_t *frame_copy; // a panel-sized frame is copied here so the camera gets it back before the bands go out
+    uint16_t *display_buffers[LCD_BUFFER_COUNT];
+    QueueHandle_t queue_free_buffers;
+    // Transfers handed to the panel IO, in submission order, taken off by the color transfer done ISR
+    portMUX_TYPE inflight_lock;
+    lcd_transfer_t inflight[LCD_TRANS_QUEUE_DEPTH];
+    uint32_t inflight_head;
+    uint32_t inflight_count;
+
+    QueueHandle_t queue_i_overlay; // single slot of overlay_t published by AppFace
+    overlay_t overlay;
+
     explicit AppLCD(AppButton *key,
            QueueHandle_t xQueueFrameI = nullptr,
            QueueHandle_t xQueueFrameO = nullptr,
+           QueueHandle_t xQueueOverlayI = nullptr,
            void (*callback)(camera_fb_t *) = esp_camera_fb_return);
 
     void draw_wallpaper();
-    void draw_color(int color) const;
+    void draw_color(int color);
+
+    /**
+     * @brief Wait for a free display buffer, nullptr if the arena had none to give.
+     */
+    uint16_t *take_buffer() const;
+    void draw_bitmap(int x_start, int y_start, int x_end, int y_end, const uint16_t *pixels, uint16_t *release = nullptr);
 
-    void update();
+    /**
+     * @brief Apply the menu changes published since the last call, from the LCD task.
+     */
+    void take_events();
 
     void run();
 };
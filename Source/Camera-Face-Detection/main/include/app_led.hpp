@@ -7,14 +7,102 @@
 
 #include "app_button.hpp"
 
-class AppLED : public Observer
+#define LED_PATTERN_STEPS 6 // Levels a pattern goes through at most before it loops
+#define LED_HOLD 0          // Step duration that keeps its level until the pattern is replaced
+
+typedef enum
 {
-private:
-    const gpio_num_t pin;
-    AppButton *key;
+    LED_ALWAYS_OFF = 0,
+    LED_ALWAYS_ON,
+    LED_OFF_1S,
+    LED_OFF_2S,
+    LED_OFF_4S,
+    LED_ON_1S,
+    LED_ON_2S,
+    LED_ON_4S,
+    LED_BLINK_1S,
+    LED_BLINK_2S,
+    LED_BLINK_4S,
+    LED_SEARCHING,   // Status: detection on, no face tracked
+    LED_TRACKING,    // Status: following a face
+    LED_LINK_DOWN,   // Status: detection on, no Alvik answered the broadcast yet
+    LED_TARGET_LOST, // Played over the status when a tracked face is lost
+    LED_MODE_MAX,
+} led_mode_t;
+
+/**
+ * @brief The LED starts at `level` and toggles after each step; after the last step the
+ *        pattern starts over until it has played `loops` times, or forever when 0.
+ */
+typedef struct
+{
+    uint8_t level;
+    uint8_t steps;
+    uint8_t loops;
+    uint8_t reserved;
+    uint16_t duration[LED_PATTERN_STEPS]; // ms, LED_HOLD ends the pattern on that level
+} led_pattern_t;
+
+typedef enum
+{
+    LED_LAYER_STATUS = 0, // Follows the pipeline state set through led_set_status()
+    LED_LAYER_EVENT,      // Patterns played with led_play(), shown over the status while they last
+    LED_LAYER_MAX,
+} led_layer_t;
+
+#define LED_STATUS_DETECTING 0x01 // Face detection is switched on
+#define LED_STATUS_TRACKING 0x02  // AppFace follows a face
+#define LED_STATUS_LINK_UP 0x04   // The paired Alvik's heartbeats keep coming
+
+typedef struct
+{
+    uint32_t status;                  // LED_STATUS_* flags
+    led_mode_t shown[LED_LAYER_MAX];  // per layer, LED_MODE_MAX when the layer is idle
+    uint32_t edges;                   // level changes written to the pin
+    uint32_t wakeups;                 // timer callbacks, one per edge plus one per request
+} led_stats_t;
 
+/**
+ * @brief Owns the LED pin. Patterns are played from an esp_timer callback that only runs
+ *        when the level has to change, so neither the callers nor an idle LED cost any time.
+ *        A press on any button blinks it over whatever the status shows.
+ */
+class AppLED
+{
 public:
+    const gpio_num_t pin;
+    Subscription events;
+
     AppLED(gpio_num_t pin, AppButton *key);
 
-    void update() final;
+    void run();
 };
+
+/**
+ * @brief Play a pattern over the status, replacing the one playing. Never blocks; the timer
+ *        callback starts it. Patterns ending on LED_HOLD stay until led_stop().
+ */
+void led_play(led_mode_t mode);
+
+/**
+ * @brief End the pattern played with led_play(), the status shows again.
+ */
+void led_stop();
+
+/**
+ * @brief Set the LED_STATUS_* flags in `mask` to their value in `flags`. A call that
+ *        changes nothing is a single atomic load.
+ */
+void led_set_status(uint32_t mask, uint32_t flags);
+
+/**
+ * @brief The table entry a mode plays.
+ */
+const led_pattern_t *led_pattern(led_mode_t mode);
+
+void led_get_stats(led_stats_t *stats);
+
+/**
+ * @brief Register the `led` console command.
+ */
+void led_register_commands();
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "__base__.hpp"
+
+#define MOTION_GRID_WIDTH 16        // Cells of the luma signature
+#define MOTION_GRID_HEIGHT 12
+#define MOTION_SAMPLE_STEP 4        // Every Nth pixel of every Nth row is sampled at most, small regions are sampled denser
+#define MOTION_CELL_THRESHOLD 4     // Mean luma change (0-255) of a cell that counts as motion
+#define MOTION_REFRESH_INTERVAL 15  // Frames skipped in a row before the detectors run anyway
+
+typedef struct
+{
+    uint32_t frames;       // frames the gate looked at
+    uint32_t skipped;      // frames that reused the last results
+    int64_t signature_us;  // time spent building signatures
+    uint32_t inferences;   // detector runs and the time they took
+    int64_t inference_us;
+} motion_stats_t;
+
+/**
+ * @brief Decides whether a frame is worth running the detectors on. The watched region of
+ *        each frame is reduced to a grid of mean luma values and compared with the frame the
+ *        detectors last ran on, so slow drift adds up until it is noticed.
+ */
+class MotionGate
+{
+private:
+    uint8_t reference[MOTION_GRID_WIDTH * MOTION_GRID_HEIGHT];
+    uint8_t current[MOTION_GRID_WIDTH * MOTION_GRID_HEIGHT];
+    bool reference_valid;
+    uint16_t reference_width;
+    uint16_t reference_height;
+    int reference_region[4];
+    uint8_t frames_skipped;
+
+public:
+    MotionGate();
+
+    /**
+     * @brief Forget the reference, the next frame always goes to the detectors.
+     */
+    void reset();
+
+    /**
+     * @brief Compare a region of a frame with the reference. When it changed, the region
+     *        moved, or the refresh interval is due, it becomes the new reference.
+     *
+     * @param region left, top, right, bottom in frame coordinates, inclusive
+     * @return true if the detectors should run on this frame
+     */
+    bool changed(const camera_fb_t *frame, const int region[4]);
+};
+
+/**
+ * @brief Account one detector run, for the CPU time estimate.
+ */
+void motion_record_inference(int64_t elapsed_us);
+
+void motion_get_stats(motion_stats_t *stats);
+
+/**
+ * @brief Log the skip ratio and the estimated inference time saved, net of the signatures.
+ */
+void motion_log_summary();
+
+/**
+ * @brief Register the `motion` console command.
+ */
+void motion_register_commands();
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "__base__.hpp"
+
+#define OVERLAY_MAX_FACES 8
+#define OVERLAY_KEYPOINTS 10    // x, y of the eyes, nose and mouth corners
+#define OVERLAY_TEXT_LEN 32
+#define OVERLAY_MAX_AGE 300000  // us, an overlay older than the frame by more is not drawn
+
+// RGB565 with the bytes swapped, the order the camera and the panel use
+#define OVERLAY_COLOR_GREEN 0xE007
+#define OVERLAY_COLOR_RED 0x00F8
+#define OVERLAY_COLOR_YELLOW 0xE0FF
+#define OVERLAY_COLOR_WHITE 0xFFFF
+
+typedef struct
+{
+    int16_t box[4];                      // left, top, right, bottom
+    int16_t keypoint[OVERLAY_KEYPOINTS]; // only valid when has_keypoints
+    bool has_keypoints;
+    bool predicted;                      // box from the tracker, not from a detection
+} overlay_face_t;
+
+/**
+ * @brief What AppFace found on a frame, for AppLCD to composite over the picture.
+ *        Coordinates are in the pixels of the frame it was found on.
+ */
+typedef struct
+{
+    int64_t capture_time; // esp_timer time the frame was captured, us
+    uint16_t width;       // frame the coordinates refer to
+    uint16_t height;
+    uint8_t count;
+    overlay_face_t faces[OVERLAY_MAX_FACES];
+    char text[OVERLAY_TEXT_LEN]; // HUD line, empty for none
+} overlay_t;
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <vector>
+
+#include "esp_partition.h"
+
+#include "__base__.hpp"
+#include "app_overlay.hpp"
+
+#define RECORD_PARTITION "model"  // Data partition recordings are written to, unused by the application otherwise
+#define RECORD_JPEG_QUALITY 60    // Frames are stored as JPEG at this quality, 0 stores raw RGB565
+#define RECORD_INDEX_MAX 2048     // Frames a recording can index, later ones are only found by scanning
+#define RECORD_ITEM_QUEUE 8       // Results and orders waiting for the recorder task
+
+#define RECORD_FOURCC(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+#define RECORD_MAGIC RECORD_FOURCC('F', 'D', 'R', 'C')
+#define RECORD_VERSION 1
+#define RECORD_UNSET 0xFFFFFFFF   // Erased flash, header fields written when the recording is closed
+
+typedef enum
+{
+    RECORD_CHUNK_FRAME = RECORD_FOURCC('F', 'R', 'A', 'M'),   // record_frame_t then the pixels
+    RECORD_CHUNK_RESULTS = RECORD_FOURCC('R', 'S', 'L', 'T'), // record_results_t then `count` record_face_t
+    RECORD_CHUNK_ORDERS = RECORD_FOURCC('O', 'R', 'D', 'R'),  // record_orders_t
+    RECORD_CHUNK_INDEX = RECORD_FOURCC('I', 'N', 'D', 'X'),   // record_index_entry_t of every frame, last chunk
+} record_chunk_type_t;
+
+typedef enum
+{
+    RECORD_FORMAT_RGB565 = 0, // width * height pixels as the camera stores them
+    RECORD_FORMAT_JPEG,
+} record_format_t;
+
+/*
+ * A recording is a record_header_t followed by chunks, each a record_chunk_t and `size`
+ * bytes of payload, all little endian. Chunks are appended as they come so a recording cut
+ * short by a reset can still be scanned; closing it appends the index and fills in the
+ * header fields left erased at the start.
+ */
+typedef struct __attribute__((packed))
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t length;       // bytes in the recording, RECORD_UNSET until closed
+    uint32_t index_offset; // of the index chunk, RECORD_UNSET until closed
+} record_header_t;
+
+typedef struct __attribute__((packed))
+{
+    uint32_t type;
+    uint32_t size; // payload bytes after this header
+} record_chunk_t;
+
+typedef struct __attribute__((packed))
+{
+    int64_t capture_time; // esp_timer time the frame was captured, us
+    uint32_t sequence;    // frames written before this one, the capture times show where frames were dropped
+    uint16_t width;
+    uint16_t height;
+    uint8_t format; // record_format_t
+    uint8_t reserved[3];
+} record_frame_t;
+
+typedef struct __attribute__((packed))
+{
+    int64_t capture_time; // of the frame the results were found on
+    int32_t elapsed_us;   // AppFace time from taking the frame to handing out its results
+    uint16_t width;       // frame the coordinates refer to
+    uint16_t height;
+    uint8_t count;
+    uint8_t reserved[3];
+} record_results_t;
+
+typedef struct __attribute__((packed))
+{
+    int16_t box[4];
+    int16_t keypoint[OVERLAY_KEYPOINTS];
+    uint8_t flags; // RECORD_FACE_*
+    uint8_t reserved;
+} record_face_t;
+
+#define RECORD_FACE_KEYPOINTS 0x01
+#define RECORD_FACE_PREDICTED 0x02
+
+typedef struct __attribute__((packed))
+{
+    int64_t capture_time;
+    int32_t latency_us; // capture to orders handed to AppTransmission
+    float horizontal_rotation;
+    float vertical_rotation;
+    float forward_displacement;
+    float confidence;
+} record_orders_t;
+
+typedef struct __attribute__((packed))
+{
+    uint32_t offset; // of the frame chunk from the start of the recording
+    int64_t capture_time;
+} record_index_entry_t;
+
+static_assert(sizeof(record_header_t) == 16, "record_header_t layout changed, bump RECORD_VERSION");
+static_assert(sizeof(record_frame_t) == 20, "record_frame_t layout changed, bump RECORD_VERSION");
+static_assert(sizeof(record_results_t) == 20, "record_results_t layout changed, bump RECORD_VERSION");
+static_assert(sizeof(record_face_t) == 30, "record_face_t layout changed, bump RECORD_VERSION");
+static_assert(sizeof(record_orders_t) == 28, "record_orders_t layout changed, bump RECORD_VERSION");
+
+typedef struct
+{
+    bool recording;
+    uint32_t bytes;    // written to the current or last recording
+    uint32_t capacity; // partition size
+    uint32_t frames;   // written, and dropped on the link while the recorder was busy
+    uint32_t dropped;
+    uint32_t results;
+    uint32_t orders;
+    uint32_t items_lost; // results and orders that found the item queue full
+    int64_t encode_us;   // time spent compressing frames, and writing them to flash
+    int64_t write_us;
+} record_stats_t;
+
+/**
+ * @brief Writes the frames it receives, with the detection results and movement orders
+ *        AppFace reports through record_results() and record_orders(), to RECORD_PARTITION.
+ *        Frames are released as soon as they are compressed, before the slow flash writes.
+ *        Nothing is written until the `record start` console command.
+ */
+class AppRecorder : public Frame
+{
+public:
+    const esp_partition_t *partition;
+    int jpeg_quality; // RECORD_JPEG_QUALITY on the robot, 0 stores raw frames
+
+    // Writer state, only touched by the recorder task
+    uint32_t offset;
+    uint32_t erased; // flash erased up to here
+    uint32_t sequence;
+    std::vector<record_index_entry_t> index; // RECORD_INDEX_MAX entries reserved by the constructor
+    QueueHandle_t queue_items;
+
+    AppRecorder(QueueHandle_t queue_i,
+                const char *partition_label = RECORD_PARTITION,
+                void (*callback)(camera_fb_t *) = esp_camera_fb_return);
+
+    void run();
+};
+
+/**
+ * @brief Hand the results AppFace published for a frame to the recorder. Does nothing
+ *        unless a recording is in progress; never blocks.
+ */
+void record_results(const overlay_t *overlay, int64_t elapsed_us);
+
+/**
+ * @brief Hand the movement orders AppFace produced to the recorder, same contract.
+ */
+void record_orders(const movement_orders_t *orders);
+
+/**
+ * @brief Start or stop the recording, the recorder task acts on it before its next frame.
+ *
+ * @param jpeg_quality 1-100, 0 for raw frames, negative to keep the current setting
+ */
+void record_start(int jpeg_quality = -1);
+void record_stop();
+
+void record_get_stats(record_stats_t *stats);
+
+/**
+ * @brief Register the `record` console command.
+ */
+void record_register_commands();
+
+/**
+ * @brief Sequential access to a recording, through the same partition API it was written with.
+ */
+class RecordReader
+{
+private:
+    const esp_partition_t *partition;
+    uint32_t offset;
+    uint32_t end;
+
+public:
+    record_header_t header;
+
+    RecordReader();
+
+    /**
+     * @brief Check the header and position on the first chunk.
+     *
+     * @return false if the partition holds no recording
+     */
+    bool open(const esp_partition_t *partition);
+
+    /**
+     * @brief Read the chunk at the current position and move past it. Stops at the end of a
+     *        closed recording, or at the first chunk that does not parse in one cut short.
+     *
+     * @param position offset of the chunk, may be nullptr
+     */
+    bool next(record_chunk_t *chunk, std::vector<uint8_t> *payload, uint32_t *position = nullptr);
+
+    /**
+     * @brief Position on the chunk at an offset taken from the index or next().
+     */
+    void seek(uint32_t position);
+
+    /**
+     * @brief Offsets and capture times of all frames: from the index of a closed recording,
+     *        by scanning otherwise. Leaves the position on the first chunk.
+     */
+    bool frames(std::vector<record_index_entry_t> *entries);
+};
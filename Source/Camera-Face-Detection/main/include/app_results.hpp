@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+
+#include "dl_detect_define.hpp"
+
+#define FACE_RESULTS_MAX 10      // Faces kept per detector pass, the top_k both detectors are built with
+#define FACE_RESULT_KEYPOINTS 10 // x, y of the eyes, nose and mouth corners
+
+typedef struct
+{
+    float score;
+    int box[4];                          // left, top, right, bottom
+    int keypoint[FACE_RESULT_KEYPOINTS]; // only valid when has_keypoints
+    bool has_keypoints;
+} face_result_t;
+
+/**
+ * @brief Results of one detector pass in a fixed-capacity array. They are read out of the
+ *        ESP-WHO result lists by reference, so keeping them never allocates; the code that
+ *        merges and selects boxes works on the array, `items` to `items + count`.
+ */
+class FaceResults
+{
+public:
+    face_result_t items[FACE_RESULTS_MAX];
+    uint8_t count;
+    uint32_t dropped; // results past FACE_RESULTS_MAX, left out
+
+    FaceResults();
+
+    /**
+     * @brief Replace the results with the ones of a detector.
+     */
+    void assign(const std::list<dl::detect::result_t> &results);
+
+    void clear() { this->count = 0; }
+    bool empty() const { return this->count == 0; }
+    const face_result_t *begin() const { return this->items; }
+    const face_result_t *end() const { return this->items + this->count; }
+    face_result_t *begin() { return this->items; }
+    face_result_t *end() { return this->items + this->count; }
+};
+
+/**
+ * @brief The std::list of candidates MNP01 takes, filled from a FaceResults. Its nodes and
+ *        their box and keypoint vectors are allocated once, in the constructor; between two
+ *        fills the nodes wait in a spare list, so filling it never allocates.
+ */
+class ResultList
+{
+private:
+    std::list<dl::detect::result_t> spare;
+    std::list<dl::detect::result_t> list;
+
+public:
+    ResultList();
+
+    /**
+     * @return the list, valid until the next fill()
+     */
+    std::list<dl::detect::result_t> &fill(const FaceResults &results);
+};
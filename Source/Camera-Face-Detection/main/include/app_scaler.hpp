@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+#define SCALER_MAX_OUTPUT 320    // Largest panel side the lookup tables cover
+#define SCALER_LETTERBOX_COLOR 0 // RGB565 of the bars around a picture of another aspect ratio
+
+/**
+ * @brief Nearest neighbour RGB565 scaler from a camera frame to a panel, keeping the
+ *        aspect ratio. The picture is centered and the rest of the panel letterboxed.
+ *        Source rows and columns are looked up in tables built once per source size,
+ *        and the output is produced a strip of rows at a time so it can go straight
+ *        from the frame buffer to a small DMA buffer.
+ */
+class FrameScaler
+{
+private:
+    uint16_t column[SCALER_MAX_OUTPUT]; // source column of each picture column
+    uint16_t row[SCALER_MAX_OUTPUT];    // source row of each picture row
+
+public:
+    int output_width; // panel
+    int output_height;
+    int source_width; // frames the tables were built for, 0 before the first one
+    int source_height;
+    int x_offset; // picture inside the panel
+    int y_offset;
+    int width;
+    int height;
+
+    FrameScaler(int output_width, int output_height);
+
+    /**
+     * @brief Rebuild the tables when the source size changes.
+     *
+     * @return true if they were rebuilt
+     */
+    bool configure(int source_width, int source_height);
+
+    /**
+     * @brief Produce the panel rows [y_start, y_end), bars included.
+     *
+     * @param source frame of the configured size
+     * @param strip  (y_end - y_start) rows of output_width pixels
+     */
+    void scale(const uint16_t *source, uint16_t *strip, int y_start, int y_end) const;
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "__base__.hpp"
+
+#define TELEMETRY_MAX_TASKS 32     // Tasks in a snapshot, the application and ESP-IDF ones together
+#define TELEMETRY_MAX_QUEUES 8
+#define TELEMETRY_SAMPLE_PERIOD 100 // ms between two samples of the queue occupancy
+#define TELEMETRY_LOG_PERIOD 10000  // ms between two summary lines
+#define TELEMETRY_STACK_WARNING 512 // bytes of stack never used under which a task is flagged
+#define TELEMETRY_LOW_STACK_TASKS 3 // tasks closest to overflowing named in the summary line
+
+typedef struct
+{
+    char name[configMAX_TASK_NAME_LEN];
+    UBaseType_t priority;
+    float load;          // % of one core since the previous snapshot
+    uint32_t stack_free; // bytes of stack the task never reached, the high-water mark
+} telemetry_task_t;
+
+typedef enum
+{
+    TELEMETRY_HEAP_INTERNAL = 0,
+    TELEMETRY_HEAP_SPIRAM,
+    TELEMETRY_HEAP_MAX,
+} telemetry_heap_region_t;
+
+typedef struct
+{
+    size_t total; // 0 when the region does not exist
+    size_t free;
+    size_t min_free;      // lowest free since boot
+    size_t largest_block; // largest allocation that could succeed now
+} telemetry_heap_t;
+
+typedef struct
+{
+    const char *name;
+    UBaseType_t length;
+    UBaseType_t peak;  // most items waiting in a sample since the previous snapshot
+    float average;     // items waiting, averaged over the samples
+} telemetry_queue_t;
+
+/**
+ * @brief Sample how full a queue runs. The name is needed as the queue registry is
+ *        disabled (CONFIG_FREERTOS_QUEUE_REGISTRY_SIZE=0).
+ */
+void telemetry_watch_queue(QueueHandle_t queue, const char *name);
+
+/**
+ * @brief Snapshot every task. The CPU loads cover the time since the previous snapshot,
+ *        which this one closes; they need CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS.
+ *
+ * @return tasks written to `tasks`, lowest stack_free first
+ */
+uint32_t telemetry_get_tasks(telemetry_task_t *tasks, uint32_t max);
+
+/**
+ * @brief Load of each core since the previous task snapshot, -1 where the idle task is unknown.
+ */
+void telemetry_get_core_loads(float loads[portNUM_PROCESSORS]);
+
+void telemetry_get_heap(telemetry_heap_region_t region, telemetry_heap_t *heap);
+
+/**
+ * @brief Occupancy of the watched queues since the previous call, which starts a new window.
+ *
+ * @return queues written to `queues`
+ */
+uint32_t telemetry_get_queues(telemetry_queue_t *queues, uint32_t max);
+
+/**
+ * @brief Log the core loads, the tasks closest to overflowing their stack, the heaps and the
+ *        queue occupancy on one line, and start a new window.
+ */
+void telemetry_log_summary();
+
+/**
+ * @brief Register the `telemetry` console command and start sampling, logging a summary every period_ms.
+ */
+void telemetry_start(uint32_t period_ms = TELEMETRY_LOG_PERIOD);
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+
+#define TRACKER_ALPHA 0.5F                 // Weight of a new detection on the box position
+#define TRACKER_BETA 0.1F                  // Weight of a new detection on the box velocity
+#define TRACKER_PREDICTION_TIMEOUT 600000  // us the box keeps being predicted without a detection
+
+typedef struct
+{
+    float left;
+    float top;
+    float right;
+    float bottom;
+} tracker_box_t;
+
+/**
+ * @brief Constant-velocity (alpha-beta) filter over the target bounding box. It smooths
+ *        the detections and extrapolates the box on frames where detection is skipped
+ *        or finds nothing, with a confidence that decays as the prediction ages.
+ */
+class BoxTracker
+{
+private:
+    float position[4]; // center x, center y, width, height in pixels
+    float velocity[4]; // in pixels/s
+    int64_t state_time;
+    int64_t measurement_time;
+
+public:
+    bool active;
+
+    BoxTracker();
+
+    void reset();
+
+    /**
+     * @brief Correct the track with a detected box.
+     *
+     * @param box     detected box in frame coordinates
+     * @param time_us capture time of the frame it was detected on
+     */
+    void update(const tracker_box_t &box, int64_t time_us);
+
+    /**
+     * @brief End the track if TRACKER_PREDICTION_TIMEOUT passed without a detection.
+     *
+     * @param time_us capture time of the current frame
+     * @return whether the track is still active
+     */
+    bool expire(int64_t time_us);
+
+    /**
+     * @brief Estimate the box at a given time without changing the track.
+     *
+     * @param time_us    capture time of the frame to predict for
+     * @param box        estimated box in frame coordinates
+     * @param confidence 1 on a detection, decaying linearly to 0 after TRACKER_PREDICTION_TIMEOUT
+     * @return false if there is no track or it timed out
+     */
+    bool predict(int64_t time_us, tracker_box_t *box, float *confidence) const;
+};
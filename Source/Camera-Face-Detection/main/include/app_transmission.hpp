@@ -3,13 +3,79 @@
 #include "__base__.hpp"
 #include "esp_now.h"
 
+#define TRANSMISSION_PERIOD 100         // ms between two frames sent to the Alvik
+#define TRANSMISSION_ORDERS_TIMEOUT 500 // ms the latest orders are repeated as heartbeats before no-target is sent instead
+#define TRANSMISSION_LINK_TIMEOUT 500   // ms without a heartbeat from the Alvik before the link is reported down
+#define TRANSMISSION_MAX_RETRIES 2      // resends of the newest frame the Alvik did not acknowledge, within its period
+#define TRANSMISSION_IN_FLIGHT 8        // frames handed to the radio and waiting for their send callback, no more are sent until one comes
+#define TRANSMISSION_CALLBACK_TIMEOUT 1000 // ms a send callback can take before it is taken as lost, with those of the frames after it
+#define TRANSMISSION_SEND_LOG 16        // latest sequence numbers whose send time is kept to time the echoes
+#define TRANSMISSION_STATS_PERIOD 10000 // ms between two radio statistics lines
+
+typedef struct
+{
+    uint8_t peer[ESP_NOW_ETH_ALEN]; // the paired Alvik, all zero before pairing
+    uint32_t sent;                  // frames handed to the radio, resends included
+    uint32_t delivered;             // acknowledged by the Alvik
+    uint32_t failed;                // not acknowledged, after the radio's own retries
+    uint32_t retries;               // resends of the newest frame after it failed
+    uint32_t send_errors;           // frames esp_now_send() refused
+    uint32_t held;                  // frames not sent while TRANSMISSION_IN_FLIGHT others waited for their send callback
+    uint32_t echoes;                // heartbeats echoing a frame still in the send log, the RTT samples
+    int64_t rtt_total_us;
+    int64_t rtt_max_us;
+    int64_t longest_gap_us; // between two acknowledged frames, the longest the Alvik went without orders
+    int8_t rssi;            // of the last frame from the Alvik, dBm
+    int8_t rssi_min;
+} transmission_stats_t;
+
+/**
+ * @brief Sends the movement orders at a fixed rate. queue_i_movement_orders is a
+ *        single-slot queue AppFace overwrites, so only the newest orders are sent;
+ *        a period without new orders repeats the last ones as a heartbeat. Once paired
+ *        a frame goes out every period, a no-target one when there is no face to follow,
+ *        so the Alvik can stop as soon as frames stop coming.
+ *
+ *        Every frame's send callback is matched with its sequence number; when the
+ *        newest one is not acknowledged it is sent again, up to TRANSMISSION_MAX_RETRIES
+ *        times before the next period. The callbacks carry no sequence number, only their
+ *        order, so nothing is sent while TRANSMISSION_IN_FLIGHT frames wait for theirs. The Alvik echoes each sequence number in its
+ *        heartbeat, which times the round trip.
+ */
 class AppTransmission
 {
 public:
     QueueHandle_t queue_i_movement_orders;
     uint32_t channel;
+    uint32_t period_ms;
+    uint32_t stats_period_ms; // between two link statistics lines, TRANSMISSION_STATS_PERIOD
+    bool radio_ready;
+    bool link_alive; // the Alvik sent a heartbeat within TRANSMISSION_LINK_TIMEOUT
+
+    AppTransmission(uint32_t channel, QueueHandle_t queue_i_movement_orders = nullptr, uint32_t period_ms = TRANSMISSION_PERIOD);
 
-    AppTransmission(uint32_t channel, QueueHandle_t queue_i_movement_orders = nullptr);
+    /**
+     * @brief Bring up NVS, Wi-Fi and ESP-NOW and listen for the Alvik's broadcast. Called by
+     *        the task if nobody did before, so boot can run it alongside the other drivers.
+     */
+    void init();
 
     void run();
-};
\ No newline at end of file
+};
+
+/**
+ * @brief Link statistics since the previous reset: delivery, retries, round trip and signal.
+ */
+void transmission_get_stats(transmission_stats_t *stats);
+
+void transmission_reset_stats();
+
+/**
+ * @brief Log the link statistics on one line.
+ */
+void transmission_log_stats();
+
+/**
+ * @brief Register the `radio` console command.
+ */
+void transmission_register_commands();
\ No newline at end of file
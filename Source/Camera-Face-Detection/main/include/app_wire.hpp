@@ -0,0 +1,81 @@
+#pragma once
+
+#include "__base__.hpp"
+
+#define WIRE_MAGIC 0xA1CA            // First two bytes of every binary frame, sent as CA A1: not ASCII, so the text handshakes can't be mistaken for it
+#define WIRE_VERSION 2               // 2 added the frame kind and the Alvik's heartbeat
+#define WIRE_ROTATION_SCALE 100      // LSB per deg/s
+#define WIRE_DISPLACEMENT_SCALE 100  // LSB per cm/s
+#define WIRE_CONFIDENCE_SCALE 255    // LSB per unit of confidence
+
+typedef enum
+{
+    WIRE_KIND_ORDERS = 0,      // new orders on a followed face
+    WIRE_KIND_HEARTBEAT,       // no new orders this period, the last ones are repeated
+    WIRE_KIND_NO_TARGET,       // no face to follow, the Alvik stops
+    WIRE_KIND_ALVIK_HEARTBEAT, // from the Alvik, a wire_heartbeat_t
+} wire_kind_t;
+
+/**
+ * @brief Movement orders as sent over ESP-NOW, little endian. Mirrored by
+ *        MOVEMENT_ORDERS_FORMAT in Source/Alvik/camera_comms.py. The camera sends one
+ *        every period once paired, whether or not it has new orders.
+ */
+typedef struct __attribute__((packed))
+{
+    uint16_t magic;
+    uint8_t version;
+    uint8_t kind;                 // wire_kind_t
+    uint16_t sequence;            // incremented for every frame sent, wraps around
+    uint32_t capture_time;        // low 32 bits of the esp_timer capture time, us
+    int16_t horizontal_rotation;  // WIRE_ROTATION_SCALE fixed point
+    int16_t vertical_rotation;    // WIRE_ROTATION_SCALE fixed point
+    int16_t forward_displacement; // WIRE_DISPLACEMENT_SCALE fixed point
+    uint8_t confidence;           // 0..WIRE_CONFIDENCE_SCALE
+} wire_movement_orders_t;
+
+static_assert(sizeof(wire_movement_orders_t) == 17, "wire_movement_orders_t layout changed, update camera_comms.py");
+
+/**
+ * @brief Sent by the Alvik every period so the camera knows it is listening. Mirrored by
+ *        HEARTBEAT_FORMAT in Source/Alvik/camera_comms.py.
+ */
+typedef struct __attribute__((packed))
+{
+    uint16_t magic;
+    uint8_t version;
+    uint8_t kind;      // WIRE_KIND_ALVIK_HEARTBEAT
+    uint16_t sequence; // of the last movement orders frame the Alvik received
+} wire_heartbeat_t;
+
+static_assert(sizeof(wire_heartbeat_t) == 6, "wire_heartbeat_t layout changed, update camera_comms.py");
+
+/**
+ * @brief Pack movement orders; out of range amounts saturate. A NO_TARGET frame carries
+ *        no movement whatever the orders.
+ *
+ * @param orders   orders from AppFace
+ * @param kind     WIRE_KIND_ORDERS, WIRE_KIND_HEARTBEAT or WIRE_KIND_NO_TARGET
+ * @param sequence sequence number of this frame
+ * @param frame    packed frame to send
+ */
+void wire_encode_orders(const movement_orders_t &orders, wire_kind_t kind, uint16_t sequence, wire_movement_orders_t *frame);
+
+/**
+ * @brief Unpack a received frame.
+ *
+ * @param data     received bytes
+ * @param len      number of received bytes
+ * @param orders   unpacked orders, captureTime holds the 32 bit capture time
+ * @param sequence sequence number of the frame, may be nullptr
+ * @param kind     kind of the frame, may be nullptr
+ * @return false if the bytes are not a movement orders frame of this version
+ */
+bool wire_decode_orders(const uint8_t *data, size_t len, movement_orders_t *orders, uint16_t *sequence, wire_kind_t *kind = nullptr);
+
+void wire_encode_heartbeat(uint16_t sequence, wire_heartbeat_t *frame);
+
+/**
+ * @return false if the bytes are not an Alvik heartbeat of this version
+ */
+bool wire_decode_heartbeat(const uint8_t *data, size_t len, uint16_t *sequence);
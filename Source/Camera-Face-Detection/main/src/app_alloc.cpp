@@ -0,0 +1,130 @@
+#include "app_alloc.hpp"
+
+#include <atomic>
+#include <string.h>
+
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_console.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+static const char TAG[] = "App/Alloc";
+
+typedef struct
+{
+    TaskHandle_t task;
+    alloc_scope_t scope; // only written by the task itself
+} alloc_task_t;
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static alloc_task_t tasks[ALLOC_MAX_TASKS] = {};
+static std::atomic<uint32_t> task_count(0); // entries of tasks[] filled in, published after the entry
+static std::atomic<uint32_t> allocations[ALLOC_SCOPE_MAX];
+static std::atomic<uint32_t> bytes[ALLOC_SCOPE_MAX];
+
+static IRAM_ATTR alloc_task_t *find(TaskHandle_t task)
+{
+    uint32_t count = task_count.load(std::memory_order_acquire);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (tasks[i].task == task)
+            return &tasks[i];
+    }
+    return nullptr;
+}
+
+#if CONFIG_HEAP_USE_HOOKS
+// Called by the heap after every successful allocation, from any task
+extern "C" void IRAM_ATTR esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    if (task_count.load(std::memory_order_relaxed) == 0)
+        return;
+    alloc_task_t *entry = find(xTaskGetCurrentTaskHandle());
+    if (entry == nullptr)
+        return;
+    allocations[entry->scope].fetch_add(1, std::memory_order_relaxed);
+    bytes[entry->scope].fetch_add(size, std::memory_order_relaxed);
+}
+
+extern "C" void IRAM_ATTR esp_heap_trace_free_hook(void *ptr)
+{
+}
+#endif
+
+void alloc_watch()
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    portENTER_CRITICAL(&lock);
+    uint32_t count = task_count.load(std::memory_order_relaxed);
+    if (find(task) == nullptr && count < ALLOC_MAX_TASKS)
+    {
+        tasks[count] = {task, ALLOC_SCOPE_APP};
+        task_count.store(count + 1, std::memory_order_release);
+        task = nullptr;
+    }
+    portEXIT_CRITICAL(&lock);
+
+    if (task)
+        ESP_LOGW(TAG, "Not counting the allocations of %s, %d tasks are watched at most", pcTaskGetName(task), ALLOC_MAX_TASKS);
+}
+
+alloc_scope_t alloc_enter(alloc_scope_t scope)
+{
+    alloc_task_t *entry = find(xTaskGetCurrentTaskHandle());
+    if (entry == nullptr)
+        return ALLOC_SCOPE_APP;
+    alloc_scope_t previous = entry->scope;
+    entry->scope = scope;
+    return previous;
+}
+
+void alloc_get_stats(alloc_stats_t *stats)
+{
+    for (int scope = 0; scope < ALLOC_SCOPE_MAX; scope++)
+    {
+        stats->allocations[scope] = allocations[scope].load();
+        stats->bytes[scope] = bytes[scope].load();
+    }
+    stats->tasks = task_count.load();
+}
+
+void alloc_reset()
+{
+    for (int scope = 0; scope < ALLOC_SCOPE_MAX; scope++)
+    {
+        allocations[scope].store(0);
+        bytes[scope].store(0);
+    }
+}
+
+static int alloc_command(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "reset") == 0)
+    {
+        alloc_reset();
+        return 0;
+    }
+#if !CONFIG_HEAP_USE_HOOKS
+    ESP_LOGW(TAG, "CONFIG_HEAP_USE_HOOKS is off, nothing is counted");
+#endif
+    alloc_stats_t stats;
+    alloc_get_stats(&stats);
+    ESP_LOGI(TAG, "%u tasks watched: %u allocations (%u bytes) in the application, %u (%u bytes) in ESP-WHO",
+             (unsigned)stats.tasks, (unsigned)stats.allocations[ALLOC_SCOPE_APP], (unsigned)stats.bytes[ALLOC_SCOPE_APP],
+             (unsigned)stats.allocations[ALLOC_SCOPE_LIBRARY], (unsigned)stats.bytes[ALLOC_SCOPE_LIBRARY]);
+    return 0;
+}
+
+void alloc_register_commands()
+{
+    const esp_console_cmd_t command = {
+        .command = "alloc",
+        .help = "Print the heap allocations made by the face detection tasks, 'alloc reset' clears the counts",
+        .hint = "[reset]",
+        .func = &alloc_command,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&command));
+}
@@ -0,0 +1,119 @@
+#include "app_arena.hpp"
+
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_console.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+static const char TAG[] = "App/Arena";
+
+static const char *const region_names[ARENA_MAX] = {"dma", "spiram"};
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t *regions[ARENA_MAX] = {};
+static arena_stats_t stats = {};
+static arena_buffer_t buffers[ARENA_MAX_BUFFERS] = {};
+
+void arena_init()
+{
+    if (regions[ARENA_DMA] || regions[ARENA_SPIRAM])
+        return;
+
+    regions[ARENA_DMA] = (uint8_t *)heap_caps_aligned_alloc(ARENA_ALIGN, ARENA_DMA_SIZE, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (regions[ARENA_DMA] == nullptr)
+    {
+        // The SPI driver bounces PSRAM buffers through internal memory, slower but it works
+        ESP_LOGW(TAG, "Internal DMA memory is not enough, the DMA region goes to PSRAM");
+        regions[ARENA_DMA] = (uint8_t *)heap_caps_aligned_alloc(ARENA_ALIGN, ARENA_DMA_SIZE, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
+        stats.dma_in_spiram = true;
+    }
+    regions[ARENA_SPIRAM] = (uint8_t *)heap_caps_aligned_alloc(ARENA_ALIGN, ARENA_SPIRAM_SIZE, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
+
+    stats.capacity[ARENA_DMA] = regions[ARENA_DMA] ? ARENA_DMA_SIZE : 0;
+    stats.capacity[ARENA_SPIRAM] = regions[ARENA_SPIRAM] ? ARENA_SPIRAM_SIZE : 0;
+    for (int region = 0; region < ARENA_MAX; region++)
+    {
+        if (regions[region] == nullptr)
+            ESP_LOGE(TAG, "Memory for the %s region is not enough", region_names[region]);
+    }
+}
+
+void *arena_alloc(arena_region_t region, size_t size, const char *owner)
+{
+    if (region >= ARENA_MAX)
+        return nullptr;
+
+    size_t rounded = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+    void *buffer = nullptr;
+    portENTER_CRITICAL(&lock);
+    if (stats.used[region] + rounded <= stats.capacity[region])
+    {
+        buffer = regions[region] + stats.used[region];
+        stats.used[region] += rounded;
+        if (stats.buffers < ARENA_MAX_BUFFERS)
+            buffers[stats.buffers] = {owner, region, size, buffer};
+        stats.buffers++;
+    }
+    else
+    {
+        stats.failed++;
+    }
+    portEXIT_CRITICAL(&lock);
+
+    if (buffer == nullptr)
+        ESP_LOGE(TAG, "No room for %u bytes of %s in the %s region, ARENA_%s_SIZE is too small", (unsigned)size, owner,
+                 region_names[region], region == ARENA_DMA ? "DMA" : "SPIRAM");
+    return buffer;
+}
+
+void arena_get_stats(arena_stats_t *out)
+{
+    portENTER_CRITICAL(&lock);
+    *out = stats;
+    portEXIT_CRITICAL(&lock);
+}
+
+void arena_log_report()
+{
+    arena_stats_t current;
+    arena_buffer_t listed[ARENA_MAX_BUFFERS];
+    portENTER_CRITICAL(&lock);
+    current = stats;
+    for (int i = 0; i < ARENA_MAX_BUFFERS; i++)
+        listed[i] = buffers[i];
+    portEXIT_CRITICAL(&lock);
+
+    for (int region = 0; region < ARENA_MAX; region++)
+    {
+        ESP_LOGI(TAG, "%-6s %6u of %6u bytes used%s", region_names[region], (unsigned)current.used[region],
+                 (unsigned)current.capacity[region], region == ARENA_DMA && current.dma_in_spiram ? ", in PSRAM" : "");
+    }
+    for (uint32_t i = 0; i < current.buffers && i < ARENA_MAX_BUFFERS; i++)
+    {
+        ESP_LOGI(TAG, "  %-6s %6u bytes at %p  %s", region_names[listed[i].region], (unsigned)listed[i].size, listed[i].buffer,
+                 listed[i].owner);
+    }
+    if (current.buffers > ARENA_MAX_BUFFERS)
+        ESP_LOGI(TAG, "  %u more buffers", (unsigned)(current.buffers - ARENA_MAX_BUFFERS));
+    if (current.failed)
+        ESP_LOGW(TAG, "%u buffers did not fit", (unsigned)current.failed);
+}
+
+static int arena_command(int argc, char **argv)
+{
+    arena_log_report();
+    return 0;
+}
+
+void arena_register_commands()
+{
+    const esp_console_cmd_t command = {
+        .command = "arena",
+        .help = "Print how much of each arena region is used and which buffers were handed out",
+        .hint = NULL,
+        .func = &arena_command,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&command));
+}
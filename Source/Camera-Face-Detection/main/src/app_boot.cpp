@@ -0,0 +1,113 @@
+#include "app_boot.hpp"
+
+#include <stdlib.h>
+#include <string>
+
+#include "esp_console.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char TAG[] = "App/Boot";
+
+static AppBoot *last_boot = nullptr;
+
+AppBoot::AppBoot() : group(xEventGroupCreate()),
+                     start_us(0),
+                     end_us(0)
+{
+    this->phases.reserve(BOOT_MAX_PHASES); // Phase tasks keep pointers into it
+}
+
+int AppBoot::add(const char *name, std::function<void()> init, std::initializer_list<int> depends, uint32_t stack_size)
+{
+    int id = static_cast<int>(this->phases.size());
+    if (id >= BOOT_MAX_PHASES)
+    {
+        ESP_LOGE(TAG, "No room for phase %s, %d phases at most", name, BOOT_MAX_PHASES);
+        abort();
+    }
+
+    EventBits_t bits = 0;
+    for (int depend : depends)
+    {
+        if (depend < 0 || depend >= id)
+        {
+            ESP_LOGE(TAG, "Phase %s depends on unknown phase %d", name, depend);
+            abort();
+        }
+        bits |= 1 << depend;
+    }
+    this->phases.push_back({name, init, static_cast<EventBits_t>(1 << id), bits, stack_size, this->group, 0, 0});
+    return id;
+}
+
+static void task(boot_phase_t *phase)
+{
+    if (phase->depends)
+        xEventGroupWaitBits(phase->group, phase->depends, pdFALSE, pdTRUE, portMAX_DELAY);
+    phase->start_us = esp_timer_get_time();
+    ESP_LOGD(TAG, "%s started", phase->name);
+    phase->init();
+    phase->end_us = esp_timer_get_time();
+    xEventGroupSetBits(phase->group, phase->bit);
+    vTaskDelete(nullptr);
+}
+
+void AppBoot::run()
+{
+    this->start_us = esp_timer_get_time();
+    EventBits_t all = 0;
+    for (boot_phase_t &phase : this->phases)
+    {
+        all |= phase.bit;
+        xTaskCreatePinnedToCore((TaskFunction_t)task, phase.name, phase.stack_size, &phase, BOOT_TASK_PRIORITY, nullptr, BOOT_CORE);
+    }
+    xEventGroupWaitBits(this->group, all, pdFALSE, pdTRUE, portMAX_DELAY);
+    this->end_us = esp_timer_get_time();
+
+    last_boot = this;
+    boot_log_summary();
+}
+
+void boot_log_summary()
+{
+    AppBoot *boot = last_boot;
+    if (boot == nullptr)
+    {
+        ESP_LOGI(TAG, "Not booted through AppBoot");
+        return;
+    }
+
+    int64_t serial_us = 0;
+    for (const boot_phase_t &phase : boot->phases)
+    {
+        std::string after;
+        for (const boot_phase_t &other : boot->phases)
+        {
+            if (phase.depends & other.bit)
+                after += std::string(after.empty() ? " after " : ", ") + other.name;
+        }
+        ESP_LOGI(TAG, "%-12s %5lld -> %5lld ms, %5lld ms%s", phase.name, (phase.start_us - boot->start_us) / 1000,
+                 (phase.end_us - boot->start_us) / 1000, (phase.end_us - phase.start_us) / 1000, after.c_str());
+        serial_us += phase.end_us - phase.start_us;
+    }
+    ESP_LOGI(TAG, "%u phases in %lld ms, %lld ms one after the other, ready %lld ms after reset",
+             (unsigned)boot->phases.size(), (boot->end_us - boot->start_us) / 1000, serial_us / 1000, boot->end_us / 1000);
+}
+
+static int boot_command(int argc, char **argv)
+{
+    boot_log_summary();
+    return 0;
+}
+
+void boot_register_commands()
+{
+    const esp_console_cmd_t command = {
+        .command = "boot",
+        .help = "Print when each boot phase started, how long it took and what it waited for",
+        .hint = NULL,
+        .func = &boot_command,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&command));
+}
@@ -2,7 +2,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "esp_console.h"
 #include "esp_timer.h"
 #include "esp_log.h"
 #include "soc/soc_caps.h"
@@ -29,12 +31,115 @@
 
 static adc_oneshot_unit_handle_t adc1_handle = NULL;
 
-#define PRESS_INTERVAL 500000
+#define PRESS_QUEUE_LENGTH 4 // Injected presses waiting for the button task
 
 static const char *TAG = "App/Button";
 
-AppButton::AppButton() : key_configs({{BUTTON_MENU, 2800, 3000}, {BUTTON_PLAY, 2250, 2450}, {BUTTON_UP, 300, 500}, {BUTTON_DOWN, 850, 1050}}),
-                         pressed(BUTTON_IDLE), menu(MENU_STOP_WORKING)
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static button_stats_t stats = {};
+
+ButtonDebouncer::ButtonDebouncer(const std::vector<key_config_t> *key_configs) : key_configs(key_configs),
+                                                                                 state(BUTTON_STATE_RELEASED),
+                                                                                 candidate(BUTTON_IDLE),
+                                                                                 count(0),
+                                                                                 next_action(INT64_MAX),
+                                                                                 glitches(0)
+{
+}
+
+const key_config_t *ButtonDebouncer::config(button_name_t button) const
+{
+    for (const key_config_t &key_config : *this->key_configs)
+        if (key_config.key == button)
+            return &key_config;
+    return nullptr;
+}
+
+uint32_t ButtonDebouncer::sample(int voltage, int64_t now, button_name_t *button, button_action_t *action)
+{
+    button_name_t reading = BUTTON_IDLE;
+    for (const key_config_t &key_config : *this->key_configs)
+    {
+        if ((voltage >= key_config.min) && (voltage <= key_config.max))
+        {
+            reading = key_config.key;
+            break;
+        }
+    }
+
+    *button = BUTTON_IDLE;
+    switch (this->state)
+    {
+    case BUTTON_STATE_RELEASED:
+        if (reading != BUTTON_IDLE)
+        {
+            this->state = BUTTON_STATE_PRESSING;
+            this->candidate = reading;
+            this->count = 1;
+        }
+        break;
+
+    case BUTTON_STATE_PRESSING:
+        if (reading == BUTTON_IDLE)
+        {
+            this->state = BUTTON_STATE_RELEASED;
+            this->glitches++;
+        }
+        else if (reading != this->candidate)
+        {
+            // Still settling, or passing through another button's range on the way
+            this->candidate = reading;
+            this->count = 1;
+            this->glitches++;
+        }
+        else if (++this->count >= BUTTON_DEBOUNCE_SAMPLES)
+        {
+            const key_config_t *key_config = this->config(reading);
+            this->state = BUTTON_STATE_PRESSED;
+            this->next_action = key_config->long_press ? now + key_config->long_press * 1000LL : INT64_MAX;
+            *button = reading;
+            *action = BUTTON_ACTION_PRESS;
+        }
+        break;
+
+    case BUTTON_STATE_PRESSED:
+    case BUTTON_STATE_RELEASING:
+        if (reading == this->candidate)
+        {
+            if (this->state == BUTTON_STATE_RELEASING)
+                this->glitches++;
+            this->state = BUTTON_STATE_PRESSED;
+            if (now >= this->next_action)
+            {
+                // Repeats are timed from the press, not from the sample that noticed the last one
+                const key_config_t *key_config = this->config(this->candidate);
+                *button = this->candidate;
+                *action = key_config->repeat ? BUTTON_ACTION_REPEAT : BUTTON_ACTION_LONG_PRESS;
+                this->next_action = key_config->repeat ? this->next_action + key_config->repeat * 1000LL : INT64_MAX;
+            }
+        }
+        else if (this->state == BUTTON_STATE_PRESSED)
+        {
+            this->state = BUTTON_STATE_RELEASING;
+            this->count = 1;
+        }
+        else if (++this->count >= BUTTON_DEBOUNCE_SAMPLES)
+        {
+            this->state = BUTTON_STATE_RELEASED;
+        }
+        break;
+    }
+
+    return this->state == BUTTON_STATE_RELEASED ? BUTTON_IDLE_INTERVAL : BUTTON_ACTIVE_INTERVAL;
+}
+
+AppButton::AppButton() : key_configs({{BUTTON_MENU, 2800, 3000, 0, 0},
+                                      {BUTTON_PLAY, 2250, 2450, 1000, 0},
+                                      {BUTTON_UP, 300, 500, 500, 150},
+                                      {BUTTON_DOWN, 850, 1050, 500, 150}}),
+                         debouncer(&this->key_configs),
+                         menu(MENU_STOP_WORKING),
+                         queue_presses(xQueueCreate(PRESS_QUEUE_LENGTH, sizeof(event_t)))
 {
     if (adc1_handle){
         ESP_LOGE(TAG, "Button adc has been initialized");
@@ -53,42 +158,62 @@ AppButton::AppButton() : key_configs({{BUTTON_MENU, 2800, 3000}, {BUTTON_PLAY, 2
     ESP_ERROR_CHECK(adc_oneshot_config_channel(adc1_handle, ADC1_EXAMPLE_CHAN0, &config));
 }
 
-static void task(AppButton *self)
+void AppButton::press(button_name_t button, uint8_t menu)
 {
-    int64_t backup_time = esp_timer_get_time();
-    int64_t last_time = esp_timer_get_time();
+    event_t event = {0, static_cast<uint8_t>(button), menu, BUTTON_ACTION_PRESS};
+    if (xQueueSend(this->queue_presses, &event, 0) != pdTRUE)
+        ESP_LOGW(TAG, "Press of button %d dropped", button);
+}
+
+static void publish(AppButton *self, button_name_t pressed, button_action_t action, uint8_t menu)
+{
+    static const char *actions[] = {"clicked", "long pressed", "repeated"};
+    ESP_LOGI(TAG, "Button[%d] is %s", pressed, actions[action]);
+    if (pressed == BUTTON_MENU && action == BUTTON_ACTION_PRESS)
+        self->menu = menu < MENU_MAX ? menu : (self->menu + 1) % MENU_MAX;
+    if (!self->publish(pressed, self->menu, action))
+        ESP_LOGW(TAG, "A subscriber is behind and misses events");
+
+    portENTER_CRITICAL(&lock);
+    stats.presses += action == BUTTON_ACTION_PRESS;
+    stats.long_presses += action == BUTTON_ACTION_LONG_PRESS;
+    stats.repeats += action == BUTTON_ACTION_REPEAT;
+    portEXIT_CRITICAL(&lock);
+}
 
-    uint8_t menu_count = 0;
+// Samples slowly until a button reads, then fast until it is released; waiting on the
+// press queue between samples lets injected presses through at once
+static void task(AppButton *self)
+{
+    uint32_t interval = BUTTON_IDLE_INTERVAL;
+    uint32_t glitches = 0;
+    TickType_t last_sample = xTaskGetTickCount();
 
     while (true)
     {
-        int voltage = 0;
-        ESP_ERROR_CHECK(adc_oneshot_read(adc1_handle, ADC1_EXAMPLE_CHAN0, &voltage));
-        backup_time = esp_timer_get_time();
-        for (auto key_config : self->key_configs)
+        TickType_t waited = xTaskGetTickCount() - last_sample;
+        TickType_t timeout = pdMS_TO_TICKS(interval) > waited ? pdMS_TO_TICKS(interval) - waited : 0;
+        event_t injected;
+        if (xQueueReceive(self->queue_presses, &injected, timeout) == pdTRUE)
         {
-            if ((voltage >= key_config.min) && (voltage <= key_config.max))
-            {
-                if (((backup_time - last_time) > PRESS_INTERVAL))
-                {
-                    self->pressed = key_config.key;
-                    ESP_LOGI(TAG, "Button[%d] is clicked", self->pressed);
-
-                    if (self->pressed == BUTTON_MENU)
-                    {
-                        self->menu++;
-                        self->menu %= (MENU_MAX);
-                    }
-
-                    last_time = backup_time;
-                    self->notify();
-
-                    self->pressed = BUTTON_IDLE;
-                    break;
-                }
-            }
+            publish(self, static_cast<button_name_t>(injected.button), BUTTON_ACTION_PRESS, injected.menu);
+            continue;
         }
-        vTaskDelay(pdMS_TO_TICKS(10));
+
+        int voltage = 0;
+        ESP_ERROR_CHECK(adc_oneshot_read(adc1_handle, ADC1_EXAMPLE_CHAN0, &voltage));
+        last_sample = xTaskGetTickCount();
+        button_name_t button;
+        button_action_t action;
+        interval = self->debouncer.sample(voltage, esp_timer_get_time(), &button, &action);
+        if (button != BUTTON_IDLE)
+            publish(self, button, action, MENU_MAX);
+
+        portENTER_CRITICAL(&lock);
+        stats.samples++;
+        stats.glitches += self->debouncer.glitches - glitches;
+        portEXIT_CRITICAL(&lock);
+        glitches = self->debouncer.glitches;
     }
 }
 
@@ -96,3 +221,39 @@ void AppButton::run()
 {
     xTaskCreatePinnedToCore((TaskFunction_t)task, TAG, 3 * 1024, this, 5, NULL, 0);
 }
+
+void button_get_stats(button_stats_t *out)
+{
+    portENTER_CRITICAL(&lock);
+    *out = stats;
+    portEXIT_CRITICAL(&lock);
+}
+
+static int button_command(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "reset") == 0)
+    {
+        portENTER_CRITICAL(&lock);
+        memset(&stats, 0, sizeof(stats));
+        portEXIT_CRITICAL(&lock);
+        return 0;
+    }
+
+    button_stats_t current;
+    button_get_stats(&current);
+    ESP_LOGI(TAG, "%lu samples, %lu presses, %lu long presses, %lu repeats, %lu glitches ignored",
+             (unsigned long)current.samples, (unsigned long)current.presses, (unsigned long)current.long_presses,
+             (unsigned long)current.repeats, (unsigned long)current.glitches);
+    return 0;
+}
+
+void button_register_commands()
+{
+    const esp_console_cmd_t command = {
+        .command = "button",
+        .help = "Print how often the buttons were sampled and what was pressed, 'button reset' clears the counts",
+        .hint = "[reset]",
+        .func = &button_command,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&command));
+}
@@ -3,6 +3,8 @@
 #include "esp_log.h"
 #include "esp_system.h"
 
+#include "app_frame_link.hpp"
+
 const static char TAG[] = "App/Camera";
 
 AppCamera::AppCamera(const pixformat_t pixel_fromat,
@@ -84,7 +86,7 @@ static void task(AppCamera *self)
 
         camera_fb_t *frame = esp_camera_fb_get();
         if (frame)
-            xQueueSend(self->queue_o, &frame, portMAX_DELAY);
+            frame_link_send(self->queue_o, frame);
     }
     ESP_LOGD(TAG, "Stop");
     vTaskDelete(nullptr);
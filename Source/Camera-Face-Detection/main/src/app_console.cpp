@@ -0,0 +1,27 @@
+#include "app_console.hpp"
+
+#include "esp_log.h"
+
+static const char TAG[] = "App/Console";
+
+AppConsole::AppConsole() : repl(nullptr)
+{
+    esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    repl_config.prompt = "alvik-cam>";
+
+#if CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG
+    esp_console_dev_usb_serial_jtag_config_t hw_config = ESP_CONSOLE_DEV_USB_SERIAL_JTAG_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_console_new_repl_usb_serial_jtag(&hw_config, &repl_config, &this->repl));
+#else
+    esp_console_dev_uart_config_t hw_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_console_new_repl_uart(&hw_config, &repl_config, &this->repl));
+#endif
+
+    ESP_ERROR_CHECK(esp_console_register_help_command());
+    ESP_LOGI(TAG, "Console ready, type 'help' for the list of commands");
+}
+
+void AppConsole::run()
+{
+    ESP_ERROR_CHECK(esp_console_start_repl(this->repl));
+}
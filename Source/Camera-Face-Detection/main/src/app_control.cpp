@@ -0,0 +1,104 @@
+#include "app_control.hpp"
+
+#include <cmath>
+
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_console.h"
+
+static const char TAG[] = "App/Control";
+
+typedef struct
+{
+    int32_t box[4];
+    int32_t width;
+    int32_t height;
+} control_sample_t;
+
+// Boxes of every size and position on a 240x240 frame, deterministic so runs compare
+static control_sample_t sample(uint32_t index)
+{
+    uint32_t hash = index * 2654435761u;
+    int32_t size = 16 + (hash >> 8) % 200;
+    int32_t left = (hash >> 16) % (240 - size);
+    int32_t top = (hash >> 4) % (240 - size);
+    return {{left, top, left + size, top + size * 5 / 4 < 239 ? top + size * 5 / 4 : 239}, 240, 240};
+}
+
+template <class N>
+static int64_t time_policy(uint32_t iterations, float *checksum)
+{
+    movement_orders_t orders;
+    float sum = 0;
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        control_sample_t s = sample(i);
+        control_compute_orders<N>(s.box[0], s.box[1], s.box[2], s.box[3], s.width, s.height, &orders);
+        sum += orders.horizontalRotationAmount + orders.verticalRotationAmount + orders.forwardDisplacementAmount;
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+    *checksum = sum;
+    return elapsed;
+}
+
+template <class N>
+static float max_error(uint32_t iterations)
+{
+    float error = 0;
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        movement_orders_t reference, orders;
+        control_sample_t s = sample(i);
+        control_compute_orders<ControlDouble>(s.box[0], s.box[1], s.box[2], s.box[3], s.width, s.height, &reference);
+        control_compute_orders<N>(s.box[0], s.box[1], s.box[2], s.box[3], s.width, s.height, &orders);
+        error = std::fmax(error, std::fabs(orders.horizontalRotationAmount - reference.horizontalRotationAmount));
+        error = std::fmax(error, std::fabs(orders.verticalRotationAmount - reference.verticalRotationAmount));
+        error = std::fmax(error, std::fabs(orders.forwardDisplacementAmount - reference.forwardDisplacementAmount));
+    }
+    return error;
+}
+
+template <class N>
+static void report(const char *name, uint32_t iterations, int64_t reference_us, float error)
+{
+    float checksum;
+    int64_t elapsed_us = time_policy<N>(iterations, &checksum);
+    double ns_per_call = elapsed_us * 1000.0 / iterations;
+    ESP_LOGI(TAG, "%-8s %8.1f ns/call %8.0f cycles/call %8.0f cycles saved  max error %.4f  (checksum %.1f)", name, ns_per_call,
+             ns_per_call * CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ / 1000.0, (reference_us - elapsed_us) * 1000.0 / iterations * CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ / 1000.0,
+             error, checksum);
+}
+
+float control_benchmark(uint32_t iterations)
+{
+    float checksum;
+    int64_t reference_us = time_policy<ControlDouble>(iterations, &checksum);
+    float float_error = max_error<ControlFloat>(iterations);
+    float fixed_error = max_error<ControlFixed<16>>(iterations);
+
+    ESP_LOGI(TAG, "Controller over %lu boxes, cycles at %d MHz", (unsigned long)iterations, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+    report<ControlDouble>("double", iterations, reference_us, 0);
+    report<ControlFloat>("float", iterations, reference_us, float_error);
+    report<ControlFixed<16>>("Q16.16", iterations, reference_us, fixed_error);
+    return std::fmax(float_error, fixed_error);
+}
+
+static int control_command(int argc, char **argv)
+{
+    uint32_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : CONTROL_BENCHMARK_ITERATIONS;
+    control_benchmark(iterations ? iterations : CONTROL_BENCHMARK_ITERATIONS);
+    return 0;
+}
+
+void control_register_commands()
+{
+    const esp_console_cmd_t command = {
+        .command = "control",
+        .help = "Compare the float and Q16.16 movement controllers with the double one and time them",
+        .hint = "[iterations]",
+        .func = &control_command,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&command));
+}
@@ -1,224 +1,542 @@
 #include "app_face.hpp"
 
+#include <algorithm>
 #include <list>
 
 #include "esp_log.h"
 #include "esp_camera.h"
+#include "esp_timer.h"
 
-#include "dl_image.hpp"
-#include "fb_gfx.h"
-
-#include "who_ai_utils.hpp"
+#include "app_alloc.hpp"
+#include "app_arena.hpp"
+#include "app_control.hpp"
+#include "app_frame_link.hpp"
+#include "app_latency.hpp"
+#include "app_led.hpp"
+#include "app_overlay.hpp"
+#include "app_recorder.hpp"
 
 static const char TAG[] = "App/Face";
 
-#define RGB565_MASK_RED 0xF800
-#define RGB565_MASK_GREEN 0x07E0
-#define RGB565_MASK_BLUE 0x001F
+AppFace::AppFace(AppButton *key,
+                 QueueHandle_t queue_i,
+                 QueueHandle_t queue_o,
+                 QueueHandle_t queue_o_movement_orders,
+                 QueueHandle_t queue_o_overlay,
+                 void (*callback)(camera_fb_t *)) : Frame(queue_i, queue_o, callback),
+                                                    detector(0.3F, 0.3F, 10, 0.3F),
+                                                    detector2(0.4F, 0.3F, 10),
+                                                    queue_o_movement_orders(queue_o_movement_orders),
+                                                    queue_o_overlay(queue_o_overlay),
+                                                    switch_on(false),
+                                                    roi_lock(portMUX_INITIALIZER_UNLOCKED),
+                                                    tracking(false),
+                                                    track_active(false),
+                                                    roi{0, 0, 0, 0},
+                                                    frames_since_rescan(0),
+                                                    scans_since_zoom(0),
+                                                    pipeline(FACE_PIPELINE),
+                                                    stages{},
+                                                    queue_free_stages(xQueueCreate(FACE_PIPELINE_SLOTS, sizeof(face_stage_t *))),
+                                                    queue_stages(xQueueCreate(FACE_PIPELINE_SLOTS, sizeof(face_stage_t *))),
+                                                    frames_since_detection(0),
+                                                    target_sent(false),
+                                                    has_results(false),
+                                                    last_results(nullptr)
+{
+    for (face_stage_t &stage : this->stages)
+    {
+        stage.detect_image = (uint16_t *)arena_alloc(ARENA_SPIRAM, FACE_DETECT_SIDE * FACE_DETECT_SIDE * sizeof(uint16_t), "face detect image");
+        if (stage.detect_image == nullptr)
+            ESP_LOGE(TAG, "No detection image for a pipeline slot, it searches full frames only");
+        face_stage_t *slot = &stage;
+        xQueueSend(this->queue_free_stages, &slot, 0);
+    }
+    key->subscribe(&this->events);
+}
 
-#define FRAME_DELAY_NUM 16
+// Menu changes since the last frame; the state of the refinement stage is reset when this frame gets there
+static void take_events(AppFace *self, face_stage_t *stage)
+{
+    event_t event;
+    stage->restart = false;
+    while (self->events.poll(&event))
+    {
+        if (event.button != BUTTON_MENU || event.action != BUTTON_ACTION_PRESS)
+            continue;
+        self->switch_on = (event.menu == MENU_FACE_RECOGNITION);
+        portENTER_CRITICAL(&self->roi_lock);
+        self->tracking = false;
+        portEXIT_CRITICAL(&self->roi_lock);
+        led_set_status(LED_STATUS_DETECTING | LED_STATUS_TRACKING, self->switch_on ? LED_STATUS_DETECTING : 0);
+        self->motion_gate.reset();
+        self->has_results = false;
+        stage->restart = true;
+        ESP_LOGD(TAG, "%s", self->switch_on ? "ON" : "OFF");
+    }
+}
 
-static void rgb_print(camera_fb_t *fb, uint32_t color, const char *str)
+/**
+ * @brief Copy a region of the frame out as a standalone image for MSR01, downscaled to
+ *        at most FACE_DETECT_SIDE on its longer side.
+ *
+ * @param region left, top, right, bottom in frame coordinates, inclusive
+ * @param image  FACE_DETECT_SIDE x FACE_DETECT_SIDE pixels of room
+ */
+static void crop_region(const camera_fb_t *frame, const int region[4], uint16_t *image, int image_width, int image_height)
 {
-    fb_gfx_print(fb, (fb->width - (strlen(str) * 14)) / 2, 10, color, str);
+    const uint16_t *pixels = (const uint16_t *)frame->buf;
+    int region_width = region[2] - region[0] + 1;
+    int region_height = region[3] - region[1] + 1;
+    if (image_width == region_width)
+    {
+        for (int y = region[1]; y <= region[3]; y++)
+            memcpy(image + (y - region[1]) * image_width, pixels + y * frame->width + region[0], region_width * sizeof(uint16_t));
+        return;
+    }
+
+    // Nearest neighbour through a column table, like AppLCD's scaler
+    uint16_t column[FACE_DETECT_SIDE];
+    for (int x = 0; x < image_width; x++)
+        column[x] = region[0] + (2 * x + 1) * region_width / (2 * image_width);
+    for (int y = 0; y < image_height; y++)
+    {
+        const uint16_t *row = pixels + (region[1] + (2 * y + 1) * region_height / (2 * image_height)) * frame->width;
+        uint16_t *out = image + y * image_width;
+        for (int x = 0; x < image_width; x++)
+            out[x] = row[column[x]];
+    }
 }
 
-static int rgb_printf(camera_fb_t *fb, uint32_t color, const char *format, ...)
+// MSR01 works on a region of the frame, its boxes are brought back to frame coordinates for MNP01
+static void map_candidates_to_frame(FaceResults &candidates, const int region[4], int image_width, int image_height)
 {
-    char loc_buf[64];
-    char *temp = loc_buf;
-    int len;
-    va_list arg;
-    va_list copy;
-    va_start(arg, format);
-    va_copy(copy, arg);
-    len = vsnprintf(loc_buf, sizeof(loc_buf), format, arg);
-    va_end(copy);
-    if (len >= sizeof(loc_buf))
+    int region_width = region[2] - region[0] + 1;
+    int region_height = region[3] - region[1] + 1;
+    for (face_result_t &candidate : candidates)
     {
-        temp = (char *)malloc(len + 1);
-        if (temp == NULL)
-        {
-            return 0;
-        }
+        for (int i = 0; i < 4; i++)
+            candidate.box[i] = (i % 2 == 0) ? region[0] + candidate.box[i] * region_width / image_width
+                                            : region[1] + candidate.box[i] * region_height / image_height;
+        for (int i = 0; candidate.has_keypoints && i < FACE_RESULT_KEYPOINTS; i++)
+            candidate.keypoint[i] = (i % 2 == 0) ? region[0] + candidate.keypoint[i] * region_width / image_width
+                                                 : region[1] + candidate.keypoint[i] * region_height / image_height;
     }
-    vsnprintf(temp, len + 1, format, arg);
-    va_end(arg);
-    rgb_print(fb, color, temp);
-    if (len > 64)
+}
+
+// Pad the box around all the faces found and clip it to the frame; this is where the next frame is searched
+static void update_roi(AppFace *self, const camera_fb_t *frame, const FaceResults &results)
+{
+    int left = frame->width, top = frame->height, right = 0, bottom = 0;
+    for (const face_result_t &result : results)
     {
-        free(temp);
+        left = std::min(left, result.box[0]);
+        top = std::min(top, result.box[1]);
+        right = std::max(right, result.box[2]);
+        bottom = std::max(bottom, result.box[3]);
     }
-    return len;
+
+    int pad_x = static_cast<int>((right - left) * FACE_ROI_PADDING);
+    int pad_y = static_cast<int>((bottom - top) * FACE_ROI_PADDING);
+    int grow_x = std::max(0, FACE_ROI_MIN_SIZE - (right - left + 1 + 2 * pad_x)) / 2;
+    int grow_y = std::max(0, FACE_ROI_MIN_SIZE - (bottom - top + 1 + 2 * pad_y)) / 2;
+
+    portENTER_CRITICAL(&self->roi_lock);
+    self->roi[0] = std::max(0, left - pad_x - grow_x);
+    self->roi[1] = std::max(0, top - pad_y - grow_y);
+    self->roi[2] = std::min(static_cast<int>(frame->width) - 1, right + pad_x + grow_x);
+    self->roi[3] = std::min(static_cast<int>(frame->height) - 1, bottom + pad_y + grow_y);
+    portEXIT_CRITICAL(&self->roi_lock);
 }
 
-AppFace::AppFace(AppButton *key,
-                 QueueHandle_t queue_i,
-                 QueueHandle_t queue_o,
-                 QueueHandle_t queue_o_movement_orders,
-                 void (*callback)(camera_fb_t *)) : Frame(queue_i, queue_o, callback),
-                                                    key(key),
-                                                    detector(0.3F, 0.3F, 10, 0.3F),
-                                                    detector2(0.4F, 0.3F, 10),
-                                                    queue_o_movement_orders(queue_o_movement_orders),
-                                                    switch_on(false)
+static void set_tracking(AppFace *self, bool tracking)
 {
+    if (self->tracking != tracking)
+        ESP_LOGD(TAG, "%s", tracking ? "Tracking" : "Target lost");
+    portENTER_CRITICAL(&self->roi_lock);
+    self->tracking = tracking;
+    portEXIT_CRITICAL(&self->roi_lock);
+    led_set_status(LED_STATUS_TRACKING, tracking ? LED_STATUS_TRACKING : 0);
+}
+
+/**
+ * @brief Candidate stage: decide what the frame needs and run MSR01 on the ROI while tracking,
+ *        or on the whole frame for a rescan or after the ROI missed. Regions larger than
+ *        FACE_DETECT_SIDE are searched on a downscaled copy; candidates come out in frame coordinates.
+ */
+static void find_candidates(AppFace *self, face_stage_t *stage)
+{
+    camera_fb_t *frame = stage->frame;
+    stage->candidates.clear();
+    stage->search = FACE_SEARCH_FRAME;
+    stage->downscaled = false;
+
+    // Detection is skipped on FACE_DETECT_INTERVAL - 1 of every FACE_DETECT_INTERVAL frames while a track exists
+    portENTER_CRITICAL(&self->roi_lock);
+    bool track_active = self->track_active;
+    portEXIT_CRITICAL(&self->roi_lock);
+    if (track_active && ++self->frames_since_detection < FACE_DETECT_INTERVAL)
+    {
+        stage->mode = FACE_STAGE_PREDICT;
+        return;
+    }
+    self->frames_since_detection = 0;
+
+    // The ROI comes from the frame before the one being refined, its padding absorbs the lag
+    portENTER_CRITICAL(&self->roi_lock);
+    bool tracking = self->tracking;
+    memcpy(stage->region, self->roi, sizeof(stage->region));
+    portEXIT_CRITICAL(&self->roi_lock);
+
+    // While tracking only the ROI is watched, where a small face moving in a large frame still shows
+    const int whole_frame[4] = {0, 0, static_cast<int>(frame->width) - 1, static_cast<int>(frame->height) - 1};
+    bool moved = self->motion_gate.changed(frame, tracking ? stage->region : whole_frame);
+    if (self->has_results && !moved)
+    {
+        stage->mode = FACE_STAGE_REUSE;
+        return;
+    }
+    stage->mode = FACE_STAGE_DETECT;
+    self->has_results = true;
+
+    // Search the ROI while tracking; otherwise the whole frame, or now and then a window
+    // at native resolution in its center so a far away face can be picked up
+    int frame_width = frame->width;
+    int frame_height = frame->height;
+    bool zoomable = std::max(frame_width, frame_height) > FACE_DETECT_SIDE;
+    if (tracking && stage->detect_image && self->frames_since_rescan < FACE_ROI_RESCAN_INTERVAL)
+    {
+        self->frames_since_rescan++;
+        stage->search = FACE_SEARCH_ROI;
+    }
+    else if (!tracking && zoomable && stage->detect_image && FACE_ZOOM_INTERVAL && ++self->scans_since_zoom >= FACE_ZOOM_INTERVAL)
+    {
+        self->scans_since_zoom = 0;
+        stage->search = FACE_SEARCH_ZOOM;
+        int window_width = std::min(frame_width, FACE_DETECT_SIDE);
+        int window_height = std::min(frame_height, FACE_DETECT_SIDE);
+        stage->region[0] = (frame_width - window_width) / 2;
+        stage->region[1] = (frame_height - window_height) / 2;
+        stage->region[2] = stage->region[0] + window_width - 1;
+        stage->region[3] = stage->region[1] + window_height - 1;
+    }
+    else
+    {
+        self->frames_since_rescan = 0;
+        stage->search = FACE_SEARCH_FRAME;
+        stage->region[0] = 0;
+        stage->region[1] = 0;
+        stage->region[2] = frame_width - 1;
+        stage->region[3] = frame_height - 1;
+    }
+
+    int region_width = stage->region[2] - stage->region[0] + 1;
+    int region_height = stage->region[3] - stage->region[1] + 1;
+    int region_side = std::max(region_width, region_height);
+    int image_width = region_side > FACE_DETECT_SIDE ? std::max(1, region_width * FACE_DETECT_SIDE / region_side) : region_width;
+    int image_height = region_side > FACE_DETECT_SIDE ? std::max(1, region_height * FACE_DETECT_SIDE / region_side) : region_height;
+    stage->downscaled = image_width != region_width;
 
+    int64_t start = esp_timer_get_time();
+    if (stage->search == FACE_SEARCH_FRAME && (!stage->downscaled || stage->detect_image == nullptr))
+    {
+        stage->downscaled = false;
+        alloc_enter(ALLOC_SCOPE_LIBRARY);
+        std::list<dl::detect::result_t> &candidates = self->detector.infer((uint16_t *)frame->buf, {frame_height, frame_width, 3});
+        alloc_enter(ALLOC_SCOPE_APP);
+        stage->candidates.assign(candidates);
+    }
+    else
+    {
+        crop_region(frame, stage->region, stage->detect_image, image_width, image_height);
+        alloc_enter(ALLOC_SCOPE_LIBRARY);
+        std::list<dl::detect::result_t> &candidates = self->detector.infer(stage->detect_image, {image_height, image_width, 3});
+        alloc_enter(ALLOC_SCOPE_APP);
+        stage->candidates.assign(candidates);
+        map_candidates_to_frame(stage->candidates, stage->region, image_width, image_height);
+    }
+    stage->candidates_us = esp_timer_get_time() - start;
 }
 
-void AppFace::update()
+/**
+ * @brief Refinement stage: run MNP01 on the candidates and move the ROI.
+ *
+ * @return the frame's results in frame coordinates, the last ones when they are reused,
+ *         or nullptr when the detectors did not look at the frame
+ */
+static FaceResults *refine_candidates(AppFace *self, face_stage_t *stage)
 {
-    // Parse key
-    if (this->key->pressed > BUTTON_IDLE)
+    if (stage->mode == FACE_STAGE_REUSE)
+        return self->last_results;
+    if (stage->mode != FACE_STAGE_DETECT)
+        return nullptr;
+
+    // The candidates are in frame coordinates, MNP01 refines each from the full resolution frame
+    camera_fb_t *frame = stage->frame;
+    int64_t start = esp_timer_get_time();
+    std::list<dl::detect::result_t> &candidates = self->candidate_list.fill(stage->candidates);
+    alloc_enter(ALLOC_SCOPE_LIBRARY);
+    std::list<dl::detect::result_t> &refined = self->detector2.infer((uint16_t *)frame->buf, {(int)frame->height, (int)frame->width, 3}, candidates);
+    alloc_enter(ALLOC_SCOPE_APP);
+    FaceResults *results = &self->results;
+    results->assign(refined);
+    if (!results->empty())
+    {
+        set_tracking(self, true);
+        update_roi(self, frame, *results);
+    }
+    else if (stage->search == FACE_SEARCH_ROI)
     {
-        if (this->key->pressed == BUTTON_MENU)
+        // The candidate stage is already on a later frame, the next one it takes rescans
+        ESP_LOGD(TAG, "ROI missed, rescanning the full frame");
+        set_tracking(self, false);
+    }
+    else if (stage->search == FACE_SEARCH_FRAME && !stage->downscaled)
+    {
+        // A downscaled rescan can miss a face the ROI still sees at full resolution
+        set_tracking(self, false);
+    }
+    motion_record_inference(stage->candidates_us + esp_timer_get_time() - start);
+
+    self->last_results = results;
+    return results;
+}
+
+// Bounding box of all the faces found, in frame coordinates
+static tracker_box_t merge_boxes(const FaceResults &results, const camera_fb_t *frame)
+{
+    int32_t left_offset = static_cast<int32_t>(frame->width); // The minimum value, to be override by the first detection
+    int32_t right_offset = 0; // The maximum value, to be override by the first detection
+    int32_t top_offset = static_cast<int32_t>(frame->height); // The minimum value, to be override by the first detection
+    int32_t bottom_offset = 0; // The maximum value, to be override by the first detection
+
+    enum box_offset {left_up_x = 0, left_up_y, right_down_x, right_down_y};
+
+    for (const face_result_t &data : results)
+    {
+        ESP_LOGD(TAG, "box data: %d, %d, %d, %d", data.box[left_up_x], data.box[left_up_y], data.box[right_down_x], data.box[right_down_y]);
+
+        if(data.box[left_up_x] < left_offset)
+        {
+            left_offset = data.box[left_up_x];
+        }
+        if(data.box[left_up_y] < top_offset)
+        {
+            top_offset = data.box[left_up_y];
+        }
+        if(data.box[right_down_x] > right_offset)
+        {
+            right_offset = data.box[right_down_x];
+        }
+        if(data.box[right_down_y] > bottom_offset)
         {
-            this->switch_on = (this->key->menu == MENU_FACE_RECOGNITION);
-            ESP_LOGD(TAG, "%s", this->switch_on ? "ON" : "OFF");
+            bottom_offset = data.box[right_down_y];
         }
     }
+
+    return {static_cast<float>(left_offset), static_cast<float>(top_offset), static_cast<float>(right_offset), static_cast<float>(bottom_offset)};
 }
 
-static double fmap(double value, double in_min, double in_max, double out_min, double out_max)
+// Detections when the detectors ran on this frame, otherwise the tracker's box
+static const overlay_t *publish_overlay(AppFace *self, const camera_fb_t *frame, int64_t capture_time, const FaceResults *results,
+                            const tracker_box_t *target, float confidence)
 {
-    return (value - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+    static overlay_t overlay;
+    overlay.capture_time = capture_time;
+    overlay.width = frame->width;
+    overlay.height = frame->height;
+    overlay.count = 0;
+    overlay.text[0] = '\0';
+
+    if (results && !results->empty())
+    {
+        for (const face_result_t &result : *results)
+        {
+            if (overlay.count == OVERLAY_MAX_FACES)
+                break;
+            overlay_face_t &face = overlay.faces[overlay.count++];
+            for (int i = 0; i < 4; i++)
+                face.box[i] = result.box[i];
+            face.has_keypoints = result.has_keypoints && FACE_RESULT_KEYPOINTS >= OVERLAY_KEYPOINTS;
+            for (int i = 0; face.has_keypoints && i < OVERLAY_KEYPOINTS; i++)
+                face.keypoint[i] = result.keypoint[i];
+            face.predicted = false;
+        }
+        snprintf(overlay.text, sizeof(overlay.text), "%u face%s", static_cast<unsigned>(results->count), results->count == 1 ? "" : "s");
+    }
+    else if (target)
+    {
+        overlay_face_t &face = overlay.faces[overlay.count++];
+        face.box[0] = static_cast<int16_t>(target->left);
+        face.box[1] = static_cast<int16_t>(target->top);
+        face.box[2] = static_cast<int16_t>(target->right);
+        face.box[3] = static_cast<int16_t>(target->bottom);
+        face.has_keypoints = false;
+        face.predicted = true;
+        snprintf(overlay.text, sizeof(overlay.text), "tracking %d%%", static_cast<int>(confidence * 100));
+    }
+
+    if (self->queue_o_overlay)
+        xQueueOverwrite(self->queue_o_overlay, &overlay);
+    return &overlay;
 }
 
-static void task(AppFace *self)
+static void send_orders(AppFace *self, movement_orders_t *orders, int64_t capture_time)
 {
-    ESP_LOGD(TAG, "Start");
-    camera_fb_t *frame = nullptr;
+    orders->captureTime = capture_time;
+    orders->producedTime = esp_timer_get_time();
+    // Single-slot queue: newer orders replace the ones the sender has not taken yet
+    if (uxQueueMessagesWaiting(self->queue_o_movement_orders))
+        latency_count_coalesced();
+    xQueueOverwrite(self->queue_o_movement_orders, orders);
+    record_orders(orders);
+    self->target_sent = orders->target;
+}
 
-    while (true)
+// Results to the tracker, movement orders and overlay, then the frame and its slot go back
+static void finish_frame(AppFace *self, face_stage_t *stage)
+{
+    camera_fb_t *frame = stage->frame;
+    int64_t capture_time = latency_frame_time(frame);
+    bool tracked = false;
+    if (stage->restart)
+    {
+        self->box_tracker.reset();
+        self->last_results = nullptr;
+    }
+    if (stage->mode != FACE_STAGE_IDLE)
     {
-        if (self->queue_i == nullptr)
-            break;
+        FaceResults *detect_results = refine_candidates(self, stage);
+        if (detect_results && !detect_results->empty())
+        {
+            tracker_box_t box = merge_boxes(*detect_results, frame);
+            self->box_tracker.update(box, capture_time);
+        }
 
-        if (xQueueReceive(self->queue_i, &frame, portMAX_DELAY))
+        tracker_box_t target;
+        float confidence = 0;
+        self->box_tracker.expire(capture_time);
+        tracked = self->box_tracker.predict(capture_time, &target, &confidence);
+        if(self->queue_o_movement_orders && tracked) // Process the tracked box and send the movement orders
         {
-            if (self->switch_on)
-            {
-                std::list<dl::detect::result_t>& detect_candidates = self->detector.infer((uint16_t *)frame->buf, {(int)frame->height, (int)frame->width, 3});
-                std::list<dl::detect::result_t>& detect_results = self->detector2.infer((uint16_t *)frame->buf, {(int)frame->height, (int)frame->width, 3}, detect_candidates);
-
-                if(self->queue_o_movement_orders && !detect_results.empty()) // Process the detection results and send the movement orders
-                {
-                    int32_t left_offset = static_cast<int32_t>(frame->width); // The minimum value, to be override by the first detection
-                    int32_t right_offset = 0; // The maximum value, to be override by the first detection
-                    int32_t top_offset = static_cast<int32_t>(frame->height); // The minimum value, to be override by the first detection
-                    int32_t bottom_offset = 0; // The maximum value, to be override by the first detection
-
-                    enum box_offset {left_up_x = 0, left_up_y, right_down_x, right_down_y};
-
-                    for(auto data : detect_results)
-                    {
-                        ESP_LOGD(TAG, "box data: %d, %d, %d, %d", data.box[left_up_x], data.box[left_up_y], data.box[right_down_x], data.box[right_down_y]);
-
-                        if(data.box[left_up_x] < left_offset)
-                        {
-                            left_offset = data.box[left_up_x];
-                        }
-                        if(data.box[left_up_y] < top_offset)
-                        {
-                            top_offset = data.box[left_up_y];
-                        }
-                        if(data.box[right_down_x] > right_offset)
-                        {
-                            right_offset = data.box[right_down_x];
-                        }
-                        if(data.box[right_down_y] > bottom_offset)
-                        {
-                            bottom_offset = data.box[right_down_y];
-                        }
-                    }
-
-                    double right_proportion = static_cast<double>(right_offset) / frame->width;
-                    double left_proportion = static_cast<double>(left_offset) / frame->width;
-                    double top_proportion = static_cast<double>(top_offset) / frame->height;
-                    double bottom_proportion = static_cast<double>(bottom_offset) / frame->height;
-
-                    uint32_t area = (right_offset - left_offset) * (bottom_offset - top_offset);
-                    double area_proportion = static_cast<double>(area) / (frame->width * frame->height);
-
-                    ESP_LOGW(TAG, "area: %lu, area_proportion: %f,\nleft_proportion: %f, right_proportion: %f, top_proportion: %f, bottom_proportion: %f,\nleft_offset: %lu, right_offset: %lu, top_offset: %lu, bottom_offset: %lu",
-                             area, area_proportion, left_proportion, right_proportion, top_proportion, bottom_proportion, left_offset, right_offset, top_offset, bottom_offset);
-
-                    #define TARGET_HORIZONTAL_EXCLUSION_PROPORTION 0.3
-                    #define MAX_HORIZONTAL_ROTATION_MOVEMENT 30.0
-                    #define MIN_HORIZONTAL_ROTATION_MOVEMENT 1.0
-
-                    static movement_orders_t movementOrders = {};
-
-                    if(left_proportion < TARGET_HORIZONTAL_EXCLUSION_PROPORTION)
-                    {
-                        movementOrders.horizontalRotationAmount = fmap(left_proportion, 0, TARGET_HORIZONTAL_EXCLUSION_PROPORTION, -MAX_HORIZONTAL_ROTATION_MOVEMENT, -MIN_HORIZONTAL_ROTATION_MOVEMENT);
-                    }
-                    else if(right_proportion > 1 - TARGET_HORIZONTAL_EXCLUSION_PROPORTION)
-                    {
-                        movementOrders.horizontalRotationAmount = fmap(right_proportion, 1 - TARGET_HORIZONTAL_EXCLUSION_PROPORTION, 1, MIN_HORIZONTAL_ROTATION_MOVEMENT, MAX_HORIZONTAL_ROTATION_MOVEMENT);
-                    }
-                    else
-                    {
-                        movementOrders.horizontalRotationAmount = 0;
-                    }
-
-                    // VERTICAL ROTATION UNTESTED
-                    #define TARGET_VERTICAL_EXCLUSION_PROPORTION 0.20
-                    #define MAX_VERTICAL_ROTATION_MOVEMENT 30.0
-                    #define MIN_VERTICAL_ROTATION_MOVEMENT 1.0
-
-                    if(top_proportion < TARGET_VERTICAL_EXCLUSION_PROPORTION)
-                    {
-                        movementOrders.verticalRotationAmount = fmap(top_proportion, 0, TARGET_VERTICAL_EXCLUSION_PROPORTION, -MAX_VERTICAL_ROTATION_MOVEMENT, -MIN_VERTICAL_ROTATION_MOVEMENT);
-                    }
-                    else if(bottom_proportion > 1 - TARGET_VERTICAL_EXCLUSION_PROPORTION)
-                    {
-                        movementOrders.verticalRotationAmount = fmap(bottom_proportion, 1 - TARGET_VERTICAL_EXCLUSION_PROPORTION, 1, MIN_VERTICAL_ROTATION_MOVEMENT, MAX_VERTICAL_ROTATION_MOVEMENT);
-                    }
-                    else
-                    {
-                        movementOrders.verticalRotationAmount = 0;
-                    }
-
-                    #define TARGET_AREA_PROPORTION 0.15
-                    #define TARGET_AREA_PROPORTION_TOLERANCE 0.05
-                    #define MAX_FORWARD_MOVEMENT 20.0
-                    #define MIN_FORWARD_MOVEMENT 0.5
-                    #define MAX_AREA_PROPORTION ((2*TARGET_AREA_PROPORTION) + TARGET_AREA_PROPORTION_TOLERANCE)
-
-                    if(area_proportion < TARGET_AREA_PROPORTION - TARGET_AREA_PROPORTION_TOLERANCE)
-                    {
-                        movementOrders.forwardDisplacementAmount = fmap(area_proportion, 0, TARGET_AREA_PROPORTION - TARGET_AREA_PROPORTION_TOLERANCE, MAX_FORWARD_MOVEMENT, MIN_FORWARD_MOVEMENT);
-                    }
-                    else if(area_proportion > TARGET_AREA_PROPORTION + TARGET_AREA_PROPORTION_TOLERANCE)
-                    {
-                        movementOrders.forwardDisplacementAmount = fmap(area_proportion, TARGET_AREA_PROPORTION + TARGET_AREA_PROPORTION_TOLERANCE, MAX_AREA_PROPORTION, -MIN_FORWARD_MOVEMENT, -MAX_FORWARD_MOVEMENT);
-                    }
-                    else
-                    {
-                        movementOrders.forwardDisplacementAmount = 0;
-                    }
-
-                    xQueueSend(self->queue_o_movement_orders, &movementOrders, portMAX_DELAY);
-                }
-
-                if (!detect_results.empty())
-                {
-                    draw_detection_result((uint16_t *)frame->buf, frame->height, frame->width, detect_results);
-                }
-            }
-
-            if (self->queue_o)
-                xQueueSend(self->queue_o, &frame, portMAX_DELAY);
-            else
-                self->callback(frame);
+            // A predicted box can drift past the frame edges
+            int32_t left_offset = std::max(0, static_cast<int32_t>(target.left));
+            int32_t right_offset = std::min(static_cast<int32_t>(frame->width) - 1, static_cast<int32_t>(target.right));
+            int32_t top_offset = std::max(0, static_cast<int32_t>(target.top));
+            int32_t bottom_offset = std::min(static_cast<int32_t>(frame->height) - 1, static_cast<int32_t>(target.bottom));
+            right_offset = std::max(right_offset, left_offset);
+            bottom_offset = std::max(bottom_offset, top_offset);
+
+            ESP_LOGD(TAG, "left_offset: %ld, right_offset: %ld, top_offset: %ld, bottom_offset: %ld", left_offset, right_offset, top_offset, bottom_offset);
+
+            static movement_orders_t movementOrders = {};
+            control_compute_orders<ControlNumeric>(left_offset, top_offset, right_offset, bottom_offset, frame->width, frame->height, &movementOrders);
+
+            movementOrders.confidence = confidence;
+            movementOrders.target = true;
+            send_orders(self, &movementOrders, capture_time);
         }
+
+        // The frame itself is never drawn on, AppLCD composites the results over it
+        const overlay_t *overlay = publish_overlay(self, frame, capture_time, detect_results, tracked ? &target : nullptr, confidence);
+
+        int64_t elapsed = esp_timer_get_time() - stage->start_time;
+        latency_record(LATENCY_STAGE_FACE, elapsed);
+        record_results(overlay, elapsed);
+    }
+    portENTER_CRITICAL(&self->roi_lock);
+    self->track_active = self->box_tracker.active;
+    portEXIT_CRITICAL(&self->roi_lock);
+
+    // The track ran out or detection was switched off: tell the Alvik to stop now rather
+    // than let it find out from the orders going stale
+    if (self->queue_o_movement_orders && self->target_sent && !tracked)
+    {
+        ESP_LOGD(TAG, "No target, sending a stop");
+        movement_orders_t no_target = {};
+        send_orders(self, &no_target, capture_time);
+    }
+
+    if (self->queue_o)
+        frame_link_send(self->queue_o, frame);
+    else
+        self->callback(frame);
+
+    xQueueSend(self->queue_free_stages, &stage, portMAX_DELAY);
+}
+
+// Waits for a free slot first, so the frame taken is the newest one the link has by then
+static face_stage_t *take_frame(AppFace *self)
+{
+    face_stage_t *stage = nullptr;
+    xQueueReceive(self->queue_free_stages, &stage, portMAX_DELAY);
+    if (!frame_link_receive(self->queue_i, &stage->frame, portMAX_DELAY))
+    {
+        xQueueSend(self->queue_free_stages, &stage, portMAX_DELAY);
+        return nullptr;
+    }
+
+    stage->start_time = esp_timer_get_time();
+    latency_record(LATENCY_HOP_CAPTURE_TO_FACE, stage->start_time - latency_frame_time(stage->frame));
+    take_events(self, stage);
+    if (self->switch_on)
+        find_candidates(self, stage);
+    else
+        stage->mode = FACE_STAGE_IDLE;
+    return stage;
+}
+
+// Both stages in one task, a frame is done before the next one is taken
+static void task(AppFace *self)
+{
+    ESP_LOGD(TAG, "Start");
+    alloc_watch();
+    while (self->queue_i)
+    {
+        face_stage_t *stage = take_frame(self);
+        if (stage)
+            finish_frame(self, stage);
     }
     ESP_LOGD(TAG, "Stop");
     vTaskDelete(nullptr);
 }
 
+static void candidates_task(AppFace *self)
+{
+    ESP_LOGD(TAG, "Candidate stage start");
+    alloc_watch();
+    while (self->queue_i)
+    {
+        face_stage_t *stage = take_frame(self);
+        if (stage)
+            xQueueSend(self->queue_stages, &stage, portMAX_DELAY);
+    }
+    ESP_LOGD(TAG, "Candidate stage stop");
+    vTaskDelete(nullptr);
+}
+
+static void refine_task(AppFace *self)
+{
+    ESP_LOGD(TAG, "Refinement stage start");
+    alloc_watch();
+    face_stage_t *stage = nullptr;
+    while (true)
+    {
+        if (xQueueReceive(self->queue_stages, &stage, portMAX_DELAY) == pdTRUE)
+            finish_frame(self, stage);
+    }
+}
+
 void AppFace::run()
 {
-    xTaskCreatePinnedToCore((TaskFunction_t)task, TAG, 8 * 1024, this, 5, nullptr, 1);
-}
\ No newline at end of file
+    if (this->pipeline)
+    {
+        // MSR01 shares core 0 with the camera and the fanout, below them so capture is never held up
+        xTaskCreatePinnedToCore((TaskFunction_t)candidates_task, "App/Face/MSR01", 8 * 1024, this, 4, nullptr, 0);
+        xTaskCreatePinnedToCore((TaskFunction_t)refine_task, "App/Face/MNP01", 8 * 1024, this, 5, nullptr, 1);
+    }
+    else
+    {
+        xTaskCreatePinnedToCore((TaskFunction_t)task, TAG, 8 * 1024, this, 5, nullptr, 1);
+    }
+}
@@ -0,0 +1,45 @@
+#include "app_fanout.hpp"
+
+#include "esp_log.h"
+
+static const char TAG[] = "App/Fanout";
+
+AppFanout::AppFanout(QueueHandle_t queue_i,
+                     std::vector<QueueHandle_t> queues_o,
+                     void (*callback)(camera_fb_t *)) : Frame(queue_i, nullptr, callback),
+                                                        queues_o(queues_o)
+{
+}
+
+static void task(AppFanout *self)
+{
+    ESP_LOGD(TAG, "Start");
+    camera_fb_t *frame = nullptr;
+
+    while (true)
+    {
+        if (self->queue_i == nullptr)
+            break;
+
+        if (frame_link_receive(self->queue_i, &frame, portMAX_DELAY))
+        {
+            if (self->queues_o.empty())
+            {
+                self->callback(frame);
+                continue;
+            }
+
+            // All references must exist before the first consumer can release its own
+            frame_pool_share(frame, self->queues_o.size());
+            for (QueueHandle_t queue_o : self->queues_o)
+                frame_link_send(queue_o, frame);
+        }
+    }
+    ESP_LOGD(TAG, "Stop");
+    vTaskDelete(nullptr);
+}
+
+void AppFanout::run()
+{
+    xTaskCreatePinnedToCore((TaskFunction_t)task, TAG, 3 * 1024, this, 5, nullptr, 0);
+}
@@ -0,0 +1,109 @@
+#include "app_frame_link.hpp"
+
+#include <atomic>
+
+#include "esp_log.h"
+
+#include "app_frame_pool.hpp"
+
+static const char TAG[] = "App/FrameLink";
+
+typedef struct
+{
+    QueueHandle_t queue;
+    const char *name;
+    frame_link_mode_t mode;
+    std::atomic<uint32_t> sent;
+    std::atomic<uint32_t> dropped;
+    std::atomic<uint32_t> consumed;
+} frame_link_t;
+
+static frame_link_t links[FRAME_LINK_MAX];
+static std::atomic<uint8_t> links_count{0};
+
+static frame_link_t *find_link(QueueHandle_t queue)
+{
+    uint8_t count = links_count.load();
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (links[i].queue == queue)
+            return &links[i];
+    }
+    return nullptr;
+}
+
+QueueHandle_t frame_link_create(const char *name, frame_link_mode_t mode)
+{
+    uint8_t index = links_count.load();
+    if (index >= FRAME_LINK_MAX)
+    {
+        ESP_LOGE(TAG, "Too many frame links, raise FRAME_LINK_MAX");
+        return nullptr;
+    }
+
+    QueueHandle_t queue = xQueueCreate(mode == FRAME_LINK_LATEST ? 1 : 2, sizeof(camera_fb_t *));
+    if (queue == nullptr)
+        return nullptr;
+    vQueueAddToRegistry(queue, name);
+
+    frame_link_t &link = links[index];
+    link.queue = queue;
+    link.name = name;
+    link.mode = mode;
+    links_count.store(index + 1); // Publish only once the entry is complete
+
+    ESP_LOGI(TAG, "Link %s created as %s", name, mode == FRAME_LINK_LATEST ? "latest-frame mailbox" : "queue");
+    return queue;
+}
+
+void frame_link_send(QueueHandle_t queue, camera_fb_t *frame)
+{
+    frame_link_t *link = find_link(queue);
+    if (link == nullptr)
+    {
+        xQueueSend(queue, &frame, portMAX_DELAY);
+        return;
+    }
+
+    if (link->mode == FRAME_LINK_LATEST)
+    {
+        // Single producer per link: once the stale frame is taken out the slot stays free for ours
+        camera_fb_t *stale = nullptr;
+        if (xQueueReceive(queue, &stale, 0) == pdTRUE)
+        {
+            frame_pool_release(stale);
+            link->dropped++;
+        }
+    }
+    xQueueSend(queue, &frame, portMAX_DELAY);
+
+    uint32_t sent = ++link->sent;
+    if (sent % FRAME_LINK_LOG_INTERVAL == 0)
+    {
+        ESP_LOGI(TAG, "%s: %lu sent, %lu consumed, %lu dropped", link->name,
+                 (unsigned long)sent, (unsigned long)link->consumed.load(), (unsigned long)link->dropped.load());
+    }
+}
+
+bool frame_link_receive(QueueHandle_t queue, camera_fb_t **frame, TickType_t ticks_to_wait)
+{
+    if (xQueueReceive(queue, frame, ticks_to_wait) != pdTRUE)
+        return false;
+
+    frame_link_t *link = find_link(queue);
+    if (link)
+        link->consumed++;
+    return true;
+}
+
+bool frame_link_get_stats(QueueHandle_t queue, frame_link_stats_t *stats)
+{
+    frame_link_t *link = find_link(queue);
+    if (link == nullptr)
+        return false;
+
+    stats->sent = link->sent.load();
+    stats->dropped = link->dropped.load();
+    stats->consumed = link->consumed.load();
+    return true;
+}
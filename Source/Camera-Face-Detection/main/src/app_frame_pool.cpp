@@ -0,0 +1,56 @@
+#include "app_frame_pool.hpp"
+
+#include <atomic>
+
+#include "esp_log.h"
+
+static const char TAG[] = "App/FramePool";
+
+typedef struct
+{
+    std::atomic<camera_fb_t *> frame;
+    std::atomic<int> references;
+} frame_slot_t;
+
+static frame_slot_t slots[FRAME_POOL_SIZE];
+
+void frame_pool_share(camera_fb_t *frame, uint8_t references)
+{
+    if (references == 0)
+    {
+        esp_camera_fb_return(frame);
+        return;
+    }
+
+    for (frame_slot_t &slot : slots)
+    {
+        camera_fb_t *empty = nullptr;
+        if (slot.frame.compare_exchange_strong(empty, frame))
+        {
+            slot.references.store(references);
+            return;
+        }
+    }
+
+    // Cannot happen while FRAME_POOL_SIZE >= fb_count: every slot belongs to a frame the driver handed out.
+    ESP_LOGE(TAG, "No free slot for frame %p, FRAME_POOL_SIZE is smaller than fb_count", frame);
+    abort();
+}
+
+void frame_pool_release(camera_fb_t *frame)
+{
+    for (frame_slot_t &slot : slots)
+    {
+        if (slot.frame.load() == frame)
+        {
+            if (slot.references.fetch_sub(1) == 1)
+            {
+                slot.frame.store(nullptr); // Free the slot before the driver can hand the buffer out again
+                esp_camera_fb_return(frame);
+            }
+            return;
+        }
+    }
+
+    esp_camera_fb_return(frame);
+}
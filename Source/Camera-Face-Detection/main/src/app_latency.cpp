@@ -0,0 +1,167 @@
+#include "app_latency.hpp"
+
+#include <cstring>
+
+#include "esp_console.h"
+#include "esp_log.h"
+
+static const char TAG[] = "App/Latency";
+
+static const char *const point_names[LATENCY_MAX] = {
+    "capture->face",
+    "face",
+    "face->transmission",
+    "esp_now_send",
+    "capture->send",
+};
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static latency_histogram_t histograms[LATENCY_MAX];
+static uint32_t coalesced = 0;
+
+static uint8_t bucket_index(int64_t us)
+{
+    if (us < 64)
+        return 0;
+
+    uint8_t exponent = 63 - __builtin_clzll(static_cast<uint64_t>(us)); // >= 6
+    uint8_t sub = (us >> (exponent - 2)) & 3;
+    uint32_t index = 1 + (exponent - 6) * 4 + sub;
+    return index < LATENCY_BUCKETS ? index : LATENCY_BUCKETS - 1;
+}
+
+static int64_t bucket_upper_bound(uint8_t index)
+{
+    if (index == 0)
+        return 64;
+
+    uint8_t exponent = 6 + (index - 1) / 4;
+    uint8_t sub = (index - 1) % 4;
+    return static_cast<int64_t>(4 + sub + 1) << (exponent - 2);
+}
+
+static void reset(latency_histogram_t *histogram)
+{
+    memset(histogram, 0, sizeof(latency_histogram_t));
+    histogram->min_us = INT64_MAX;
+}
+
+int64_t latency_frame_time(const camera_fb_t *frame)
+{
+    return static_cast<int64_t>(frame->timestamp.tv_sec) * 1000000 + frame->timestamp.tv_usec;
+}
+
+void latency_record(latency_point_t point, int64_t elapsed_us)
+{
+    if (elapsed_us < 0)
+        elapsed_us = 0;
+
+    portENTER_CRITICAL(&lock);
+    latency_histogram_t &histogram = histograms[point];
+    if (histogram.count == 0)
+        histogram.min_us = INT64_MAX;
+    histogram.count++;
+    histogram.total_us += elapsed_us;
+    if (elapsed_us < histogram.min_us)
+        histogram.min_us = elapsed_us;
+    if (elapsed_us > histogram.max_us)
+        histogram.max_us = elapsed_us;
+    histogram.buckets[bucket_index(elapsed_us)]++;
+    portEXIT_CRITICAL(&lock);
+}
+
+void latency_count_coalesced()
+{
+    portENTER_CRITICAL(&lock);
+    coalesced++;
+    portEXIT_CRITICAL(&lock);
+}
+
+void latency_get(latency_point_t point, latency_histogram_t *histogram)
+{
+    portENTER_CRITICAL(&lock);
+    *histogram = histograms[point];
+    portEXIT_CRITICAL(&lock);
+}
+
+int64_t latency_percentile(const latency_histogram_t *histogram, uint32_t percent)
+{
+    if (histogram->count == 0)
+        return 0;
+
+    uint64_t target = (static_cast<uint64_t>(histogram->count) * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        seen += histogram->buckets[i];
+        if (seen >= target)
+            return bucket_upper_bound(i) < histogram->max_us ? bucket_upper_bound(i) : histogram->max_us;
+    }
+    return histogram->max_us;
+}
+
+static void print_summary(bool restart)
+{
+    latency_histogram_t snapshot[LATENCY_MAX];
+    uint32_t coalesced_snapshot;
+
+    portENTER_CRITICAL(&lock);
+    memcpy(snapshot, histograms, sizeof(snapshot));
+    coalesced_snapshot = coalesced;
+    if (restart)
+    {
+        for (latency_histogram_t &histogram : histograms)
+            reset(&histogram);
+        coalesced = 0;
+    }
+    portEXIT_CRITICAL(&lock);
+
+    for (uint8_t point = 0; point < LATENCY_MAX; point++)
+    {
+        const latency_histogram_t &histogram = snapshot[point];
+        if (histogram.count == 0)
+            continue;
+        ESP_LOGI(TAG, "%-18s n=%-5lu min=%.1f avg=%.1f p99=%.1f max=%.1f ms", point_names[point], (unsigned long)histogram.count,
+                 histogram.min_us / 1000.0, histogram.total_us / 1000.0 / histogram.count,
+                 latency_percentile(&histogram, 99) / 1000.0, histogram.max_us / 1000.0);
+    }
+    ESP_LOGI(TAG, "%lu movement orders replaced before the sender took them", (unsigned long)coalesced_snapshot);
+}
+
+void latency_log_summary()
+{
+    print_summary(true);
+}
+
+static int latency_command(int argc, char **argv)
+{
+    bool restart = argc > 1 && strcmp(argv[1], "reset") == 0;
+    print_summary(restart);
+    return 0;
+}
+
+static void task(void *period_ms)
+{
+    TickType_t last_wake_time = xTaskGetTickCount();
+    while (true)
+    {
+        vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(reinterpret_cast<uintptr_t>(period_ms)));
+        latency_log_summary();
+    }
+}
+
+void latency_start(uint32_t period_ms)
+{
+    for (latency_histogram_t &histogram : histograms)
+        reset(&histogram);
+
+    const esp_console_cmd_t command = {
+        .command = "latency",
+        .help = "Print capture-to-radio latency per stage for the current window, 'latency reset' starts a new one",
+        .hint = "[reset]",
+        .func = &latency_command,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&command));
+
+    xTaskCreatePinnedToCore((TaskFunction_t)task, TAG, 3 * 1024, reinterpret_cast<void *>(static_cast<uintptr_t>(period_ms)), 1, nullptr, 0);
+}
@@ -1,25 +1,178 @@
 #include "app_lcd.hpp"
 
+#include <algorithm>
 #include <string.h>
 
+#include "esp_attr.h"
 #include "esp_log.h"
 #include "esp_camera.h"
-#include "dl_image.hpp"
+#include "fb_gfx.h"
 
 #include "arduino_community_logo_240_240.h"
 
+#include "app_arena.hpp"
+#include "app_frame_link.hpp"
+#include "app_latency.hpp"
+
 static const char TAG[] = "App/LCD";
 
+// Runs in the SPI ISR when a draw_bitmap() transfer completes
+static bool IRAM_ATTR color_trans_done(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_io_event_data_t *edata, void *user_ctx)
+{
+    AppLCD *self = (AppLCD *)user_ctx;
+    BaseType_t high_task_woken = pdFALSE;
+    uint16_t *released[LCD_TRANS_QUEUE_DEPTH];
+    int count = 0;
+
+    // The transfer that completed, then the refused ones behind it, which only waited for it
+    portENTER_CRITICAL_ISR(&self->inflight_lock);
+    bool completed = true;
+    while (self->inflight_count && (completed || !self->inflight[self->inflight_head].queued))
+    {
+        lcd_transfer_t &transfer = self->inflight[self->inflight_head];
+        if (transfer.release)
+            released[count++] = transfer.release;
+        self->inflight_head = (self->inflight_head + 1) % LCD_TRANS_QUEUE_DEPTH;
+        self->inflight_count--;
+        completed = false;
+    }
+    portEXIT_CRITICAL_ISR(&self->inflight_lock);
+
+    for (int i = 0; i < count; i++)
+        xQueueSendFromISR(self->queue_free_buffers, &released[i], &high_task_woken);
+    return high_task_woken == pdTRUE;
+}
+
+static void rgb_print(camera_fb_t *fb, int32_t y, uint32_t color, const char *str)
+{
+    fb_gfx_print(fb, (fb->width - (strlen(str) * 14)) / 2, y, color, str);
+}
+
+static int rgb_printf(camera_fb_t *fb, int32_t y, uint32_t color, const char *format, ...)
+{
+    char loc_buf[64];
+    char *temp = loc_buf;
+    int len;
+    va_list arg;
+    va_list copy;
+    va_start(arg, format);
+    va_copy(copy, arg);
+    len = vsnprintf(loc_buf, sizeof(loc_buf), format, copy);
+    va_end(copy);
+    if (len >= (int)sizeof(loc_buf))
+    {
+        temp = (char *)malloc(len + 1);
+        if (temp == NULL)
+        {
+            va_end(arg);
+            return 0;
+        }
+        vsnprintf(temp, len + 1, format, arg);
+    }
+    va_end(arg);
+    rgb_print(fb, y, color, temp);
+    if (temp != loc_buf)
+    {
+        free(temp);
+    }
+    return len;
+}
+
+// Overlay primitives in panel coordinates, clipped to the band holding rows [y_start, y_end)
+static void fill_rect(uint16_t *band, int width, int y_start, int y_end, int x0, int y0, int x1, int y1, uint16_t color)
+{
+    x0 = std::max(x0, 0);
+    x1 = std::min(x1, width - 1);
+    y0 = std::max(y0, y_start);
+    y1 = std::min(y1, y_end - 1);
+    for (int y = y0; y <= y1; y++)
+    {
+        for (int x = x0; x <= x1; x++)
+            band[(y - y_start) * width + x] = color;
+    }
+}
+
+static void draw_box(uint16_t *pixels, int width, int y_start, int y_end, const int box[4], uint16_t color)
+{
+    fill_rect(pixels, width, y_start, y_end, box[0], box[1], box[2], box[1] + 1, color);
+    fill_rect(pixels, width, y_start, y_end, box[0], box[3] - 1, box[2], box[3], color);
+    fill_rect(pixels, width, y_start, y_end, box[0], box[1], box[0] + 1, box[3], color);
+    fill_rect(pixels, width, y_start, y_end, box[2] - 1, box[1], box[2], box[3], color);
+}
+
+/**
+ * @brief Composite the overlay on a scaled band, before the band is sent.
+ *
+ * @param scaler  where the picture sits on the panel
+ * @param band    panel rows [y_start, y_end)
+ */
+static void draw_overlay_band(const overlay_t &overlay, const FrameScaler &scaler, uint16_t *band, int y_start, int y_end)
+{
+    const int width = scaler.output_width;
+    for (uint8_t i = 0; i < overlay.count; i++)
+    {
+        const overlay_face_t &face = overlay.faces[i];
+        int box[4];
+        for (int j = 0; j < 4; j++)
+            box[j] = (j % 2 == 0) ? scaler.x_offset + face.box[j] * scaler.width / overlay.width
+                                  : scaler.y_offset + face.box[j] * scaler.height / overlay.height;
+        if (box[3] < y_start || box[1] >= y_end)
+            continue;
+        draw_box(band, width, y_start, y_end, box, face.predicted ? OVERLAY_COLOR_YELLOW : OVERLAY_COLOR_GREEN);
+
+        for (int j = 0; face.has_keypoints && j < OVERLAY_KEYPOINTS; j += 2)
+        {
+            int x = scaler.x_offset + face.keypoint[j] * scaler.width / overlay.width;
+            int y = scaler.y_offset + face.keypoint[j + 1] * scaler.height / overlay.height;
+            fill_rect(band, width, y_start, y_end, x - 1, y - 1, x + 1, y + 1, OVERLAY_COLOR_RED);
+        }
+    }
+
+    // fb_gfx does not clip, the line is only drawn by the band that holds all of it
+    if (overlay.text[0] && y_start <= OVERLAY_TEXT_Y && OVERLAY_TEXT_Y + OVERLAY_TEXT_HEIGHT <= y_end)
+    {
+        camera_fb_t view = {};
+        view.buf = (uint8_t *)band;
+        view.len = width * (y_end - y_start) * sizeof(uint16_t);
+        view.width = width;
+        view.height = y_end - y_start;
+        view.format = PIXFORMAT_RGB565;
+        rgb_printf(&view, OVERLAY_TEXT_Y - y_start, OVERLAY_COLOR_WHITE, "%s", overlay.text);
+    }
+}
+
 AppLCD::AppLCD(AppButton *key,
                QueueHandle_t queue_i,
                QueueHandle_t queue_o,
+               QueueHandle_t queue_i_overlay,
                void (*callback)(camera_fb_t *)) : Frame(queue_i, queue_o, callback),
-                                                  key(key),
                                                   panel_handle(NULL),
                                                   switch_on(false),
                                                   paper_drawn(false),
-                                                  black_drawn(false)
+                                                  black_drawn(false),
+                                                  scaler(BOARD_LCD_H_RES, BOARD_LCD_V_RES),
+                                                  frame_copy(nullptr),
+                                                  display_buffers{},
+                                                  queue_free_buffers(xQueueCreate(LCD_BUFFER_COUNT, sizeof(uint16_t *))),
+                                                  inflight_lock(portMUX_INITIALIZER_UNLOCKED),
+                                                  inflight{},
+                                                  inflight_head(0),
+                                                  inflight_count(0),
+                                                  queue_i_overlay(queue_i_overlay),
+                                                  overlay{}
 {
+        key->subscribe(&this->events);
+
+        // The band buffers also carry the wallpaper and the fills, so they exist before the first draw
+        uint32_t constexpr band_pixels_buff_size = (BOARD_LCD_H_RES * LCD_BAND_HEIGHT) * sizeof(uint16_t);
+        for (uint16_t *&buffer : this->display_buffers)
+        {
+            buffer = (uint16_t *)arena_alloc(ARENA_DMA, band_pixels_buff_size, "lcd band");
+            if (buffer)
+                xQueueSend(this->queue_free_buffers, &buffer, 0);
+        }
+        // Without it, panel-sized frames are held until their last band is queued, like scaled ones
+        this->frame_copy = (uint16_t *)arena_alloc(ARENA_SPIRAM, BOARD_LCD_H_RES * BOARD_LCD_V_RES * sizeof(uint16_t), "lcd frame copy");
 
         ESP_LOGI(TAG, "Initialize SPI bus");
         spi_bus_config_t bus_conf = {
@@ -39,7 +192,9 @@ AppLCD::AppLCD(AppButton *key,
             .dc_gpio_num = BOARD_LCD_DC,
             .spi_mode = 0,
             .pclk_hz = BOARD_LCD_PIXEL_CLOCK_HZ,
-            .trans_queue_depth = 10,
+            .trans_queue_depth = LCD_TRANS_QUEUE_DEPTH,
+            .on_color_trans_done = color_trans_done,
+            .user_ctx = this,
             .lcd_cmd_bits = BOARD_LCD_CMD_BITS,
             .lcd_param_bits = BOARD_LCD_PARAM_BITS,
         };
@@ -60,77 +215,124 @@ AppLCD::AppLCD(AppButton *key,
         // turn on display
         esp_lcd_panel_disp_on_off(panel_handle, true);
 
+        // The wallpaper stays up until the LCD task draws over it, nothing needs to wait for it
         this->draw_color(0x000000);
-        vTaskDelay(pdMS_TO_TICKS(500));
         this->draw_wallpaper();
-        vTaskDelay(pdMS_TO_TICKS(1000));
 }
 
 void AppLCD::draw_wallpaper()
 {
-    uint16_t *pixels = (uint16_t *)heap_caps_malloc((arduino_community_logo_240x240_lcd_width * arduino_community_logo_240x240_lcd_height) * sizeof(uint16_t), MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
-    if (nullptr == pixels)
+    // SPI DMA cannot read flash, the logo is copied to a band buffer a band at a time
+    const int width = arduino_community_logo_240x240_lcd_width;
+    const int height = arduino_community_logo_240x240_lcd_height;
+    const int band_rows = BOARD_LCD_H_RES * LCD_BAND_HEIGHT / width;
+    for (int y_start = 0; y_start < height; y_start += band_rows)
     {
-        ESP_LOGE(TAG, "Memory for bitmap is not enough");
-        return;
+        int y_end = std::min(y_start + band_rows, height);
+        uint16_t *band = this->take_buffer();
+        if (band == nullptr)
+            return;
+        memcpy(band, arduino_community_logo_240x240_lcd + y_start * width, (y_end - y_start) * width * sizeof(uint16_t));
+        this->draw_bitmap(0, y_start, width, y_end, band, band);
     }
-    memcpy(pixels, arduino_community_logo_240x240_lcd, (arduino_community_logo_240x240_lcd_width * arduino_community_logo_240x240_lcd_height) * sizeof(uint16_t));
-    esp_lcd_panel_draw_bitmap(panel_handle, 0, 0, arduino_community_logo_240x240_lcd_width, arduino_community_logo_240x240_lcd_height, (uint16_t *)pixels);
-    heap_caps_free(pixels);
 
     this->paper_drawn = true;
 }
 
-void AppLCD::draw_color(int color) const
+void AppLCD::draw_color(int color)
 {
-    uint16_t *buffer = (uint16_t *)malloc(BOARD_LCD_H_RES * sizeof(uint16_t));
-    if (NULL == buffer)
+    uint16_t *band = this->take_buffer();
+    if (band == nullptr)
+        return;
+    for (size_t i = 0; i < BOARD_LCD_H_RES * LCD_BAND_HEIGHT; i++)
+        band[i] = color;
+
+    // The same band is sent for every band of the panel, it is handed back after the last one
+    for (int y_start = 0; y_start < BOARD_LCD_V_RES; y_start += LCD_BAND_HEIGHT)
     {
-        ESP_LOGE(TAG, "Memory for bitmap is not enough");
+        int y_end = std::min(y_start + LCD_BAND_HEIGHT, BOARD_LCD_V_RES);
+        this->draw_bitmap(0, y_start, BOARD_LCD_H_RES, y_end, band, y_end == BOARD_LCD_V_RES ? band : nullptr);
     }
-    else
+}
+
+uint16_t *AppLCD::take_buffer() const
+{
+    // Waits while every band buffer is still queued on the panel
+    uint16_t *band = nullptr;
+    if (this->display_buffers[0] == nullptr || xQueueReceive(this->queue_free_buffers, &band, portMAX_DELAY) != pdTRUE)
+        return nullptr;
+    return band;
+}
+
+void AppLCD::draw_bitmap(int x_start, int y_start, int x_end, int y_end, const uint16_t *pixels, uint16_t *release)
+{
+    // The pixels must stay untouched until color_trans_done() takes them off the in-flight list.
+    // The entry goes in first, as the transfer can complete before esp_lcd_panel_draw_bitmap() returns.
+    lcd_transfer_t *transfer = nullptr;
+    while (transfer == nullptr)
     {
-        for (size_t i = 0; i < BOARD_LCD_H_RES; i++)
+        portENTER_CRITICAL(&this->inflight_lock);
+        if (this->inflight_count < LCD_TRANS_QUEUE_DEPTH)
         {
-            buffer[i] = color;
+            transfer = &this->inflight[(this->inflight_head + this->inflight_count++) % LCD_TRANS_QUEUE_DEPTH];
+            *transfer = {pixels, release, true};
         }
+        portEXIT_CRITICAL(&this->inflight_lock);
+        if (transfer == nullptr)
+            vTaskDelay(1); // Only if the panel IO queues more transfers than the buffers can feed
+    }
 
-        for (int y = 0; y < BOARD_LCD_V_RES; y++)
-        {
-            esp_lcd_panel_draw_bitmap(panel_handle, 0, y, BOARD_LCD_H_RES, y+1, buffer);
-        }
+    esp_err_t ret = esp_lcd_panel_draw_bitmap(this->panel_handle, x_start, y_start, x_end, y_end, pixels);
+    if (ret == ESP_OK)
+        return;
+    ESP_LOGE(TAG, "Draw failed: %s", esp_err_to_name(ret));
 
-        free(buffer);
-    }
+    // Nothing will complete for this transfer. Its buffer goes back once the transfers before it,
+    // which may read the same buffer, are done, or now if there are none.
+    portENTER_CRITICAL(&this->inflight_lock);
+    bool alone = this->inflight_count == 1;
+    if (alone)
+        this->inflight_count = 0;
+    else
+        transfer->queued = false;
+    portEXIT_CRITICAL(&this->inflight_lock);
+    if (alone && release)
+        xQueueSend(this->queue_free_buffers, &release, 0);
 }
 
-void AppLCD::update()
+void AppLCD::take_events()
 {
-    if (this->key->pressed > BUTTON_IDLE)
+    event_t event;
+    while (this->events.poll(&event))
     {
-        if (this->key->pressed == BUTTON_MENU)
+        if (event.button == BUTTON_MENU && event.action == BUTTON_ACTION_PRESS)
         {
-            this->switch_on = this->key->menu != MENU_STOP_WORKING;
+            this->switch_on = event.menu != MENU_STOP_WORKING;
             this->black_drawn = false;
             ESP_LOGD(TAG, "%s", this->switch_on ? "ON" : "OFF");
         }
-    }
 
-    if (!this->switch_on)
-    {
-        this->paper_drawn = false;
+        if (!this->switch_on)
+        {
+            this->paper_drawn = false;
+        }
     }
 }
 
+static void release_frame(AppLCD *self, camera_fb_t *frame)
+{
+    if (self->queue_o)
+        frame_link_send(self->queue_o, frame);
+    else
+        self->callback(frame);
+}
+
 static void task(AppLCD *self)
 {
     ESP_LOGD(TAG, "Start");
-    uint32_t constexpr frame_pixels_buff_size = (BOARD_LCD_H_RES * BOARD_LCD_V_RES) * sizeof(uint16_t);
-    ESP_LOGI(TAG, "allocating %lu bytes for frame_pixels_buff", frame_pixels_buff_size);
-    uint16_t *frame_pixels_buff = (uint16_t *)heap_caps_malloc(frame_pixels_buff_size, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
-    if(nullptr == frame_pixels_buff)
+    if (self->display_buffers[0] == nullptr)
     {
-        ESP_LOGE(TAG, "Memory for bitmap is not enough");
+        ESP_LOGE(TAG, "No display buffers, see the arena report");
         vTaskDelete(nullptr);
     }
 
@@ -140,8 +342,9 @@ static void task(AppLCD *self)
         if (self->queue_i == nullptr)
             break;
 
-        if (xQueueReceive(self->queue_i, &frame, portMAX_DELAY))
+        if (frame_link_receive(self->queue_i, &frame, portMAX_DELAY))
         {
+            self->take_events();
             if (self->switch_on)
             {
                 if(!self->black_drawn)
@@ -150,42 +353,49 @@ static void task(AppLCD *self)
                     self->black_drawn = true;
                 }
 
-                if(frame->height == BOARD_LCD_V_RES && frame->width == BOARD_LCD_H_RES)
+                // Lookup tables are only rebuilt when the camera resolution changes
+                self->scaler.configure(frame->width, frame->height);
+
+                // Latest results from AppFace, left out once they are too far from the picture
+                bool overlay_valid = self->queue_i_overlay && xQueuePeek(self->queue_i_overlay, &self->overlay, 0) == pdTRUE &&
+                                     llabs(latency_frame_time(frame) - self->overlay.capture_time) <= OVERLAY_MAX_AGE;
+
+                // Two band buffers cannot hold a frame, the bands wait on the wire. A panel-sized frame is
+                // copied whole and goes back to the camera now; a scaled one is read until its last band.
+                const uint16_t *source = (const uint16_t *)frame->buf;
+                if (self->frame_copy && frame->width == BOARD_LCD_H_RES && frame->height == BOARD_LCD_V_RES)
                 {
-                    esp_lcd_panel_draw_bitmap(self->panel_handle, 0, 0, frame->width, frame->height, (uint16_t *)frame->buf);
+                    memcpy(self->frame_copy, frame->buf, BOARD_LCD_H_RES * BOARD_LCD_V_RES * sizeof(uint16_t));
+                    source = self->frame_copy;
+                    release_frame(self, frame);
+                    frame = nullptr;
                 }
-                else
+
+                // Each band is scaled, composited and queued while the previous one is on the wire.
+                // The whole panel is sent, so the letterbox bars never keep stale pixels.
+                for (int y_start = 0; y_start < BOARD_LCD_V_RES; y_start += LCD_BAND_HEIGHT)
                 {
-                    double aspectRatio = static_cast<double>(frame->width) / frame->height;
-                    int destHRes = BOARD_LCD_H_RES;
-                    int destVRes = BOARD_LCD_V_RES;
-                    if(aspectRatio > 1) // width > height
-                    {
-                        destVRes = static_cast<int>(static_cast<double>(BOARD_LCD_V_RES) / aspectRatio);
-                    }
-                    else if(aspectRatio < 1) // height > width
-                    {
-                        destHRes = static_cast<int>(static_cast<double>(BOARD_LCD_H_RES) * aspectRatio);
-                    }
-
-                    ESP_LOGD(TAG, "Resizing image from %dx%d to %dx%d (aspect ratio: %f)", frame->width, frame->height, destHRes, destVRes, aspectRatio);
-                    dl::image::resize_image_nearest((uint16_t*)frame->buf, {static_cast<int>(frame->height), static_cast<int>(frame->width), 1}, frame_pixels_buff, {destVRes, destHRes, 1});
-                    esp_lcd_panel_draw_bitmap(self->panel_handle, 0, 0, destHRes, destVRes, frame_pixels_buff);
+                    int y_end = std::min(y_start + LCD_BAND_HEIGHT, BOARD_LCD_V_RES);
+
+                    uint16_t *band = self->take_buffer();
+
+                    self->scaler.scale(source, band, y_start, y_end);
+                    if (overlay_valid)
+                        draw_overlay_band(self->overlay, self->scaler, band, y_start, y_end);
+                    self->draw_bitmap(0, y_start, BOARD_LCD_H_RES, y_end, band, band);
                 }
             }
 
             else if (!self->paper_drawn)
                 self->draw_wallpaper();
 
-            if (self->queue_o)
-                xQueueSend(self->queue_o, &frame, portMAX_DELAY);
-            else
-                self->callback(frame);
+            // The camera frame is not needed any more, the panel is fed from the display buffers
+            if (frame)
+                release_frame(self, frame);
         }
     }
     ESP_LOGD(TAG, "Stop");
     self->draw_wallpaper();
-    heap_caps_free(frame_pixels_buff);
     vTaskDelete(nullptr);
 }
 
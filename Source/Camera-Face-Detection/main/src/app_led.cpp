@@ -1,25 +1,155 @@
 #include "app_led.hpp"
 
+#include <atomic>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_console.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 const static char TAG[] = "App/LED";
 
-typedef enum
+static const led_pattern_t patterns[LED_MODE_MAX] = {
+    {0, 1, 0, 0, {LED_HOLD}},             // LED_ALWAYS_OFF
+    {1, 1, 0, 0, {LED_HOLD}},             // LED_ALWAYS_ON
+    {0, 2, 1, 0, {1000, LED_HOLD}},       // LED_OFF_1S
+    {0, 2, 1, 0, {2000, LED_HOLD}},       // LED_OFF_2S
+    {0, 2, 1, 0, {4000, LED_HOLD}},       // LED_OFF_4S
+    {1, 2, 1, 0, {1000, LED_HOLD}},       // LED_ON_1S
+    {1, 2, 1, 0, {2000, LED_HOLD}},       // LED_ON_2S
+    {1, 2, 1, 0, {4000, LED_HOLD}},       // LED_ON_4S
+    {1, 2, 2, 0, {250, 250}},             // LED_BLINK_1S
+    {1, 2, 4, 0, {250, 250}},             // LED_BLINK_2S
+    {1, 2, 8, 0, {250, 250}},             // LED_BLINK_4S
+    {1, 2, 0, 0, {50, 1950}},             // LED_SEARCHING, a short flash every 2 s
+    {1, 1, 0, 0, {LED_HOLD}},             // LED_TRACKING
+    {1, 4, 0, 0, {100, 150, 100, 650}},   // LED_LINK_DOWN, a double flash every second
+    {1, 6, 1, 0, {80, 80, 80, 80, 80, 80}}, // LED_TARGET_LOST, three quick flashes
+};
+
+typedef struct
+{
+    led_mode_t mode; // LED_MODE_MAX when idle
+    uint8_t step;
+    uint8_t loop;
+    int64_t step_end; // INT64_MAX while holding
+} layer_t;
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t timer = nullptr;
+static gpio_num_t led_pin = GPIO_NUM_NC;
+
+// Requests from any task, taken up by the next timer callback
+static std::atomic<uint32_t> status(0);
+static led_mode_t requested = LED_MODE_MAX;
+static bool play_requested = false;
+
+// Playback, under the lock
+static layer_t layers[LED_LAYER_MAX] = {{LED_ALWAYS_OFF, 0, 0, INT64_MAX}, {LED_MODE_MAX, 0, 0, INT64_MAX}};
+static uint32_t status_shown = 0;
+static int level = -1;
+static uint32_t edges = 0;
+static uint32_t wakeups = 0;
+
+static led_mode_t status_mode(uint32_t flags)
+{
+    if (!(flags & LED_STATUS_DETECTING))
+        return LED_ALWAYS_OFF;
+    if (!(flags & LED_STATUS_LINK_UP))
+        return LED_LINK_DOWN;
+    return (flags & LED_STATUS_TRACKING) ? LED_TRACKING : LED_SEARCHING;
+}
+
+static int64_t step_end(const led_pattern_t *pattern, uint8_t step, int64_t start)
 {
-    LED_ALWAYS_OFF = 0,
-    LED_ALWAYS_ON = 1,
-    LED_OFF_1S = 2,
-    LED_OFF_2S = 3,
-    LED_OFF_4S = 4,
-    LED_ON_1S = 5,
-    LED_ON_2S = 6,
-    LED_ON_4S = 7,
-    LED_BLINK_1S = 8,
-    LED_BLINK_2S = 9,
-    LED_BLINK_4S = 10,
-} led_mode_t;
+    uint16_t duration = pattern->duration[step];
+    return duration == LED_HOLD ? INT64_MAX : start + duration * 1000LL;
+}
 
-AppLED::AppLED(const gpio_num_t pin, AppButton *key) : pin(pin), key(key)
+static void start(layer_t *layer, led_mode_t mode, int64_t now)
+{
+    layer->mode = mode;
+    layer->step = 0;
+    layer->loop = 0;
+    layer->step_end = mode == LED_MODE_MAX ? INT64_MAX : step_end(&patterns[mode], 0, now);
+}
+
+// Steps are timed from the end of the previous one so a late callback does not stretch the pattern
+static void advance(layer_t *layer, int64_t now)
+{
+    while (layer->mode != LED_MODE_MAX && layer->step_end <= now)
+    {
+        const led_pattern_t *pattern = &patterns[layer->mode];
+        if (++layer->step == pattern->steps)
+        {
+            layer->step = 0;
+            if (pattern->loops && ++layer->loop == pattern->loops)
+            {
+                layer->mode = LED_MODE_MAX;
+                break;
+            }
+        }
+        layer->step_end = step_end(pattern, layer->step, layer->step_end);
+    }
+}
+
+// Called with the lock held; a pending timer is replaced, so the callback runs next in any case
+static void arm(uint64_t timeout_us)
+{
+    if (timer == nullptr)
+        return;
+    esp_timer_stop(timer);
+    esp_timer_start_once(timer, timeout_us);
+}
+
+static void step(void *)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&lock);
+    wakeups++;
+
+    uint32_t flags = status.load(std::memory_order_acquire);
+    if (flags != status_shown)
+    {
+        bool lost = (status_shown & LED_STATUS_TRACKING) && !(flags & LED_STATUS_TRACKING) && (flags & LED_STATUS_DETECTING);
+        if (status_mode(flags) != status_mode(status_shown))
+            start(&layers[LED_LAYER_STATUS], status_mode(flags), now);
+        if (lost && layers[LED_LAYER_EVENT].mode == LED_MODE_MAX)
+            start(&layers[LED_LAYER_EVENT], LED_TARGET_LOST, now);
+        status_shown = flags;
+    }
+    if (play_requested)
+    {
+        start(&layers[LED_LAYER_EVENT], requested, now);
+        play_requested = false;
+    }
+
+    int next_level = 0;
+    int64_t next = INT64_MAX;
+    for (int i = 0; i < LED_LAYER_MAX; i++)
+    {
+        layer_t *layer = &layers[i];
+        advance(layer, now);
+        if (layer->mode == LED_MODE_MAX)
+            continue;
+        next_level = patterns[layer->mode].level ^ (layer->step & 1); // the topmost layer playing wins
+        if (layer->step_end < next)
+            next = layer->step_end;
+    }
+
+    if (next_level != level)
+    {
+        gpio_set_level(led_pin, next_level);
+        level = next_level;
+        edges++;
+    }
+    if (next != INT64_MAX)
+        arm(next > now ? next - now : 0);
+    portEXIT_CRITICAL(&lock);
+}
+
+AppLED::AppLED(const gpio_num_t pin, AppButton *key) : pin(pin)
 {
     // initialize GPIO
     gpio_config_t gpio_conf;
@@ -31,86 +161,130 @@ AppLED::AppLED(const gpio_num_t pin, AppButton *key) : pin(pin), key(key)
     gpio_config(&gpio_conf);
 
     gpio_set_level(this->pin, 0);
+    key->subscribe(&this->events);
+
+    esp_timer_handle_t handle;
+    const esp_timer_create_args_t timer_args = {
+        .callback = &step,
+        .arg = nullptr,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "led",
+        .skip_unhandled_events = false,
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &handle));
+
+    // Whatever was requested before the LED existed shows now
+    portENTER_CRITICAL(&lock);
+    led_pin = this->pin;
+    level = 0;
+    timer = handle;
+    arm(0);
+    portEXIT_CRITICAL(&lock);
 }
 
-void AppLED::update()
+static void task(AppLED *self)
 {
-    led_mode_t mode = LED_ALWAYS_OFF;
-
-    // parse key
-    if (this->key->pressed)
+    ESP_LOGD(TAG, "Start");
+    event_t event;
+    while (true)
     {
-        mode = LED_BLINK_1S;
+        // Sleeps until a press; one during a blink starts it over
+        self->events.wait(&event);
+        while (self->events.poll(&event))
+            ;
+        led_play(LED_BLINK_1S);
     }
+}
+
+void AppLED::run()
+{
+    xTaskCreatePinnedToCore((TaskFunction_t)task, TAG, 2 * 1024, this, 1, nullptr, 0);
+}
+
+void led_play(led_mode_t mode)
+{
+    portENTER_CRITICAL(&lock);
+    requested = mode;
+    play_requested = true;
+    arm(0);
+    portEXIT_CRITICAL(&lock);
+}
+
+void led_stop()
+{
+    led_play(LED_MODE_MAX);
+}
+
+void led_set_status(uint32_t mask, uint32_t flags)
+{
+    uint32_t current = status.load(std::memory_order_relaxed);
+    if (((current ^ flags) & mask) == 0)
+        return;
+
+    portENTER_CRITICAL(&lock);
+    status.store((status.load(std::memory_order_relaxed) & ~mask) | (flags & mask), std::memory_order_release);
+    arm(0);
+    portEXIT_CRITICAL(&lock);
+}
+
+const led_pattern_t *led_pattern(led_mode_t mode)
+{
+    return &patterns[mode];
+}
 
-    // do
-    switch (mode)
+void led_get_stats(led_stats_t *stats)
+{
+    portENTER_CRITICAL(&lock);
+    stats->status = status.load(std::memory_order_relaxed);
+    for (int i = 0; i < LED_LAYER_MAX; i++)
+        stats->shown[i] = layers[i].mode;
+    stats->edges = edges;
+    stats->wakeups = wakeups;
+    portEXIT_CRITICAL(&lock);
+}
+
+static const char *mode_name(led_mode_t mode)
+{
+    static const char *names[LED_MODE_MAX + 1] = {"off", "on", "off 1s", "off 2s", "off 4s", "on 1s", "on 2s", "on 4s",
+                                                  "blink 1s", "blink 2s", "blink 4s", "searching", "tracking", "link down",
+                                                  "target lost", "none"};
+    return names[mode];
+}
+
+static int led_command(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "stop") == 0)
     {
-    case LED_ALWAYS_OFF:
-        gpio_set_level(this->pin, 0);
-        break;
-    case LED_ALWAYS_ON:
-        gpio_set_level(this->pin, 1);
-        break;
-    case LED_OFF_1S:
-        gpio_set_level(this->pin, 0);
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
-        gpio_set_level(this->pin, 1);
-        break;
-    case LED_OFF_2S:
-        gpio_set_level(this->pin, 0);
-        vTaskDelay(2000 / portTICK_PERIOD_MS);
-        gpio_set_level(this->pin, 1);
-        break;
-    case LED_OFF_4S:
-        gpio_set_level(this->pin, 0);
-        vTaskDelay(4000 / portTICK_PERIOD_MS);
-        gpio_set_level(this->pin, 1);
-        break;
-    case LED_ON_1S:
-        gpio_set_level(this->pin, 1);
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
-        gpio_set_level(this->pin, 0);
-        break;
-    case LED_ON_2S:
-        gpio_set_level(this->pin, 1);
-        vTaskDelay(2000 / portTICK_PERIOD_MS);
-        gpio_set_level(this->pin, 0);
-        break;
-    case LED_ON_4S:
-        gpio_set_level(this->pin, 1);
-        vTaskDelay(4000 / portTICK_PERIOD_MS);
-        gpio_set_level(this->pin, 0);
-        break;
-    case LED_BLINK_1S:
-        for (int i = 0; i < 2; ++i)
-        {
-            gpio_set_level(this->pin, 1);
-            vTaskDelay(250 / portTICK_PERIOD_MS);
-            gpio_set_level(this->pin, 0);
-            vTaskDelay(250 / portTICK_PERIOD_MS);
-        }
-        break;
-    case LED_BLINK_2S:
-        for (int i = 0; i < 4; ++i)
-        {
-            gpio_set_level(this->pin, 1);
-            vTaskDelay(250 / portTICK_PERIOD_MS);
-            gpio_set_level(this->pin, 0);
-            vTaskDelay(250 / portTICK_PERIOD_MS);
-        }
-        break;
-    case LED_BLINK_4S:
-        for (int i = 0; i < 8; ++i)
+        led_stop();
+        return 0;
+    }
+    if (argc > 1)
+    {
+        int mode = atoi(argv[1]);
+        if (mode < 0 || mode >= LED_MODE_MAX)
         {
-            gpio_set_level(this->pin, 1);
-            vTaskDelay(250 / portTICK_PERIOD_MS);
-            gpio_set_level(this->pin, 0);
-            vTaskDelay(250 / portTICK_PERIOD_MS);
+            ESP_LOGE(TAG, "Pattern %d does not exist, 0-%d", mode, LED_MODE_MAX - 1);
+            return 1;
         }
-        break;
-
-    default:
-        break;
+        led_play(static_cast<led_mode_t>(mode));
+        return 0;
     }
-}
\ No newline at end of file
+
+    led_stats_t current;
+    led_get_stats(&current);
+    ESP_LOGI(TAG, "Status 0x%02lx shows %s, playing %s, %lu edges in %lu wakeups", (unsigned long)current.status,
+             mode_name(current.shown[LED_LAYER_STATUS]), mode_name(current.shown[LED_LAYER_EVENT]),
+             (unsigned long)current.edges, (unsigned long)current.wakeups);
+    return 0;
+}
+
+void led_register_commands()
+{
+    const esp_console_cmd_t command = {
+        .command = "led",
+        .help = "Print what the LED shows, 'led N' plays pattern N over the status and 'led stop' ends it",
+        .hint = "[pattern|stop]",
+        .func = &led_command,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&command));
+}
@@ -0,0 +1,154 @@
+#include "app_motion.hpp"
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_console.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char TAG[] = "App/Motion";
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static motion_stats_t stats = {};
+
+// Luma (0-255) of an RGB565 pixel as the camera stores it, bytes swapped
+static inline uint32_t luma(uint16_t pixel)
+{
+    pixel = static_cast<uint16_t>((pixel >> 8) | (pixel << 8));
+    uint32_t r = (pixel >> 11) & 0x1F;
+    uint32_t g = (pixel >> 5) & 0x3F;
+    uint32_t b = pixel & 0x1F;
+    // 0.299 R + 0.587 G + 0.114 B with the channels widened to 8 bits, in 1/256
+    return (r * 8 * 77 + g * 4 * 150 + b * 8 * 29) >> 8;
+}
+
+static void signature(const camera_fb_t *frame, const int region[4], uint8_t *cells)
+{
+    uint32_t sums[MOTION_GRID_WIDTH * MOTION_GRID_HEIGHT] = {};
+    uint16_t counts[MOTION_GRID_WIDTH * MOTION_GRID_HEIGHT] = {};
+    const uint16_t *pixels = (const uint16_t *)frame->buf;
+    int width = region[2] - region[0] + 1;
+    int height = region[3] - region[1] + 1;
+    // About four samples across each cell, fewer on large frames
+    int step = std::min(MOTION_SAMPLE_STEP, std::max(1, width / (MOTION_GRID_WIDTH * 4)));
+    for (int y = 0; y < height; y += step)
+    {
+        const uint16_t *row = pixels + (region[1] + y) * frame->width + region[0];
+        int cell_row = y * MOTION_GRID_HEIGHT / height * MOTION_GRID_WIDTH;
+        for (int x = 0; x < width; x += step)
+        {
+            int cell = cell_row + x * MOTION_GRID_WIDTH / width;
+            sums[cell] += luma(row[x]);
+            counts[cell]++;
+        }
+    }
+    for (int i = 0; i < MOTION_GRID_WIDTH * MOTION_GRID_HEIGHT; i++)
+        cells[i] = counts[i] ? sums[i] / counts[i] : 0;
+}
+
+MotionGate::MotionGate() : reference{},
+                           current{},
+                           reference_valid(false),
+                           reference_width(0),
+                           reference_height(0),
+                           reference_region{0, 0, 0, 0},
+                           frames_skipped(0)
+{
+}
+
+void MotionGate::reset()
+{
+    this->reference_valid = false;
+}
+
+bool MotionGate::changed(const camera_fb_t *frame, const int region[4])
+{
+    int64_t start = esp_timer_get_time();
+    signature(frame, region, this->current);
+
+    bool moved = !this->reference_valid || frame->width != this->reference_width || frame->height != this->reference_height ||
+                 memcmp(region, this->reference_region, sizeof(this->reference_region)) != 0 ||
+                 this->frames_skipped >= MOTION_REFRESH_INTERVAL;
+    for (int i = 0; !moved && i < MOTION_GRID_WIDTH * MOTION_GRID_HEIGHT; i++)
+        moved = abs(this->current[i] - this->reference[i]) > MOTION_CELL_THRESHOLD;
+
+    if (moved)
+    {
+        memcpy(this->reference, this->current, sizeof(this->reference));
+        this->reference_valid = true;
+        this->reference_width = frame->width;
+        this->reference_height = frame->height;
+        memcpy(this->reference_region, region, sizeof(this->reference_region));
+        this->frames_skipped = 0;
+    }
+    else
+    {
+        this->frames_skipped++;
+    }
+
+    int64_t elapsed = esp_timer_get_time() - start;
+    portENTER_CRITICAL(&lock);
+    stats.frames++;
+    stats.skipped += !moved;
+    stats.signature_us += elapsed;
+    portEXIT_CRITICAL(&lock);
+    return moved;
+}
+
+void motion_record_inference(int64_t elapsed_us)
+{
+    portENTER_CRITICAL(&lock);
+    stats.inferences++;
+    stats.inference_us += elapsed_us;
+    portEXIT_CRITICAL(&lock);
+}
+
+void motion_get_stats(motion_stats_t *out)
+{
+    portENTER_CRITICAL(&lock);
+    *out = stats;
+    portEXIT_CRITICAL(&lock);
+}
+
+void motion_log_summary()
+{
+    motion_stats_t current;
+    motion_get_stats(&current);
+    if (current.frames == 0)
+    {
+        ESP_LOGI(TAG, "No frames gated yet");
+        return;
+    }
+
+    int64_t inference_avg_us = current.inferences ? current.inference_us / current.inferences : 0;
+    int64_t saved_us = current.skipped * inference_avg_us - current.signature_us;
+    ESP_LOGI(TAG, "%lu of %lu frames skipped (%.0f%%), signature %lld us/frame, inference %lld us/run, %.1f s of CPU saved",
+             (unsigned long)current.skipped, (unsigned long)current.frames, 100.0F * current.skipped / current.frames,
+             current.signature_us / current.frames, inference_avg_us, saved_us / 1e6F);
+}
+
+static int motion_command(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "reset") == 0)
+    {
+        portENTER_CRITICAL(&lock);
+        memset(&stats, 0, sizeof(stats));
+        portEXIT_CRITICAL(&lock);
+        return 0;
+    }
+    motion_log_summary();
+    return 0;
+}
+
+void motion_register_commands()
+{
+    const esp_console_cmd_t command = {
+        .command = "motion",
+        .help = "Print how many frames skipped detection on a still scene and the CPU time it saved, 'motion reset' clears the counts",
+        .hint = "[reset]",
+        .func = &motion_command,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&command));
+}
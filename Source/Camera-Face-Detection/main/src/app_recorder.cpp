@@ -0,0 +1,478 @@
+#include "app_recorder.hpp"
+
+#include <algorithm>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_console.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "img_converters.h"
+
+#include "app_frame_link.hpp"
+#include "app_latency.hpp"
+
+static const char TAG[] = "App/Recorder";
+
+// A results or orders chunk, encoded by the caller so the recorder task only copies it out
+typedef struct
+{
+    uint32_t type;
+    uint16_t size;
+    uint8_t payload[sizeof(record_results_t) + OVERLAY_MAX_FACES * sizeof(record_face_t)];
+} record_item_t;
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static record_stats_t stats = {};
+static bool start_requested = false;
+static bool stop_requested = false;
+static int requested_quality = -1;
+static QueueHandle_t items = nullptr; // the recorder's item queue, for the producers
+
+AppRecorder::AppRecorder(QueueHandle_t queue_i,
+                         const char *partition_label,
+                         void (*callback)(camera_fb_t *)) : Frame(queue_i, nullptr, callback),
+                                                            partition(esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partition_label)),
+                                                            jpeg_quality(RECORD_JPEG_QUALITY),
+                                                            offset(0),
+                                                            erased(0),
+                                                            sequence(0),
+                                                            queue_items(xQueueCreate(RECORD_ITEM_QUEUE, sizeof(record_item_t)))
+{
+    if (this->partition == nullptr)
+        ESP_LOGE(TAG, "No %s partition, nothing can be recorded", partition_label);
+    else
+        stats.capacity = this->partition->size;
+    // Room for a whole index at boot, clear() keeps it, so recording never allocates
+    this->index.reserve(RECORD_INDEX_MAX);
+    items = this->queue_items;
+}
+
+/* ---------------------------------------------------------------- producers */
+
+// The recorder task sets it under the lock, the producers run on other cores
+static bool recording()
+{
+    portENTER_CRITICAL(&lock);
+    bool recording = stats.recording;
+    portEXIT_CRITICAL(&lock);
+    return recording;
+}
+
+static void send_item(const record_item_t *item)
+{
+    if (items == nullptr)
+        return;
+
+    if (xQueueSend(items, item, 0) != pdTRUE)
+    {
+        portENTER_CRITICAL(&lock);
+        stats.items_lost++;
+        portEXIT_CRITICAL(&lock);
+    }
+}
+
+void record_results(const overlay_t *overlay, int64_t elapsed_us)
+{
+    if (!recording())
+        return;
+
+    record_item_t item;
+    record_results_t results = {};
+    results.capture_time = overlay->capture_time;
+    results.elapsed_us = static_cast<int32_t>(elapsed_us);
+    results.width = overlay->width;
+    results.height = overlay->height;
+    results.count = overlay->count;
+    memcpy(item.payload, &results, sizeof(results));
+
+    for (uint8_t i = 0; i < overlay->count; i++)
+    {
+        const overlay_face_t &face = overlay->faces[i];
+        record_face_t out = {};
+        memcpy(out.box, face.box, sizeof(out.box));
+        if (face.has_keypoints)
+            memcpy(out.keypoint, face.keypoint, sizeof(out.keypoint));
+        out.flags = (face.has_keypoints ? RECORD_FACE_KEYPOINTS : 0) | (face.predicted ? RECORD_FACE_PREDICTED : 0);
+        memcpy(item.payload + sizeof(results) + i * sizeof(out), &out, sizeof(out));
+    }
+    item.type = RECORD_CHUNK_RESULTS;
+    item.size = sizeof(results) + overlay->count * sizeof(record_face_t);
+    send_item(&item);
+}
+
+void record_orders(const movement_orders_t *orders)
+{
+    if (!recording())
+        return;
+
+    record_item_t item;
+    record_orders_t out;
+    out.capture_time = orders->captureTime;
+    out.latency_us = static_cast<int32_t>(orders->producedTime - orders->captureTime);
+    out.horizontal_rotation = orders->horizontalRotationAmount;
+    out.vertical_rotation = orders->verticalRotationAmount;
+    out.forward_displacement = orders->forwardDisplacementAmount;
+    out.confidence = orders->confidence;
+    memcpy(item.payload, &out, sizeof(out));
+    item.type = RECORD_CHUNK_ORDERS;
+    item.size = sizeof(out);
+    send_item(&item);
+}
+
+/* ---------------------------------------------------------------- writer */
+
+// Bytes the index chunk takes for a number of frames
+static uint32_t index_size(uint32_t frames)
+{
+    return sizeof(record_chunk_t) + std::min<uint32_t>(frames, RECORD_INDEX_MAX) * sizeof(record_index_entry_t);
+}
+
+// Append to the recording, erasing flash sector by sector just ahead of the writes
+static bool write(AppRecorder *self, const void *data, uint32_t len)
+{
+    uint32_t end = self->offset + len;
+    if (end > self->partition->size)
+        return false;
+
+    while (self->erased < end)
+    {
+        if (esp_partition_erase_range(self->partition, self->erased, self->partition->erase_size) != ESP_OK)
+            return false;
+        self->erased += self->partition->erase_size;
+    }
+    if (esp_partition_write(self->partition, self->offset, data, len) != ESP_OK)
+        return false;
+    self->offset = end;
+    return true;
+}
+
+static bool write_chunk(AppRecorder *self, uint32_t type, const void *header, uint32_t header_len, const void *data, uint32_t data_len)
+{
+    // Whatever is written, the index must still fit behind it
+    uint32_t frames = self->index.size() + (type == RECORD_CHUNK_FRAME);
+    if (self->offset + sizeof(record_chunk_t) + header_len + data_len + index_size(frames) > self->partition->size)
+        return false;
+
+    record_chunk_t chunk = {type, header_len + data_len};
+    return write(self, &chunk, sizeof(chunk)) && write(self, header, header_len) && (data_len == 0 || write(self, data, data_len));
+}
+
+static bool begin(AppRecorder *self)
+{
+    if (self->partition == nullptr)
+        return false;
+
+    self->offset = 0;
+    self->erased = 0;
+    self->sequence = 0;
+    self->index.clear();
+    xQueueReset(self->queue_items);
+
+    record_header_t header = {RECORD_MAGIC, RECORD_VERSION, 0, RECORD_UNSET, RECORD_UNSET};
+    return write(self, &header, sizeof(header));
+}
+
+// Append the index and fill in the header, on flash only erased bits are programmed
+static void finish(AppRecorder *self)
+{
+    uint32_t index_offset = self->offset;
+    if (!write_chunk(self, RECORD_CHUNK_INDEX, self->index.data(), self->index.size() * sizeof(record_index_entry_t), nullptr, 0))
+    {
+        ESP_LOGE(TAG, "Index not written, the recording can still be scanned");
+        return;
+    }
+    uint32_t fields[2] = {self->offset, index_offset};
+    esp_partition_write(self->partition, offsetof(record_header_t, length), fields, sizeof(fields));
+}
+
+static void set_recording(AppRecorder *self, bool recording)
+{
+    portENTER_CRITICAL(&lock);
+    stats.recording = recording;
+    stats.bytes = self->offset;
+    if (recording)
+    {
+        stats.frames = 0;
+        stats.dropped = 0;
+        stats.results = 0;
+        stats.orders = 0;
+        stats.items_lost = 0;
+        stats.encode_us = 0;
+        stats.write_us = 0;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+// Compress the frame and let it go before the flash writes, which take far longer
+static bool write_frame(AppRecorder *self, camera_fb_t *frame)
+{
+    record_frame_t header = {};
+    header.capture_time = latency_frame_time(frame);
+    header.sequence = self->sequence++;
+    header.width = frame->width;
+    header.height = frame->height;
+
+    int64_t start = esp_timer_get_time();
+    uint8_t *jpeg = nullptr;
+    size_t jpeg_len = 0;
+    bool compressed = self->jpeg_quality > 0 && frame2jpg(frame, self->jpeg_quality, &jpeg, &jpeg_len);
+    header.format = compressed ? RECORD_FORMAT_JPEG : RECORD_FORMAT_RGB565;
+    int64_t encoded = esp_timer_get_time();
+
+    uint32_t position = self->offset;
+    bool ok;
+    if (compressed)
+    {
+        self->callback(frame);
+        ok = write_chunk(self, RECORD_CHUNK_FRAME, &header, sizeof(header), jpeg, jpeg_len);
+        free(jpeg);
+    }
+    else
+    {
+        ok = write_chunk(self, RECORD_CHUNK_FRAME, &header, sizeof(header), frame->buf, frame->len);
+        self->callback(frame);
+    }
+    if (ok && self->index.size() < RECORD_INDEX_MAX)
+        self->index.push_back({position, header.capture_time});
+
+    portENTER_CRITICAL(&lock);
+    stats.frames += ok;
+    stats.bytes = self->offset;
+    stats.encode_us += encoded - start;
+    stats.write_us += esp_timer_get_time() - encoded;
+    portEXIT_CRITICAL(&lock);
+    return ok;
+}
+
+static void task(AppRecorder *self)
+{
+    ESP_LOGD(TAG, "Start");
+    camera_fb_t *frame = nullptr;
+    uint32_t link_dropped = 0;
+    record_item_t item;
+
+    while (self->queue_i)
+    {
+        // Wake up now and then without frames so results, orders and commands don't wait
+        bool received = frame_link_receive(self->queue_i, &frame, pdMS_TO_TICKS(100));
+
+        portENTER_CRITICAL(&lock);
+        bool recording = stats.recording;
+        bool start = start_requested && !recording;
+        bool stop = stop_requested && recording;
+        start_requested = false;
+        stop_requested = false;
+        if (requested_quality >= 0)
+            self->jpeg_quality = requested_quality;
+        requested_quality = -1;
+        portEXIT_CRITICAL(&lock);
+
+        frame_link_stats_t link;
+        frame_link_get_stats(self->queue_i, &link);
+        if (start)
+        {
+            if (begin(self))
+            {
+                link_dropped = link.dropped;
+                set_recording(self, true);
+                ESP_LOGI(TAG, "Recording to %s, %s frames", self->partition->label, self->jpeg_quality > 0 ? "JPEG" : "raw");
+            }
+            else
+            {
+                ESP_LOGE(TAG, "Cannot start a recording");
+            }
+        }
+
+        bool full = false;
+        while (xQueueReceive(self->queue_items, &item, 0) == pdTRUE)
+        {
+            if (!stats.recording || full)
+                continue;
+            full = !write_chunk(self, item.type, item.payload, item.size, nullptr, 0);
+            portENTER_CRITICAL(&lock);
+            stats.results += !full && item.type == RECORD_CHUNK_RESULTS;
+            stats.orders += !full && item.type == RECORD_CHUNK_ORDERS;
+            portEXIT_CRITICAL(&lock);
+        }
+
+        if (received)
+        {
+            if (stats.recording && !full)
+                full = !write_frame(self, frame);
+            else
+                self->callback(frame);
+        }
+
+        if (stats.recording)
+        {
+            portENTER_CRITICAL(&lock);
+            stats.dropped = link.dropped - link_dropped;
+            portEXIT_CRITICAL(&lock);
+        }
+
+        if (stats.recording && (stop || full))
+        {
+            if (full)
+                ESP_LOGW(TAG, "%s is full", self->partition->label);
+            finish(self);
+            set_recording(self, false);
+            ESP_LOGI(TAG, "Recording closed, %lu bytes", (unsigned long)self->offset);
+        }
+    }
+    ESP_LOGD(TAG, "Stop");
+    vTaskDelete(nullptr);
+}
+
+void AppRecorder::run()
+{
+    // Below AppFace on the core it shares with the camera, flash writes can wait
+    xTaskCreatePinnedToCore((TaskFunction_t)task, TAG, 4 * 1024, this, 2, nullptr, 0);
+}
+
+/* ---------------------------------------------------------------- control */
+
+void record_start(int jpeg_quality)
+{
+    portENTER_CRITICAL(&lock);
+    start_requested = true;
+    stop_requested = false;
+    requested_quality = jpeg_quality > 100 ? 100 : jpeg_quality;
+    portEXIT_CRITICAL(&lock);
+}
+
+void record_stop()
+{
+    portENTER_CRITICAL(&lock);
+    stop_requested = true;
+    start_requested = false;
+    portEXIT_CRITICAL(&lock);
+}
+
+void record_get_stats(record_stats_t *out)
+{
+    portENTER_CRITICAL(&lock);
+    *out = stats;
+    portEXIT_CRITICAL(&lock);
+}
+
+static int record_command(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "start") == 0)
+    {
+        record_start(argc > 2 ? atoi(argv[2]) : -1);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "stop") == 0)
+    {
+        record_stop();
+        return 0;
+    }
+
+    record_stats_t current;
+    record_get_stats(&current);
+    ESP_LOGI(TAG, "%s, %lu frames (%lu dropped), %lu results, %lu orders, %lu lost, %lu of %lu kB",
+             current.recording ? "Recording" : "Idle", (unsigned long)current.frames, (unsigned long)current.dropped,
+             (unsigned long)current.results, (unsigned long)current.orders, (unsigned long)current.items_lost,
+             (unsigned long)(current.bytes / 1024), (unsigned long)(current.capacity / 1024));
+    if (current.frames)
+        ESP_LOGI(TAG, "encode %lld us/frame, write %lld us/frame, %lu B/frame", current.encode_us / current.frames,
+                 current.write_us / current.frames, (unsigned long)(current.bytes / current.frames));
+    return 0;
+}
+
+void record_register_commands()
+{
+    const esp_console_cmd_t command = {
+        .command = "record",
+        .help = "Record frames, detection results and movement orders to the " RECORD_PARTITION " partition, "
+                "'record start [jpeg quality, 0 for raw]' and 'record stop', no argument prints the progress",
+        .hint = "[start [quality]|stop]",
+        .func = &record_command,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&command));
+}
+
+/* ---------------------------------------------------------------- reader */
+
+static bool known_chunk(uint32_t type)
+{
+    return type == RECORD_CHUNK_FRAME || type == RECORD_CHUNK_RESULTS || type == RECORD_CHUNK_ORDERS || type == RECORD_CHUNK_INDEX;
+}
+
+RecordReader::RecordReader() : partition(nullptr),
+                               offset(0),
+                               end(0),
+                               header{}
+{
+}
+
+bool RecordReader::open(const esp_partition_t *partition)
+{
+    this->partition = partition;
+    if (partition == nullptr || esp_partition_read(partition, 0, &this->header, sizeof(this->header)) != ESP_OK ||
+        this->header.magic != RECORD_MAGIC || this->header.version != RECORD_VERSION)
+        return false;
+
+    this->end = this->header.length != RECORD_UNSET && this->header.length <= partition->size ? this->header.length : partition->size;
+    this->offset = sizeof(this->header);
+    return true;
+}
+
+bool RecordReader::next(record_chunk_t *chunk, std::vector<uint8_t> *payload, uint32_t *position)
+{
+    if (this->offset + sizeof(record_chunk_t) > this->end ||
+        esp_partition_read(this->partition, this->offset, chunk, sizeof(record_chunk_t)) != ESP_OK ||
+        !known_chunk(chunk->type) || chunk->size > this->end - this->offset - sizeof(record_chunk_t))
+        return false;
+
+    payload->resize(chunk->size);
+    if (esp_partition_read(this->partition, this->offset + sizeof(record_chunk_t), payload->data(), chunk->size) != ESP_OK)
+        return false;
+    if (position)
+        *position = this->offset;
+    this->offset += sizeof(record_chunk_t) + chunk->size;
+    return true;
+}
+
+void RecordReader::seek(uint32_t position)
+{
+    this->offset = position;
+}
+
+bool RecordReader::frames(std::vector<record_index_entry_t> *entries)
+{
+    entries->clear();
+    record_chunk_t chunk;
+    std::vector<uint8_t> payload;
+
+    if (this->header.index_offset != RECORD_UNSET)
+    {
+        this->seek(this->header.index_offset);
+        if (this->next(&chunk, &payload) && chunk.type == RECORD_CHUNK_INDEX)
+        {
+            entries->resize(payload.size() / sizeof(record_index_entry_t));
+            memcpy(entries->data(), payload.data(), entries->size() * sizeof(record_index_entry_t));
+        }
+    }
+
+    // Cut short, or more frames than the index holds
+    if (entries->empty() || entries->size() == RECORD_INDEX_MAX)
+    {
+        entries->clear();
+        this->seek(sizeof(this->header));
+        uint32_t position;
+        while (this->next(&chunk, &payload, &position))
+        {
+            if (chunk.type != RECORD_CHUNK_FRAME || payload.size() < sizeof(record_frame_t))
+                continue;
+            record_frame_t frame;
+            memcpy(&frame, payload.data(), sizeof(frame));
+            entries->push_back({position, frame.capture_time});
+        }
+    }
+
+    this->seek(sizeof(this->header));
+    return !entries->empty();
+}
@@ -0,0 +1,59 @@
+#include "app_results.hpp"
+
+FaceResults::FaceResults() : items{},
+                             count(0),
+                             dropped(0)
+{
+}
+
+void FaceResults::assign(const std::list<dl::detect::result_t> &results)
+{
+    this->count = 0;
+    for (const dl::detect::result_t &result : results)
+    {
+        if (this->count == FACE_RESULTS_MAX)
+        {
+            this->dropped++;
+            continue;
+        }
+        face_result_t &item = this->items[this->count++];
+        item.score = result.score;
+        for (int i = 0; i < 4; i++)
+            item.box[i] = i < (int)result.box.size() ? result.box[i] : 0;
+        item.has_keypoints = result.keypoint.size() >= FACE_RESULT_KEYPOINTS;
+        for (int i = 0; item.has_keypoints && i < FACE_RESULT_KEYPOINTS; i++)
+            item.keypoint[i] = result.keypoint[i];
+    }
+}
+
+ResultList::ResultList()
+{
+    for (int i = 0; i < FACE_RESULTS_MAX; i++)
+    {
+        this->spare.emplace_back();
+        this->spare.back().box.reserve(4);
+        this->spare.back().keypoint.reserve(FACE_RESULT_KEYPOINTS);
+    }
+}
+
+std::list<dl::detect::result_t> &ResultList::fill(const FaceResults &results)
+{
+    // Nodes only move between the lists, and the vectors stay within the room reserved for them
+    this->spare.splice(this->spare.end(), this->list);
+    for (const face_result_t &item : results)
+    {
+        // Only runs short if a detector took nodes out of the list it was given
+        if (this->spare.empty())
+            this->spare.emplace_back();
+        this->list.splice(this->list.end(), this->spare, this->spare.begin());
+        dl::detect::result_t &result = this->list.back();
+        result.category = 0;
+        result.score = item.score;
+        result.box.assign(item.box, item.box + 4);
+        if (item.has_keypoints)
+            result.keypoint.assign(item.keypoint, item.keypoint + FACE_RESULT_KEYPOINTS);
+        else
+            result.keypoint.clear();
+    }
+    return this->list;
+}
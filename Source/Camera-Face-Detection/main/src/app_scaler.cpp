@@ -0,0 +1,89 @@
+#include "app_scaler.hpp"
+
+#include <algorithm>
+#include <string.h>
+
+#include "esp_log.h"
+
+static const char TAG[] = "App/Scaler";
+
+FrameScaler::FrameScaler(int output_width, int output_height) : column{},
+                                                               row{},
+                                                               output_width(std::min(output_width, SCALER_MAX_OUTPUT)),
+                                                               output_height(std::min(output_height, SCALER_MAX_OUTPUT)),
+                                                               source_width(0),
+                                                               source_height(0),
+                                                               x_offset(0),
+                                                               y_offset(0),
+                                                               width(0),
+                                                               height(0)
+{
+}
+
+bool FrameScaler::configure(int source_width, int source_height)
+{
+    if (source_width == this->source_width && source_height == this->source_height)
+        return false;
+
+    this->source_width = source_width;
+    this->source_height = source_height;
+
+    // Fit the longer side, in integers to stay off the emulated double arithmetic
+    if (source_width * this->output_height >= source_height * this->output_width)
+    {
+        this->width = this->output_width;
+        this->height = std::max(1, source_height * this->output_width / source_width);
+    }
+    else
+    {
+        this->height = this->output_height;
+        this->width = std::max(1, source_width * this->output_height / source_height);
+    }
+    this->x_offset = (this->output_width - this->width) / 2;
+    this->y_offset = (this->output_height - this->height) / 2;
+
+    // Sample at the center of the source span each output pixel covers
+    for (int x = 0; x < this->width; x++)
+        this->column[x] = (2 * x + 1) * source_width / (2 * this->width);
+    for (int y = 0; y < this->height; y++)
+        this->row[y] = (2 * y + 1) * source_height / (2 * this->height);
+
+    ESP_LOGI(TAG, "%dx%d frames shown as %dx%d at (%d, %d)", source_width, source_height, this->width, this->height, this->x_offset, this->y_offset);
+    return true;
+}
+
+void FrameScaler::scale(const uint16_t *source, uint16_t *strip, int y_start, int y_end) const
+{
+    for (int y = y_start; y < y_end; y++)
+    {
+        uint16_t *out = strip + (y - y_start) * this->output_width;
+        int picture_y = y - this->y_offset;
+        if (picture_y < 0 || picture_y >= this->height)
+        {
+            std::fill(out, out + this->output_width, SCALER_LETTERBOX_COLOR);
+            continue;
+        }
+
+        // Upscaling repeats source rows, copy the one just produced
+        if (y > y_start && picture_y > 0 && this->row[picture_y] == this->row[picture_y - 1])
+        {
+            memcpy(out, out - this->output_width, this->output_width * sizeof(uint16_t));
+            continue;
+        }
+
+        std::fill(out, out + this->x_offset, SCALER_LETTERBOX_COLOR);
+        std::fill(out + this->x_offset + this->width, out + this->output_width, SCALER_LETTERBOX_COLOR);
+
+        const uint16_t *in = source + this->row[picture_y] * this->source_width;
+        uint16_t *picture = out + this->x_offset;
+        if (this->width == this->source_width)
+        {
+            memcpy(picture, in, this->width * sizeof(uint16_t));
+        }
+        else
+        {
+            for (int x = 0; x < this->width; x++)
+                picture[x] = in[this->column[x]];
+        }
+    }
+}
@@ -0,0 +1,329 @@
+#include "app_telemetry.hpp"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstring>
+
+#include "esp_console.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+static const char TAG[] = "App/Telemetry";
+
+static const char *const heap_names[TELEMETRY_HEAP_MAX] = {"internal", "psram"};
+static const uint32_t heap_caps[TELEMETRY_HEAP_MAX] = {MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT, MALLOC_CAP_SPIRAM};
+
+typedef struct
+{
+    QueueHandle_t queue;
+    const char *name;
+    UBaseType_t length;
+    uint32_t samples;
+    uint32_t waiting; // summed over the samples
+    UBaseType_t peak;
+} watched_queue_t;
+
+typedef struct
+{
+    TaskHandle_t task;
+    uint32_t run_time;
+} run_time_t;
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static watched_queue_t queues[TELEMETRY_MAX_QUEUES];
+static uint32_t queue_count = 0;
+
+// Task snapshots are taken by the telemetry task and the console task, one at a time
+static SemaphoreHandle_t snapshot_mutex = nullptr;
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+static TaskStatus_t statuses[TELEMETRY_MAX_TASKS];
+#endif
+static telemetry_task_t snapshot[TELEMETRY_MAX_TASKS];
+static run_time_t previous[TELEMETRY_MAX_TASKS];
+static uint32_t previous_count = 0;
+static uint32_t previous_total = 0;
+static float core_loads[portNUM_PROCESSORS];
+
+void telemetry_watch_queue(QueueHandle_t queue, const char *name)
+{
+    if (queue == nullptr)
+        return;
+
+    portENTER_CRITICAL(&lock);
+    bool full = queue_count == TELEMETRY_MAX_QUEUES;
+    if (!full)
+        queues[queue_count++] = {queue, name, uxQueueMessagesWaiting(queue) + uxQueueSpacesAvailable(queue), 0, 0, 0};
+    portEXIT_CRITICAL(&lock);
+
+    if (full)
+        ESP_LOGW(TAG, "Not watching %s, %d queues are watched at most", name, TELEMETRY_MAX_QUEUES);
+}
+
+static void sample_queues()
+{
+    // Watched queues are only ever added, the ones counted here stay in place
+    portENTER_CRITICAL(&lock);
+    uint32_t count = queue_count;
+    portEXIT_CRITICAL(&lock);
+
+    UBaseType_t waiting[TELEMETRY_MAX_QUEUES];
+    for (uint32_t i = 0; i < count; i++)
+        waiting[i] = uxQueueMessagesWaiting(queues[i].queue);
+
+    portENTER_CRITICAL(&lock);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        watched_queue_t &watched = queues[i];
+        watched.samples++;
+        watched.waiting += waiting[i];
+        if (waiting[i] > watched.peak)
+            watched.peak = waiting[i];
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+uint32_t telemetry_get_tasks(telemetry_task_t *tasks, uint32_t max)
+{
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    xSemaphoreTake(snapshot_mutex, portMAX_DELAY);
+    uint32_t total = 0;
+    uint32_t count = uxTaskGetSystemState(statuses, TELEMETRY_MAX_TASKS, &total);
+    if (count == 0 && uxTaskGetNumberOfTasks() > TELEMETRY_MAX_TASKS)
+    {
+        xSemaphoreGive(snapshot_mutex);
+        ESP_LOGW(TAG, "More than %d tasks, no snapshot", TELEMETRY_MAX_TASKS);
+        return 0;
+    }
+
+    // Run times count in esp_timer microseconds and wrap, only their differences are used
+    uint32_t elapsed = total - previous_total;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const TaskStatus_t &status = statuses[i];
+        uint32_t run_time = 0;
+        for (uint32_t j = 0; j < previous_count; j++)
+        {
+            if (previous[j].task == status.xHandle)
+            {
+                run_time = previous[j].run_time;
+                break;
+            }
+        }
+        telemetry_task_t &task = snapshot[i];
+        strncpy(task.name, status.pcTaskName, sizeof(task.name) - 1);
+        task.name[sizeof(task.name) - 1] = '\0';
+        task.priority = status.uxCurrentPriority;
+        task.load = elapsed ? 100.0F * (uint32_t)(status.ulRunTimeCounter - run_time) / elapsed : 0;
+        task.stack_free = status.usStackHighWaterMark;
+    }
+
+    // A core is busy for the time its idle task did not run
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        TaskHandle_t idle = xTaskGetIdleTaskHandleForCPU(core);
+        core_loads[core] = -1;
+        for (uint32_t i = 0; idle && i < count; i++)
+        {
+            if (statuses[i].xHandle == idle)
+                core_loads[core] = std::max(0.0F, 100 - snapshot[i].load);
+        }
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+        previous[i] = {statuses[i].xHandle, (uint32_t)statuses[i].ulRunTimeCounter};
+    previous_count = count;
+    previous_total = total;
+
+    std::sort(snapshot, snapshot + count, [](const telemetry_task_t &a, const telemetry_task_t &b)
+              { return a.stack_free < b.stack_free; });
+    count = std::min(count, max);
+    memcpy(tasks, snapshot, count * sizeof(telemetry_task_t));
+    xSemaphoreGive(snapshot_mutex);
+    return count;
+#else
+    return 0;
+#endif
+}
+
+void telemetry_get_core_loads(float loads[portNUM_PROCESSORS])
+{
+    xSemaphoreTake(snapshot_mutex, portMAX_DELAY);
+    memcpy(loads, core_loads, sizeof(core_loads));
+    xSemaphoreGive(snapshot_mutex);
+}
+
+void telemetry_get_heap(telemetry_heap_region_t region, telemetry_heap_t *heap)
+{
+    uint32_t caps = heap_caps[region];
+    heap->total = heap_caps_get_total_size(caps);
+    heap->free = heap_caps_get_free_size(caps);
+    heap->min_free = heap_caps_get_minimum_free_size(caps);
+    heap->largest_block = heap_caps_get_largest_free_block(caps);
+}
+
+uint32_t telemetry_get_queues(telemetry_queue_t *out, uint32_t max)
+{
+    portENTER_CRITICAL(&lock);
+    uint32_t count = std::min(queue_count, max);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        watched_queue_t &watched = queues[i];
+        out[i] = {watched.name, watched.length, watched.peak, watched.samples ? (float)watched.waiting / watched.samples : 0};
+        watched.samples = 0;
+        watched.waiting = 0;
+        watched.peak = 0;
+    }
+    portEXIT_CRITICAL(&lock);
+    return count;
+}
+
+// Append to a summary line, stopping at its end
+static void append(char *line, size_t size, size_t *length, const char *format, ...)
+{
+    if (*length >= size - 1)
+        return;
+    va_list arguments;
+    va_start(arguments, format);
+    int written = vsnprintf(line + *length, size - *length, format, arguments);
+    va_end(arguments);
+    if (written > 0)
+        *length = std::min(*length + written, size - 1);
+}
+
+void telemetry_log_summary()
+{
+    char line[320];
+    size_t length = 0;
+    append(line, sizeof(line), &length, "cpu");
+    telemetry_task_t tasks[TELEMETRY_LOW_STACK_TASKS];
+    uint32_t task_count = telemetry_get_tasks(tasks, TELEMETRY_LOW_STACK_TASKS);
+    float loads[portNUM_PROCESSORS];
+    telemetry_get_core_loads(loads);
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        if (loads[core] < 0)
+            append(line, sizeof(line), &length, "%s-", core ? "/" : " ");
+        else
+            append(line, sizeof(line), &length, "%s%.0f%%", core ? "/" : " ", loads[core]);
+    }
+
+    append(line, sizeof(line), &length, " | stack");
+    for (uint32_t i = 0; i < task_count; i++)
+        append(line, sizeof(line), &length, " %s %lu", tasks[i].name, (unsigned long)tasks[i].stack_free);
+
+    append(line, sizeof(line), &length, " | heap");
+    for (int region = 0; region < TELEMETRY_HEAP_MAX; region++)
+    {
+        telemetry_heap_t heap;
+        telemetry_get_heap((telemetry_heap_region_t)region, &heap);
+        if (heap.total)
+            append(line, sizeof(line), &length, " %s %u/%u/%uk", heap_names[region], (unsigned)(heap.free / 1024),
+                   (unsigned)(heap.min_free / 1024), (unsigned)(heap.largest_block / 1024));
+    }
+
+    append(line, sizeof(line), &length, " | queue");
+    telemetry_queue_t watched[TELEMETRY_MAX_QUEUES];
+    uint32_t queue_count = telemetry_get_queues(watched, TELEMETRY_MAX_QUEUES);
+    for (uint32_t i = 0; i < queue_count; i++)
+        append(line, sizeof(line), &length, " %s %.1f/%u", watched[i].name, watched[i].average, (unsigned)watched[i].peak);
+
+    ESP_LOGI(TAG, "%s", line);
+    for (uint32_t i = 0; i < task_count; i++)
+    {
+        if (tasks[i].stack_free < TELEMETRY_STACK_WARNING)
+            ESP_LOGW(TAG, "%s has come within %lu bytes of its stack end", tasks[i].name, (unsigned long)tasks[i].stack_free);
+    }
+}
+
+static void print_tasks()
+{
+    telemetry_task_t tasks[TELEMETRY_MAX_TASKS];
+    uint32_t count = telemetry_get_tasks(tasks, TELEMETRY_MAX_TASKS);
+#if !CONFIG_FREERTOS_USE_TRACE_FACILITY
+    ESP_LOGW(TAG, "CONFIG_FREERTOS_USE_TRACE_FACILITY is off, no task list");
+#endif
+    float loads[portNUM_PROCESSORS];
+    telemetry_get_core_loads(loads);
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        if (loads[core] >= 0)
+            ESP_LOGI(TAG, "core %d %5.1f%% busy", core, loads[core]);
+    }
+    ESP_LOGI(TAG, "%-16s %4s %6s %10s", "task", "prio", "cpu", "stack free");
+    for (uint32_t i = 0; i < count; i++)
+        ESP_LOGI(TAG, "%-16s %4u %5.1f%% %10lu", tasks[i].name, (unsigned)tasks[i].priority, tasks[i].load,
+                 (unsigned long)tasks[i].stack_free);
+}
+
+static void print_heap()
+{
+    for (int region = 0; region < TELEMETRY_HEAP_MAX; region++)
+    {
+        telemetry_heap_t heap;
+        telemetry_get_heap((telemetry_heap_region_t)region, &heap);
+        if (heap.total == 0)
+            continue;
+        ESP_LOGI(TAG, "%-8s %u of %u bytes free, %u at the lowest, largest block %u", heap_names[region], (unsigned)heap.free,
+                 (unsigned)heap.total, (unsigned)heap.min_free, (unsigned)heap.largest_block);
+    }
+}
+
+static void print_queues()
+{
+    telemetry_queue_t watched[TELEMETRY_MAX_QUEUES];
+    uint32_t count = telemetry_get_queues(watched, TELEMETRY_MAX_QUEUES);
+    for (uint32_t i = 0; i < count; i++)
+        ESP_LOGI(TAG, "%-8s %.2f of %u waiting on average, %u at the most", watched[i].name, watched[i].average,
+                 (unsigned)watched[i].length, (unsigned)watched[i].peak);
+}
+
+static int telemetry_command(int argc, char **argv)
+{
+    const char *section = argc > 1 ? argv[1] : "";
+    bool all = section[0] == '\0';
+    if (all || strcmp(section, "tasks") == 0)
+        print_tasks();
+    if (all || strcmp(section, "heap") == 0)
+        print_heap();
+    if (all || strcmp(section, "queues") == 0)
+        print_queues();
+    return 0;
+}
+
+static void task(void *period_ms)
+{
+    uint32_t samples = reinterpret_cast<uintptr_t>(period_ms) / TELEMETRY_SAMPLE_PERIOD;
+    uint32_t sampled = 0;
+    TickType_t last_wake_time = xTaskGetTickCount();
+    while (true)
+    {
+        vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(TELEMETRY_SAMPLE_PERIOD));
+        sample_queues();
+        if (++sampled >= samples)
+        {
+            sampled = 0;
+            telemetry_log_summary();
+        }
+    }
+}
+
+void telemetry_start(uint32_t period_ms)
+{
+    snapshot_mutex = xSemaphoreCreateMutex();
+    for (float &load : core_loads)
+        load = -1;
+
+    const esp_console_cmd_t command = {
+        .command = "telemetry",
+        .help = "Print per-task CPU load and stack high-water marks, heap use and queue occupancy since the previous report",
+        .hint = "[tasks|heap|queues]",
+        .func = &telemetry_command,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&command));
+
+    // Sampling the first window starts the run-time deltas
+    telemetry_task_t first;
+    telemetry_get_tasks(&first, 1);
+
+    xTaskCreatePinnedToCore((TaskFunction_t)task, TAG, 4 * 1024, reinterpret_cast<void *>(static_cast<uintptr_t>(period_ms)), 1, nullptr, 0);
+}
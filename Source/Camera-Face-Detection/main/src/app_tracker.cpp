@@ -0,0 +1,90 @@
+#include "app_tracker.hpp"
+
+#include "esp_log.h"
+
+static const char TAG[] = "App/Tracker";
+
+BoxTracker::BoxTracker() : position{0, 0, 0, 0},
+                           velocity{0, 0, 0, 0},
+                           state_time(0),
+                           measurement_time(0),
+                           active(false)
+{
+}
+
+void BoxTracker::reset()
+{
+    this->active = false;
+}
+
+static void box_to_state(const tracker_box_t &box, float state[4])
+{
+    state[0] = (box.left + box.right) / 2;
+    state[1] = (box.top + box.bottom) / 2;
+    state[2] = box.right - box.left;
+    state[3] = box.bottom - box.top;
+}
+
+void BoxTracker::update(const tracker_box_t &box, int64_t time_us)
+{
+    float measurement[4];
+    box_to_state(box, measurement);
+
+    if (!this->active || time_us - this->measurement_time > TRACKER_PREDICTION_TIMEOUT)
+    {
+        ESP_LOGD(TAG, "New track");
+        for (int i = 0; i < 4; i++)
+        {
+            this->position[i] = measurement[i];
+            this->velocity[i] = 0;
+        }
+    }
+    else
+    {
+        float dt = (time_us - this->state_time) / 1000000.0F;
+        for (int i = 0; i < 4; i++)
+        {
+            float predicted = this->position[i] + this->velocity[i] * dt;
+            float residual = measurement[i] - predicted;
+            this->position[i] = predicted + TRACKER_ALPHA * residual;
+            if (dt > 0)
+                this->velocity[i] += TRACKER_BETA * residual / dt;
+        }
+    }
+
+    this->state_time = time_us;
+    this->measurement_time = time_us;
+    this->active = true;
+}
+
+bool BoxTracker::expire(int64_t time_us)
+{
+    int64_t age = time_us - this->measurement_time;
+    if (this->active && age >= TRACKER_PREDICTION_TIMEOUT)
+    {
+        ESP_LOGD(TAG, "Track lost after %lld ms without a detection", age / 1000);
+        this->active = false;
+    }
+    return this->active;
+}
+
+bool BoxTracker::predict(int64_t time_us, tracker_box_t *box, float *confidence) const
+{
+    int64_t age = time_us - this->measurement_time;
+    if (!this->active || age >= TRACKER_PREDICTION_TIMEOUT)
+        return false;
+
+    float dt = (time_us - this->state_time) / 1000000.0F;
+    float state[4];
+    for (int i = 0; i < 4; i++)
+        state[i] = this->position[i] + this->velocity[i] * dt;
+    state[2] = state[2] > 1 ? state[2] : 1;
+    state[3] = state[3] > 1 ? state[3] : 1;
+
+    box->left = state[0] - state[2] / 2;
+    box->right = state[0] + state[2] / 2;
+    box->top = state[1] - state[3] / 2;
+    box->bottom = state[1] + state[3] / 2;
+    *confidence = 1.0F - static_cast<float>(age) / TRACKER_PREDICTION_TIMEOUT;
+    return true;
+}
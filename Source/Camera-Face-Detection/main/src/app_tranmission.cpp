@@ -1,20 +1,100 @@
 #include <cstring>
 #include "app_transmission.hpp"
 
+#include "esp_console.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "esp_wifi.h"
 #include "esp_mac.h"
+#include "esp_timer.h"
 
-#define TRANSMISSION_MIN_DELAY 100
+#include "app_latency.hpp"
+#include "app_led.hpp"
+#include "app_wire.hpp"
 
 static const char TAG[] = "App/Transmission";
 
+static const char *const kind_names[] = {"movement orders", "heartbeat", "no target"};
+
+static const char camera_hello[] = "ARDUINO_ALVIK_CAMERA_FACEDETECTOR_:P";
+
 static bool dest_mac_set = false;
 static uint8_t dest_mac[ESP_NOW_ETH_ALEN];
 
-AppTransmission::AppTransmission(uint32_t channel, QueueHandle_t queue_i_movement_orders) : queue_i_movement_orders(queue_i_movement_orders), channel(channel)
+// What the Wi-Fi task's callbacks hand over to the transmission task, which keeps all the link state
+typedef enum
+{
+    LINK_EVENT_SENT = 0, // send callback, for the oldest frame in flight
+    LINK_EVENT_HELLO,    // the Alvik's broadcast, to be answered
+    LINK_EVENT_ECHO,     // the Alvik's heartbeat, echoing the sequence number of a frame it got
+} link_event_type_t;
+
+typedef struct
+{
+    link_event_type_t type;
+    bool delivered;
+    uint16_t sequence;
+    int8_t rssi;
+    int64_t time;
+} link_event_t;
+
+static QueueHandle_t link_events = nullptr;
+
+typedef struct
+{
+    uint16_t sequence;
+    bool orders;     // false for the hellos, which are not counted
+    uint8_t attempt; // 0 for the first send
+    int64_t time;    // handed to the radio
+} link_in_flight_t;
+
+typedef struct
+{
+    uint16_t sequence;
+    bool echoed;
+    int64_t time; // of the latest attempt
+} link_sent_t;
+
+// Owned by the transmission task
+typedef struct
+{
+    wire_movement_orders_t frame; // newest frame sent, resent while not acknowledged
+    uint16_t sequence;            // of frame
+    link_in_flight_t in_flight[TRANSMISSION_IN_FLIGHT]; // in send order, which is the order of the callbacks
+    uint32_t in_flight_head;
+    uint32_t in_flight_count;
+    link_sent_t sent[TRANSMISSION_SEND_LOG]; // by sequence number modulo TRANSMISSION_SEND_LOG
+    int64_t heard_time;                       // last frame from the Alvik
+    int64_t stats_time;                       // last statistics line
+    bool send_error_logged;                   // since the last statistics line
+} link_state_t;
+
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static transmission_stats_t stats = {};
+static int64_t delivered_time = 0; // last frame the Alvik acknowledged
+
+AppTransmission::AppTransmission(uint32_t channel, QueueHandle_t queue_i_movement_orders, uint32_t period_ms) : queue_i_movement_orders(queue_i_movement_orders),
+                                                                                                             channel(channel),
+                                                                                                             period_ms(period_ms),
+                                                                                                             stats_period_ms(TRANSMISSION_STATS_PERIOD),
+                                                                                                             radio_ready(false),
+                                                                                                             link_alive(false)
+{
+}
+
+static void post_event(const link_event_t &event)
+{
+    if (xQueueSend(link_events, &event, 0) != pdTRUE)
+        ESP_LOGD(TAG, "Link event queue full, event %d dropped", event.type);
+}
+
+static void espnow_send_cb(const uint8_t *mac_addr, esp_now_send_status_t status)
 {
+    link_event_t event = {};
+    event.type = LINK_EVENT_SENT;
+    event.delivered = status == ESP_NOW_SEND_SUCCESS;
+    event.time = esp_timer_get_time();
+    post_event(event);
 }
 
 static void espnow_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
@@ -27,6 +107,20 @@ static void espnow_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *
     }
 
     uint8_t * mac_addr = recv_info->src_addr;
+    link_event_t event = {};
+    event.rssi = recv_info->rx_ctrl ? recv_info->rx_ctrl->rssi : 0;
+    event.time = esp_timer_get_time();
+
+    // Heartbeats come every period, they are not logged
+    if (wire_decode_heartbeat(data, len, &event.sequence))
+    {
+        if (dest_mac_set && memcmp(mac_addr, dest_mac, ESP_NOW_ETH_ALEN) == 0)
+        {
+            event.type = LINK_EVENT_ECHO;
+            post_event(event);
+        }
+        return;
+    }
 
     ESP_LOGI(TAG, "Received a ESP-NOW message from mac: " MACSTR " with len: %d", MAC2STR(mac_addr), len);
     ESP_LOG_BUFFER_HEXDUMP(TAG, data, len, ESP_LOG_DEBUG);
@@ -54,16 +148,22 @@ static void espnow_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *
             ESP_LOGI(TAG, "Destination MAC set to " MACSTR, MAC2STR(dest_mac));
         }
 
-        ESP_ERROR_CHECK( esp_now_send(dest_mac, (uint8_t *)"ARDUINO_ALVIK_CAMERA_FACEDETECTOR_:P", sizeof("ARDUINO_ALVIK_CAMERA_FACEDETECTOR_:P")) );
-        ESP_LOGI(TAG, "Connected to Arduino Alvik");
+        // Answered by the task, so the answer's send callback is in the in-flight list
+        event.type = LINK_EVENT_HELLO;
+        post_event(event);
     }
 }
 
-static void task(AppTransmission *self)
+void AppTransmission::init()
 {
-    ESP_LOGD(TAG, "Start");
+    if (this->radio_ready)
+        return;
 
     dest_mac_set = false;
+    led_set_status(LED_STATUS_LINK_UP, 0);
+    if (link_events == nullptr)
+        link_events = xQueueCreate(2 * TRANSMISSION_IN_FLIGHT, sizeof(link_event_t));
+    xQueueReset(link_events);
 
     // Initialize NVS
     esp_err_t ret = nvs_flash_init();
@@ -81,10 +181,11 @@ static void task(AppTransmission *self)
     ESP_ERROR_CHECK( esp_wifi_set_storage(WIFI_STORAGE_RAM) );
     ESP_ERROR_CHECK( esp_wifi_set_mode(WIFI_MODE_STA) );
     ESP_ERROR_CHECK( esp_wifi_start());
-    ESP_ERROR_CHECK( esp_wifi_set_channel(self->channel, WIFI_SECOND_CHAN_NONE));
+    ESP_ERROR_CHECK( esp_wifi_set_channel(this->channel, WIFI_SECOND_CHAN_NONE));
 
     ESP_ERROR_CHECK( esp_now_init() );
     ESP_ERROR_CHECK( esp_now_register_recv_cb(espnow_recv_cb) );
+    ESP_ERROR_CHECK( esp_now_register_send_cb(espnow_send_cb) );
 
     esp_now_peer_info_t peer_info;
     memset(&peer_info, 0, sizeof(esp_now_peer_info_t));
@@ -96,10 +197,212 @@ static void task(AppTransmission *self)
     ESP_ERROR_CHECK( esp_now_add_peer(&peer_info) );
 
     ESP_LOGI(TAG, "ESP-NOW ready");
+    this->radio_ready = true;
+}
+
+void transmission_get_stats(transmission_stats_t *out)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    // A gap still open counts too, it is the one that matters once the radio is gone
+    if (delivered_time && now - delivered_time > out->longest_gap_us)
+        out->longest_gap_us = now - delivered_time;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+void transmission_reset_stats()
+{
+    portENTER_CRITICAL(&stats_lock);
+    uint8_t peer[ESP_NOW_ETH_ALEN];
+    memcpy(peer, stats.peer, sizeof(peer));
+    stats = {};
+    memcpy(stats.peer, peer, sizeof(peer));
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+void transmission_log_stats()
+{
+    transmission_stats_t link;
+    transmission_get_stats(&link);
+    uint32_t acknowledged = link.delivered + link.failed;
+    ESP_LOGI(TAG, "Alvik " MACSTR ": %u of %u frames delivered (%.1f%%), %u retries, %u send errors, %u held, longest gap %.0f ms, "
+                  "RTT avg %.1f ms max %.1f ms over %u echoes, RSSI %d dBm (min %d)",
+             MAC2STR(link.peer), (unsigned)link.delivered, (unsigned)acknowledged, acknowledged ? 100.0 * link.delivered / acknowledged : 0.0,
+             (unsigned)link.retries, (unsigned)link.send_errors, (unsigned)link.held, link.longest_gap_us / 1000.0,
+             link.echoes ? link.rtt_total_us / 1000.0 / link.echoes : 0.0, link.rtt_max_us / 1000.0, (unsigned)link.echoes,
+             link.rssi, link.rssi_min);
+}
+
+// Hand a frame to the radio and queue it for its send callback. Failures to send, and frames
+// held back while the callbacks are behind, are counted rather than fatal, the next period sends again anyway.
+static bool send_frame(link_state_t *link, const uint8_t *mac, const void *data, size_t len, bool orders, uint8_t attempt)
+{
+    // Callbacks are matched by their order alone: dropping an entry to make room would credit
+    // every later callback to the frame after its own. Only callbacks the radio lost are given up on.
+    int64_t now = esp_timer_get_time();
+    if (link->in_flight_count == TRANSMISSION_IN_FLIGHT)
+    {
+        if (now - link->in_flight[link->in_flight_head].time < TRANSMISSION_CALLBACK_TIMEOUT * 1000)
+        {
+            ESP_LOGD(TAG, "%d frames without a send callback, holding frame %u back", TRANSMISSION_IN_FLIGHT, link->sequence);
+            if (orders)
+            {
+                portENTER_CRITICAL(&stats_lock);
+                stats.held++;
+                portEXIT_CRITICAL(&stats_lock);
+            }
+            return false;
+        }
+        ESP_LOGW(TAG, "No send callback for %d ms, forgetting the %d frames waiting for one", TRANSMISSION_CALLBACK_TIMEOUT, TRANSMISSION_IN_FLIGHT);
+        link->in_flight_count = 0;
+    }
+
+    // The callback, and even the echo, can come before esp_now_send() returns, the entries go in first
+    link_in_flight_t &entry = link->in_flight[(link->in_flight_head + link->in_flight_count) % TRANSMISSION_IN_FLIGHT];
+    entry = {link->sequence, orders, attempt, now};
+    link->in_flight_count++;
+    if (orders)
+        link->sent[link->sequence % TRANSMISSION_SEND_LOG] = {link->sequence, false, now};
+
+    esp_err_t err = esp_now_send(mac, (const uint8_t *)data, len);
+    if (err != ESP_OK)
+    {
+        link->in_flight_count--;
+        if (!link->send_error_logged)
+            ESP_LOGW(TAG, "esp_now_send() failed: %s", esp_err_to_name(err));
+        link->send_error_logged = true;
+        if (orders)
+        {
+            portENTER_CRITICAL(&stats_lock);
+            stats.send_errors++;
+            portEXIT_CRITICAL(&stats_lock);
+        }
+        return false;
+    }
+
+    if (orders)
+    {
+        portENTER_CRITICAL(&stats_lock);
+        stats.sent++;
+        if (attempt)
+            stats.retries++;
+        portEXIT_CRITICAL(&stats_lock);
+    }
+    return true;
+}
 
-    movement_orders_t orders;
+static void handle_sent(link_state_t *link, const link_event_t &event)
+{
+    // A callback for a frame sent before the radio was restarted, or given up on
+    if (link->in_flight_count == 0)
+        return;
+    link_in_flight_t entry = link->in_flight[link->in_flight_head];
+    link->in_flight_head = (link->in_flight_head + 1) % TRANSMISSION_IN_FLIGHT;
+    link->in_flight_count--;
+    if (!entry.orders)
+        return;
+
+    portENTER_CRITICAL(&stats_lock);
+    if (event.delivered)
+    {
+        stats.delivered++;
+        if (delivered_time && event.time - delivered_time > stats.longest_gap_us)
+            stats.longest_gap_us = event.time - delivered_time;
+        delivered_time = event.time;
+    }
+    else
+        stats.failed++;
+    portEXIT_CRITICAL(&stats_lock);
+
+    if (event.delivered)
+        return;
+
+    // Only the newest frame is worth another try, an older one has been superseded
+    if (entry.sequence != link->sequence || entry.attempt >= TRANSMISSION_MAX_RETRIES)
+    {
+        ESP_LOGD(TAG, "Frame %u not acknowledged", entry.sequence);
+        return;
+    }
+    ESP_LOGD(TAG, "Frame %u not acknowledged, sending it again", entry.sequence);
+    send_frame(link, dest_mac, &link->frame, sizeof(link->frame), true, entry.attempt + 1);
+}
+
+static void handle_heard(link_state_t *link, const link_event_t &event)
+{
+    link->heard_time = event.time;
+    portENTER_CRITICAL(&stats_lock);
+    stats.rssi = event.rssi;
+    if (stats.rssi_min == 0 || event.rssi < stats.rssi_min)
+        stats.rssi_min = event.rssi;
+    if (event.type == LINK_EVENT_ECHO)
+    {
+        // The round trip includes the Alvik's own time to answer, a resent frame is timed from its latest attempt
+        link_sent_t &sent = link->sent[event.sequence % TRANSMISSION_SEND_LOG];
+        if (sent.sequence == event.sequence && !sent.echoed)
+        {
+            int64_t rtt = event.time - sent.time;
+            sent.echoed = true;
+            stats.echoes++;
+            stats.rtt_total_us += rtt;
+            if (rtt > stats.rtt_max_us)
+                stats.rtt_max_us = rtt;
+        }
+    }
+    else
+        memcpy(stats.peer, dest_mac, ESP_NOW_ETH_ALEN);
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+static void handle_event(link_state_t *link, const link_event_t &event)
+{
+    switch (event.type)
+    {
+    case LINK_EVENT_SENT:
+        handle_sent(link, event);
+        break;
+    case LINK_EVENT_HELLO:
+        handle_heard(link, event);
+        if (send_frame(link, dest_mac, camera_hello, sizeof(camera_hello), false, 0))
+            ESP_LOGI(TAG, "Connected to Arduino Alvik");
+        break;
+    case LINK_EVENT_ECHO:
+        handle_heard(link, event);
+        break;
+    }
+}
+
+// The link is up while the Alvik's heartbeats keep coming, the LED shows it
+static void update_link(AppTransmission *self, const link_state_t *link, int64_t now)
+{
+    bool alive = dest_mac_set && now - link->heard_time < TRANSMISSION_LINK_TIMEOUT * 1000;
+    if (alive == self->link_alive)
+        return;
 
-    TickType_t last_wake_time = xTaskGetTickCount();
+    self->link_alive = alive;
+    led_set_status(LED_STATUS_LINK_UP, alive ? LED_STATUS_LINK_UP : 0);
+    if (alive)
+        ESP_LOGI(TAG, "Link to the Alvik up");
+    else
+        ESP_LOGW(TAG, "No heartbeat from the Alvik for %d ms, link down", TRANSMISSION_LINK_TIMEOUT);
+}
+
+static void task(AppTransmission *self)
+{
+    ESP_LOGD(TAG, "Start");
+    self->init();
+
+    uint8_t broadcast_mac[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    movement_orders_t orders = {}; // no target until AppFace follows a face
+    int64_t orders_time = 0;
+    uint16_t sequence = 0;
+    // Off the 4 KB stack: the in-flight list and the send log are most of a kilobyte
+    static link_state_t state;
+    state = {};
+    link_state_t *link = &state;
+    link->stats_time = esp_timer_get_time();
+
+    TickType_t next_wake_time = xTaskGetTickCount() + pdMS_TO_TICKS(self->period_ms);
     while (true)
     {
         if (self->queue_i_movement_orders == nullptr)
@@ -107,36 +410,68 @@ static void task(AppTransmission *self)
             break;
         }
 
-        if (xQueueReceive(self->queue_i_movement_orders, &orders, portMAX_DELAY) == pdTRUE)
+        // Callbacks are handled as they come, between two periods
+        TickType_t wait = next_wake_time - xTaskGetTickCount();
+        if ((int32_t)wait < 0)
+            wait = 0;
+        link_event_t event;
+        if (xQueueReceive(link_events, &event, wait) == pdTRUE)
         {
-            ESP_LOGI(TAG, "Received Movement - horizontalRotationAmount: %f\tverticalRotationAmount: %f\tforwardDisplacementAmount: %f", orders.horizontalRotationAmount, orders.verticalRotationAmount, orders.forwardDisplacementAmount);
+            handle_event(link, event);
+            continue;
+        }
+        next_wake_time += pdMS_TO_TICKS(self->period_ms);
 
-            if(xTaskGetTickCount() - last_wake_time >= pdMS_TO_TICKS(TRANSMISSION_MIN_DELAY))
+        bool fresh = xQueueReceive(self->queue_i_movement_orders, &orders, 0) == pdTRUE;
+        int64_t now = esp_timer_get_time();
+        if (fresh)
+        {
+            ESP_LOGI(TAG, "Received Movement - horizontalRotationAmount: %f\tverticalRotationAmount: %f\tforwardDisplacementAmount: %f\tconfidence: %f", orders.horizontalRotationAmount, orders.verticalRotationAmount, orders.forwardDisplacementAmount, orders.confidence);
+            orders_time = now;
+            latency_record(LATENCY_HOP_FACE_TO_TRANSMISSION, orders_time - orders.producedTime);
+        }
+        else if (orders.target && now - orders_time > TRANSMISSION_ORDERS_TIMEOUT * 1000)
+        {
+            ESP_LOGD(TAG, "No new orders for %d ms, sending no target", TRANSMISSION_ORDERS_TIMEOUT);
+            orders = {}; // AppFace stopped, heartbeats turn into no-target once the orders are stale
+        }
+        update_link(self, link, now);
+
+        if (dest_mac_set)
+        {
+            wire_kind_t kind = !orders.target ? WIRE_KIND_NO_TARGET : (fresh ? WIRE_KIND_ORDERS : WIRE_KIND_HEARTBEAT);
+            ESP_LOGD(TAG, "Sending %s %u to " MACSTR, kind_names[kind], sequence, MAC2STR(dest_mac));
+            link->sequence = sequence;
+            wire_encode_orders(orders, kind, sequence++, &link->frame);
+            int64_t send_time = esp_timer_get_time();
+            bool sent = send_frame(link, dest_mac, &link->frame, sizeof(link->frame), true, 0);
+            int64_t sent_time = esp_timer_get_time();
+            if (fresh && sent)
             {
-                last_wake_time = xTaskGetTickCount();
-
-                if (dest_mac_set)
-                {
-                    char buff[ESP_NOW_MAX_DATA_LEN+1];
-                    ESP_LOGD(TAG, "Sending movement orders to " MACSTR, MAC2STR(dest_mac));
-                    int size = std::max(snprintf(buff, ESP_NOW_MAX_DATA_LEN, "%f,%f,%f", orders.horizontalRotationAmount, orders.verticalRotationAmount, orders.forwardDisplacementAmount), ESP_NOW_MAX_DATA_LEN);
-                    ESP_ERROR_CHECK( esp_now_send(dest_mac, (uint8_t *)buff, size) );
-                }
-                else
-                {
-                    char buff[ESP_NOW_MAX_DATA_LEN+1];
-                    ESP_LOGD(TAG, "Sending broadcast message to Arduino Alvik to reconnect");
-                    int size = std::max(snprintf(buff, ESP_NOW_MAX_DATA_LEN, "ARDUINO_ALVIK_CAMERA_FACEDETECTOR_:P"), ESP_NOW_MAX_DATA_LEN);
-                    ESP_ERROR_CHECK( esp_now_send(broadcast_mac, (uint8_t *)buff, size) );
-                }
+                latency_record(LATENCY_STAGE_SEND, sent_time - send_time);
+                latency_record(LATENCY_CAPTURE_TO_SEND, sent_time - orders.captureTime);
+            }
+
+            if (now - link->stats_time >= (int64_t)self->stats_period_ms * 1000)
+            {
+                transmission_log_stats();
+                transmission_reset_stats();
+                link->stats_time = now;
+                link->send_error_logged = false;
             }
         }
+        else if (fresh)
+        {
+            ESP_LOGD(TAG, "Sending broadcast message to Arduino Alvik to reconnect");
+            send_frame(link, broadcast_mac, camera_hello, sizeof(camera_hello), false, 0);
+        }
     }
 
     esp_now_deinit();
 
     esp_wifi_stop();
     esp_wifi_deinit();
+    self->radio_ready = false;
 
     ESP_LOGD(TAG, "Stop");
     vTaskDelete(nullptr);
@@ -146,3 +481,25 @@ void AppTransmission::run()
 {
     xTaskCreatePinnedToCore((TaskFunction_t)task, TAG, 4 * 1024, this, 5, nullptr, 1);
 }
+
+static int radio_command(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "reset") == 0)
+    {
+        transmission_reset_stats();
+        return 0;
+    }
+    transmission_log_stats();
+    return 0;
+}
+
+void transmission_register_commands()
+{
+    const esp_console_cmd_t command = {
+        .command = "radio",
+        .help = "Print the ESP-NOW link statistics to the Alvik, 'radio reset' clears them",
+        .hint = "[reset]",
+        .func = &radio_command,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&command));
+}
@@ -0,0 +1,76 @@
+#include "app_wire.hpp"
+
+#include <cmath>
+#include <cstring>
+
+static int16_t to_fixed(float value, float scale)
+{
+    float fixed = std::round(value * scale);
+    if (fixed > INT16_MAX)
+        return INT16_MAX;
+    if (fixed < INT16_MIN)
+        return INT16_MIN;
+    return static_cast<int16_t>(fixed);
+}
+
+void wire_encode_orders(const movement_orders_t &orders, wire_kind_t kind, uint16_t sequence, wire_movement_orders_t *frame)
+{
+    float confidence = orders.confidence < 0 ? 0 : (orders.confidence > 1 ? 1 : orders.confidence);
+    bool stop = kind == WIRE_KIND_NO_TARGET;
+
+    frame->magic = WIRE_MAGIC;
+    frame->version = WIRE_VERSION;
+    frame->kind = kind;
+    frame->sequence = sequence;
+    frame->capture_time = static_cast<uint32_t>(orders.captureTime);
+    frame->horizontal_rotation = stop ? 0 : to_fixed(orders.horizontalRotationAmount, WIRE_ROTATION_SCALE);
+    frame->vertical_rotation = stop ? 0 : to_fixed(orders.verticalRotationAmount, WIRE_ROTATION_SCALE);
+    frame->forward_displacement = stop ? 0 : to_fixed(orders.forwardDisplacementAmount, WIRE_DISPLACEMENT_SCALE);
+    frame->confidence = stop ? 0 : static_cast<uint8_t>(std::round(confidence * WIRE_CONFIDENCE_SCALE));
+}
+
+bool wire_decode_orders(const uint8_t *data, size_t len, movement_orders_t *orders, uint16_t *sequence, wire_kind_t *kind)
+{
+    wire_movement_orders_t frame;
+    if (len < sizeof(frame))
+        return false;
+
+    memcpy(&frame, data, sizeof(frame));
+    if (frame.magic != WIRE_MAGIC || frame.version != WIRE_VERSION || frame.kind > WIRE_KIND_NO_TARGET)
+        return false;
+
+    orders->horizontalRotationAmount = static_cast<float>(frame.horizontal_rotation) / WIRE_ROTATION_SCALE;
+    orders->verticalRotationAmount = static_cast<float>(frame.vertical_rotation) / WIRE_ROTATION_SCALE;
+    orders->forwardDisplacementAmount = static_cast<float>(frame.forward_displacement) / WIRE_DISPLACEMENT_SCALE;
+    orders->confidence = static_cast<float>(frame.confidence) / WIRE_CONFIDENCE_SCALE;
+    orders->captureTime = frame.capture_time;
+    orders->producedTime = 0;
+    orders->target = frame.kind != WIRE_KIND_NO_TARGET;
+    if (sequence)
+        *sequence = frame.sequence;
+    if (kind)
+        *kind = static_cast<wire_kind_t>(frame.kind);
+    return true;
+}
+
+void wire_encode_heartbeat(uint16_t sequence, wire_heartbeat_t *frame)
+{
+    frame->magic = WIRE_MAGIC;
+    frame->version = WIRE_VERSION;
+    frame->kind = WIRE_KIND_ALVIK_HEARTBEAT;
+    frame->sequence = sequence;
+}
+
+bool wire_decode_heartbeat(const uint8_t *data, size_t len, uint16_t *sequence)
+{
+    wire_heartbeat_t frame;
+    if (len < sizeof(frame))
+        return false;
+
+    memcpy(&frame, data, sizeof(frame));
+    if (frame.magic != WIRE_MAGIC || frame.version != WIRE_VERSION || frame.kind != WIRE_KIND_ALVIK_HEARTBEAT)
+        return false;
+    if (sequence)
+        *sequence = frame.sequence;
+    return true;
+}